@@ -8,34 +8,194 @@ SDL_CFLAGS=$(pkg-config --cflags sdl2)
 SDL_LIBS=$(pkg-config --libs sdl2)
 
 # Common compiler flags
-# Put our include directory first so our SDL.h is found before system ones
-CFLAGS="-I./include -Wall -Wextra $SDL_CFLAGS"
+# Put our include directory first so our SDL.h is found before system ones.
+# Compilers fuse multiplies and adds into FMA instructions where the target
+# has them, which rounds differently, so that is turned off to keep results
+# the same across compilers and machines.
+CFLAGS="-I./include -Wall -Wextra -ffp-contract=off $SDL_CFLAGS"
 
 # Compile source files
 gcc $CFLAGS -c src/main.c -o build/main.o
 gcc $CFLAGS -c src/physics/physics.c -o build/physics.o
+gcc $CFLAGS -c src/physics/contacts.c -o build/contacts.o
+gcc $CFLAGS -c src/physics/body_pool.c -o build/body_pool.o
+gcc $CFLAGS -c src/physics/reorder.c -o build/reorder.o
+gcc $CFLAGS -c src/physics/islands.c -o build/islands.o
+gcc $CFLAGS -c src/physics/ccd.c -o build/ccd.o
+gcc $CFLAGS -c src/physics/neighbors.c -o build/neighbors.o
+gcc $CFLAGS -c src/physics/xpbd.c -o build/xpbd.o
+gcc $CFLAGS -c src/physics/events.c -o build/events.o
+gcc $CFLAGS -c src/physics/field.c -o build/field.o
+gcc $CFLAGS -c src/physics/particle_mesh.c -o build/particle_mesh.o
+gcc $CFLAGS -c src/physics/state_hash.c -o build/state_hash.o
+gcc $CFLAGS -c src/io/snapshot.c -o build/snapshot.o
+gcc $CFLAGS -c src/io/trajectory.c -o build/trajectory.o
+gcc $CFLAGS -c src/io/scene.c -o build/scene.o
+gcc $CFLAGS -c src/io/session.c -o build/session.o
+gcc $CFLAGS -c src/io/history.c -o build/history.o
+gcc $CFLAGS -c src/io/state_publisher.c -o build/state_publisher.o
+gcc $CFLAGS -c src/io/state_buffer.c -o build/state_buffer.o
+gcc $CFLAGS -c src/net/replica.c -o build/replica.o
+gcc $CFLAGS -c src/net/replication.c -o build/replication.o
+gcc $CFLAGS -c src/net/domain.c -o build/domain.o
 gcc $CFLAGS -c src/render/renderer.c -o build/renderer.o
 gcc $CFLAGS -c src/utils/random.c -o build/random.o
+gcc $CFLAGS -c src/utils/thread_pool.c -o build/thread_pool.o
+gcc $CFLAGS -c src/utils/fft.c -o build/fft.o
+gcc $CFLAGS -c src/utils/encoding.c -o build/encoding.o
 gcc $CFLAGS -c src/ui/ui.c -o build/ui.o
 gcc $CFLAGS -c src/ui/nuklear_impl.c -o build/nuklear_impl.o
+gcc $CFLAGS -c src/bench/bench.c -o build/bench.o
+gcc $CFLAGS -c src/check/check.c -o build/check.o
+gcc $CFLAGS -c src/watch/watch.c -o build/watch.o
+gcc $CFLAGS -c src/slabs/slabs.c -o build/slabs.o
 
 # Link object files
 gcc build/main.o \
     build/physics.o \
+    build/contacts.o \
+    build/body_pool.o \
+    build/reorder.o \
+    build/islands.o \
+    build/ccd.o \
+    build/neighbors.o \
+    build/xpbd.o \
+    build/events.o \
+    build/field.o \
+    build/particle_mesh.o \
+    build/state_hash.o \
+    build/history.o \
+    build/snapshot.o \
+    build/trajectory.o \
+    build/scene.o \
+    build/session.o \
+    build/state_publisher.o \
+    build/replica.o \
+    build/replication.o \
     build/renderer.o \
     build/random.o \
+    build/thread_pool.o \
+    build/fft.o \
+    build/encoding.o \
     build/ui.o \
     build/nuklear_impl.o \
     -o build/engine \
     $SDL_LIBS \
     -lm \
+    -lpthread \
     -framework OpenGL \
     -framework Cocoa
+ENGINE_STATUS=$?
+
+# Link the headless benchmark, which needs no windowing libraries
+gcc build/bench.o \
+    build/physics.o \
+    build/contacts.o \
+    build/body_pool.o \
+    build/reorder.o \
+    build/islands.o \
+    build/ccd.o \
+    build/neighbors.o \
+    build/xpbd.o \
+    build/events.o \
+    build/field.o \
+    build/particle_mesh.o \
+    build/state_hash.o \
+    build/history.o \
+    build/snapshot.o \
+    build/trajectory.o \
+    build/scene.o \
+    build/session.o \
+    build/state_publisher.o \
+    build/replica.o \
+    build/replication.o \
+    build/random.o \
+    build/thread_pool.o \
+    build/fft.o \
+    build/encoding.o \
+    -o build/bench \
+    -lm \
+    -lpthread
+BENCH_STATUS=$?
+
+# Link the regression checks, which need no windowing libraries either
+gcc build/check.o \
+    build/physics.o \
+    build/contacts.o \
+    build/body_pool.o \
+    build/reorder.o \
+    build/islands.o \
+    build/ccd.o \
+    build/neighbors.o \
+    build/xpbd.o \
+    build/events.o \
+    build/field.o \
+    build/particle_mesh.o \
+    build/state_hash.o \
+    build/history.o \
+    build/snapshot.o \
+    build/trajectory.o \
+    build/scene.o \
+    build/session.o \
+    build/state_publisher.o \
+    build/replica.o \
+    build/replication.o \
+    build/random.o \
+    build/thread_pool.o \
+    build/fft.o \
+    build/encoding.o \
+    -o build/check \
+    -lm \
+    -lpthread
+CHECK_STATUS=$?
+
+# Link the state viewer, which only needs the buffer and wire layouts
+gcc build/watch.o \
+    build/state_buffer.o \
+    build/replica.o \
+    build/encoding.o \
+    -o build/watch \
+    -lm
+WATCH_STATUS=$?
+
+# Link the split runner, which steps slabs of a scene in separate processes
+gcc build/slabs.o \
+    build/domain.o \
+    build/scene.o \
+    build/physics.o \
+    build/contacts.o \
+    build/body_pool.o \
+    build/reorder.o \
+    build/islands.o \
+    build/ccd.o \
+    build/neighbors.o \
+    build/xpbd.o \
+    build/events.o \
+    build/field.o \
+    build/particle_mesh.o \
+    build/state_hash.o \
+    build/history.o \
+    build/trajectory.o \
+    build/state_publisher.o \
+    build/replica.o \
+    build/replication.o \
+    build/random.o \
+    build/thread_pool.o \
+    build/fft.o \
+    build/encoding.o \
+    -o build/slabs \
+    -lm \
+    -lpthread
+SLABS_STATUS=$?
 
 # Check if build succeeded
-if [ $? -eq 0 ]; then
+if [ $ENGINE_STATUS -eq 0 ] && [ $BENCH_STATUS -eq 0 ] && [ $CHECK_STATUS -eq 0 ] && [ $WATCH_STATUS -eq 0 ] && [ $SLABS_STATUS -eq 0 ]; then
     echo "Build successful!"
     echo "Run ./build/engine to start the application"
+    echo "Run ./build/bench to benchmark the solver headless, or ./build/bench replay <session>"
+    echo "Run ./build/check to run the regression checks"
+    echo "Run ./build/watch to follow a running engine"
+    echo "Run ./build/slabs <scene> to step a scene split across processes"
 else
     echo "Build failed!"
 fi
\ No newline at end of file
@@ -0,0 +1,425 @@
+#include "../core/types.h"
+#include "../physics/physics.h"
+#include "../physics/body_pool.h"
+#include "../io/session.h"
+#include "../utils/random.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Headless benchmark: runs each scene under each solver configuration and
+// reports step cost alongside the solver counters
+
+#define BENCH_SEED 42
+#define CHURN_PER_STEP 20   // Bodies the churn scene despawns and respawns each step
+
+typedef struct {
+    const char* name;
+    int bodyCount;
+    int steps;
+    float dt;
+    void (*setup)(World* world, int count);
+    void (*tick)(World* world);   // Optional per-step change to the scene, run before each step
+    bool hardDisks;     // Coasting bodies that start apart, as the event solver expects
+} Scene;
+
+typedef struct {
+    const char* name;
+    void (*configure)(World* world);
+    bool hardDisksOnly;
+} Mode;
+
+// Overrides applied to every run
+typedef struct {
+    int threads;            // 0 keeps the world's default
+} Options;
+
+static void setup_pile(World* world, int count) {
+    for (int i = 0; i < count; i++) {
+        spawn_body(world, create_body(
+            random_float(20, WINDOW_WIDTH - 20),
+            random_float(20, WINDOW_HEIGHT / 2),
+            random_float(-50, 50),
+            random_float(-50, 50),
+            random_float(0.5f, 2.0f),
+            random_float(4, 8),
+            random_color()
+        ));
+    }
+}
+
+// Columns of equal bodies resting on the floor, which should settle and sleep
+static void setup_stacks(World* world, int count) {
+    int perColumn = 10;
+    float radius = 8;
+    for (int i = 0; i < count; i++) {
+        int column = i / perColumn;
+        int row = i % perColumn;
+        spawn_body(world, create_body(
+            40 + column * 4 * radius,
+            WINDOW_HEIGHT - radius - row * 2 * radius,
+            0,
+            0,
+            1.0f,
+            radius,
+            random_color()
+        ));
+    }
+}
+
+// Small, fast bodies at a large step, where discrete detection misses hits
+static void setup_bullets(World* world, int count) {
+    for (int i = 0; i < count; i++) {
+        float angle = random_float(0, 2 * (float)M_PI);
+        float speed = random_float(2000, 4000);
+        spawn_body(world, create_body(
+            random_float(20, WINDOW_WIDTH - 20),
+            random_float(20, WINDOW_HEIGHT - 20),
+            cosf(angle) * speed,
+            sinf(angle) * speed,
+            random_float(0.5f, 2.0f),
+            random_float(3, 5),
+            random_color()
+        ));
+    }
+}
+
+// A self-gravitating disc in rough orbital balance
+static void setup_galaxy(World* world, int count) {
+    world->field = FIELD_GRAVITATION;
+    float extent = 250;
+    for (int i = 0; i < count; i++) {
+        float angle = random_float(0, 2 * (float)M_PI);
+        float r = extent * sqrtf(random_float(0.01f, 1));
+        float enclosed = count * (r / extent) * (r / extent);
+        float speed = sqrtf(world->field_constant * enclosed / sqrtf(r * r + FIELD_SOFTENING * FIELD_SOFTENING));
+        spawn_body(world, create_body(
+            WINDOW_WIDTH / 2 + cosf(angle) * r,
+            WINDOW_HEIGHT / 2 + sinf(angle) * r,
+            -sinf(angle) * speed,
+            cosf(angle) * speed,
+            1.0f,
+            2,
+            random_color()
+        ));
+    }
+}
+
+// The same disc with its field solved on a particle mesh
+static void setup_galaxy_mesh(World* world, int count) {
+    setup_galaxy(world, count);
+    world->field_method = FIELD_PARTICLE_MESH;
+}
+
+// Equal numbers of opposite charges released at rest
+static void setup_plasma(World* world, int count) {
+    world->field = FIELD_ELECTROSTATIC;
+    for (int i = 0; i < count; i++) {
+        Body body = create_body(
+            random_float(20, WINDOW_WIDTH - 20),
+            random_float(20, WINDOW_HEIGHT - 20),
+            0,
+            0,
+            1.0f,
+            3,
+            random_color()
+        );
+        body.charge = i % 2 ? 1.0f : -1.0f;
+        spawn_body(world, body);
+    }
+}
+
+// A dilute gas of small disks on a jittered grid, so none start overlapping
+static void setup_gas(World* world, int count) {
+    world->field = FIELD_NONE;
+    int cols = (int)sqrtf(count * (float)WINDOW_WIDTH / WINDOW_HEIGHT) + 1;
+    int rows = count / cols + 1;
+    float spacingX = (float)WINDOW_WIDTH / cols;
+    float spacingY = (float)WINDOW_HEIGHT / rows;
+    for (int i = 0; i < count; i++) {
+        float angle = random_float(0, 2 * (float)M_PI);
+        float speed = random_float(50, 200);
+        spawn_body(world, create_body(
+            (i % cols + 0.5f) * spacingX + random_float(-2, 2),
+            (i / cols + 0.5f) * spacingY + random_float(-2, 2),
+            cosf(angle) * speed,
+            sinf(angle) * speed,
+            1.0f,
+            2,
+            random_color()
+        ));
+    }
+}
+
+// Bodies falling through a large field of static pegs, most of the scene
+static void setup_pegs(World* world, int count) {
+    int drops = count / 10;
+    int pegs = count - drops;
+    float top = WINDOW_HEIGHT / 3.0f;
+    int cols = (int)sqrtf(pegs * (float)WINDOW_WIDTH / (WINDOW_HEIGHT - top)) + 1;
+    int rows = pegs / cols + 1;
+    float spacingX = (float)WINDOW_WIDTH / cols;
+    float spacingY = (WINDOW_HEIGHT - top) / rows;
+    for (int i = 0; i < pegs; i++) {
+        // Offset alternate rows so bodies can't fall straight through
+        int row = i / cols;
+        float shift = row % 2 ? 0.25f : -0.25f;
+        BodyHandle peg = spawn_body(world, create_body(
+            (i % cols + 0.5f + shift) * spacingX,
+            top + (row + 0.5f) * spacingY,
+            0,
+            0,
+            1.0f,
+            2,
+            random_color()
+        ));
+        set_body_type(world, get_body(world, peg), BODY_STATIC);
+    }
+    for (int i = 0; i < drops; i++) {
+        spawn_body(world, create_body(
+            random_float(20, WINDOW_WIDTH - 20),
+            random_float(20, top - 20),
+            random_float(-50, 50),
+            0,
+            random_float(0.5f, 2.0f),
+            random_float(3, 5),
+            random_color()
+        ));
+    }
+}
+
+// Replace a few random bodies with new ones dropped from the top every step
+static void tick_churn(World* world) {
+    for (int i = 0; i < CHURN_PER_STEP; i++) {
+        despawn_body(world, body_handle(world, rand() % world->bodyCount));
+        spawn_body(world, create_body(
+            random_float(20, WINDOW_WIDTH - 20),
+            random_float(20, 60),
+            random_float(-50, 50),
+            0,
+            random_float(0.5f, 2.0f),
+            random_float(4, 8),
+            random_color()
+        ));
+    }
+}
+
+static void configure_discrete(World* world) {
+    world->collision_mode = COLLISION_DISCRETE;
+}
+
+static void configure_ccd(World* world) {
+    world->collision_mode = COLLISION_CCD;
+}
+
+static void configure_speculative(World* world) {
+    world->collision_mode = COLLISION_SPECULATIVE;
+}
+
+static void configure_projection(World* world) {
+    world->collision_mode = COLLISION_CCD;
+    world->position_correction = CORRECTION_PROJECTION;
+}
+
+static void configure_xpbd(World* world) {
+    world->solver = SOLVER_XPBD;
+    world->collision_mode = COLLISION_DISCRETE;
+}
+
+static void configure_event(World* world) {
+    world->solver = SOLVER_EVENT;
+}
+
+static const Scene scenes[] = {
+    { "pile", 400, 1200, 1.0f / 120, setup_pile, NULL, false },
+    { "churn", 400, 1200, 1.0f / 120, setup_pile, tick_churn, false },
+    { "stacks", 200, 1200, 1.0f / 120, setup_stacks, NULL, false },
+    { "bullets", 200, 300, 1.0f / 30, setup_bullets, NULL, false },
+    { "pegs", 4000, 600, 1.0f / 120, setup_pegs, NULL, false },
+    { "galaxy", 2000, 300, 1.0f / 120, setup_galaxy, NULL, false },
+    { "galaxy-pm", 2000, 300, 1.0f / 120, setup_galaxy_mesh, NULL, false },
+    { "plasma", 2000, 300, 1.0f / 120, setup_plasma, NULL, false },
+    { "gas", 2000, 1200, 1.0f / 120, setup_gas, NULL, true },
+};
+
+static const Mode modes[] = {
+    { "discrete", configure_discrete, false },
+    { "ccd", configure_ccd, false },
+    { "speculative", configure_speculative, false },
+    { "projection", configure_projection, false },
+    { "xpbd", configure_xpbd, false },
+    { "event", configure_event, true },
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Count pairs whose straight-line relative motion over the step passed
+// through each other while both endpoints were separated. Bodies that
+// bounce between XPBD substeps bend away from that line, so this overcounts
+// for that solver. Bodies before the step are looked up by pool slot, since
+// the step may reorder them.
+static int count_tunnels(const Body* before, const Body* after, int count) {
+    int tunnels = 0;
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            float r = after[i].radius + after[j].radius;
+            float px = before[after[j].slot].x - before[after[i].slot].x;
+            float py = before[after[j].slot].y - before[after[i].slot].y;
+            float qx = after[j].x - after[i].x;
+            float qy = after[j].y - after[i].y;
+            if (px * px + py * py < r * r || qx * qx + qy * qy < r * r) continue;
+
+            float dx = qx - px;
+            float dy = qy - py;
+            float lenSq = dx * dx + dy * dy;
+            if (lenSq == 0) continue;
+            float t = -(px * dx + py * dy) / lenSq;
+            if (t <= 0 || t >= 1) continue;
+            float cx = px + dx * t;
+            float cy = py + dy * t;
+            if (cx * cx + cy * cy < r * r) tunnels++;
+        }
+    }
+    return tunnels;
+}
+
+static void run(const Scene* scene, const Mode* mode, const Options* options) {
+    World world = {0};
+    init_physics(&world);
+    reserve_bodies(&world, scene->bodyCount);
+    mode->configure(&world);
+    if (options->threads > 0) world.threads = options->threads;
+
+    srand(BENCH_SEED);
+    scene->setup(&world, scene->bodyCount);
+
+    // Ticks keep the body count constant, so the pool never grows past one
+    // snapshot buffer indexed by slot
+    Body* previous = malloc(sizeof(Body) * world.body_pool.capacity);
+
+    double elapsed = 0;
+    long pairs = 0, contacts = 0, speculative = 0, iterations = 0, sleeping = 0, rebuilds = 0, tunnels = 0;
+    for (int step = 0; step < scene->steps; step++) {
+        if (scene->tick) scene->tick(&world);
+        for (int i = 0; i < world.bodyCount; i++) {
+            previous[world.bodies[i].slot] = world.bodies[i];
+        }
+
+        double start = now_seconds();
+        update_physics(&world, scene->dt);
+        elapsed += now_seconds() - start;
+
+        PhysicsStats stats = get_physics_stats(&world);
+        pairs += stats.pairs_tested;
+        contacts += stats.contacts_found;
+        speculative += stats.speculative_contacts;
+        iterations += stats.iterations;
+        sleeping += stats.sleeping_bodies;
+        rebuilds += stats.neighbor_rebuilds;
+        tunnels += count_tunnels(previous, world.bodies, world.bodyCount);
+    }
+
+    printf("%-10s %-12s %9.3f %10.0f %9.1f %9.1f %6.2f %7.1f %8ld %8ld %016llx\n",
+        scene->name, mode->name,
+        elapsed * 1000.0 / scene->steps,
+        (double)pairs / scene->steps,
+        (double)contacts / scene->steps,
+        (double)speculative / scene->steps,
+        (double)iterations / scene->steps,
+        (double)sleeping / scene->steps,
+        rebuilds,
+        tunnels,
+        (unsigned long long)world.stats.state_hash);
+
+    cleanup_physics(&world);
+    free(previous);
+}
+
+// Replay a recorded session as fast as it will go, timing only the steps.
+// The inputs are read up front so file reads stay out of the timing.
+static int run_session(const char* path) {
+    SessionReader* reader = open_session(path);
+    if (!reader) return 1;
+    SessionEvent* events = NULL;
+    int count = 0, capacity = 0, steps = 0, hashes = 0;
+    SessionEvent event;
+    while (read_session_event(reader, &event)) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            events = realloc(events, sizeof(SessionEvent) * capacity);
+        }
+        events[count++] = event;
+        if (event.type == SESSION_STEP) steps++;
+        if (event.type == SESSION_HASH) hashes++;
+    }
+
+    World world = {0};
+    init_physics(&world);
+    reserve_bodies(&world, INITIAL_BODIES);
+    seed_random(session_seed(reader));
+    populate_session_world(&world, reader);
+
+    double elapsed = 0;
+    int step = 0, divergedAt = -1;
+    for (int i = 0; i < count; i++) {
+        if (events[i].type == SESSION_HASH) {
+            if (divergedAt < 0 && events[i].hash != world.stats.state_hash) divergedAt = step;
+            continue;
+        }
+        if (events[i].type != SESSION_STEP) {
+            apply_session_event(&world, &events[i], NULL);
+            continue;
+        }
+        double start = now_seconds();
+        update_physics(&world, events[i].dt);
+        elapsed += now_seconds() - start;
+        step++;
+    }
+
+    printf("%s: %d steps, %d inputs, %d bodies at the end, %.3f ms/step, hash %016llx\n",
+        path, steps, count - steps - hashes, world.bodyCount, steps > 0 ? elapsed * 1000.0 / steps : 0,
+        (unsigned long long)world.stats.state_hash);
+    if (divergedAt >= 0) {
+        printf("Diverged from the recording at step %d\n", divergedAt);
+    } else if (hashes > 0) {
+        printf("Matched the recording at every step\n");
+    }
+
+    cleanup_physics(&world);
+    close_session(reader);
+    free(events);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    // A recorded session to replay, or an optional scene name filter
+    if (argc > 2 && strcmp(argv[1], "replay") == 0) {
+        return run_session(argv[2]);
+    }
+    const char* only = NULL;
+    Options options = {0};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+        } else {
+            only = argv[i];
+        }
+    }
+
+    printf("%-10s %-12s %9s %10s %9s %9s %6s %7s %8s %8s %-16s\n",
+        "scene", "mode", "ms/step", "pairs", "contacts", "spec", "iters", "asleep", "rebuilds", "tunnels", "final hash");
+    for (size_t s = 0; s < sizeof(scenes) / sizeof(scenes[0]); s++) {
+        if (only && strcmp(only, scenes[s].name) != 0) continue;
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            if (modes[m].hardDisksOnly && !scenes[s].hardDisks) continue;
+            run(&scenes[s], &modes[m], &options);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,489 @@
+#include "../core/types.h"
+#include "../physics/physics.h"
+#include "../physics/body_pool.h"
+#include "../physics/reorder.h"
+#include "../io/snapshot.h"
+#include "../io/scene.h"
+#include "../io/session.h"
+#include "../io/history.h"
+#include "../physics/state_hash.h"
+#include "../utils/random.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Headless regression checks: each sets up a small world, exercises a path
+// that once went wrong and reports whether it now behaves. Exits nonzero if
+// any check fails.
+
+#define CHECK_SEED 7
+#define CHECK_BODIES 200
+#define CHECK_DT (1.0f / 60.0f)
+#define CHECK_SNAPSHOT_PATH "check.snapshot"
+#define CHECK_SCENE_PATH "check.bscene"
+#define CHECK_SESSION_PATH "check.session"
+#define CHECK_MESH_BODIES 2000
+#define CHECK_REWIND_STEPS 160
+#define CHECK_REWIND_TO 100
+#define CHECK_REWIND_AGAIN 30
+#define CHECK_HISTORY_CAP (256 * 1024)
+#define CHECK_SMALL_BODIES 20
+
+typedef struct {
+    const char* name;
+    bool (*run)(void);
+} Check;
+
+static void setup_world(World* world, int count) {
+    seed_random(CHECK_SEED);
+    *world = (World){0};
+    init_physics(world);
+    for (int i = 0; i < count; i++) {
+        spawn_body(world, create_body(
+            random_float(50, WINDOW_WIDTH - 50),
+            random_float(50, WINDOW_HEIGHT / 2),
+            random_float(-200, 200),
+            random_float(-100, 100),
+            random_float(0.5f, 2.0f),
+            random_float(4, 10),
+            random_color()
+        ));
+    }
+}
+
+static void step_world(World* world, int steps) {
+    for (int s = 0; s < steps; s++) {
+        update_physics(world, CHECK_DT);
+    }
+}
+
+// Saving over the snapshot the world's bodies are mapped from must neither
+// fault the mapping nor lose the bodies
+static bool check_snapshot_save_over_loaded(void) {
+    World world;
+    setup_world(&world, CHECK_BODIES);
+    step_world(&world, 10);
+    bool ok = save_snapshot(&world, CHECK_SNAPSHOT_PATH) && load_snapshot(&world, CHECK_SNAPSHOT_PATH);
+
+    step_world(&world, 10);
+    ok = ok && save_snapshot(&world, CHECK_SNAPSHOT_PATH);
+    step_world(&world, 10);
+    int count = world.bodyCount;
+    Body* expected = malloc(sizeof(Body) * (count > 0 ? count : 1));
+    memcpy(expected, world.bodies, sizeof(Body) * count);
+
+    // The file must hold the bodies as of the second save, which stepping
+    // on from there reproduces
+    ok = ok && load_snapshot(&world, CHECK_SNAPSHOT_PATH);
+    step_world(&world, 10);
+    ok = ok && world.bodyCount == count && memcmp(world.bodies, expected, sizeof(Body) * count) == 0;
+
+    free(expected);
+    cleanup_physics(&world);
+    remove(CHECK_SNAPSHOT_PATH);
+    return ok;
+}
+
+// Write a binary scene with one body value or setting spoiled, and check
+// that loading it fails and leaves the world as it was
+static bool scene_rejected(void (*spoil)(World* world)) {
+    World world;
+    setup_world(&world, CHECK_BODIES);
+    spoil(&world);
+    bool saved = save_scene(&world, CHECK_SCENE_PATH);
+    cleanup_physics(&world);
+
+    World loaded;
+    setup_world(&loaded, 1);
+    bool rejected = saved && !load_scene(&loaded, CHECK_SCENE_PATH) && loaded.bodyCount == 1;
+    cleanup_physics(&loaded);
+    remove(CHECK_SCENE_PATH);
+    return rejected;
+}
+
+static void spoil_position(World* world) { world->bodies[CHECK_BODIES / 2].x = NAN; }
+static void spoil_velocity(World* world) { world->bodies[CHECK_BODIES / 2].vy = INFINITY; }
+static void spoil_mass(World* world) { world->bodies[CHECK_BODIES / 2].mass = 0; }
+static void spoil_radius(World* world) { world->bodies[CHECK_BODIES / 2].radius = -1; }
+static void spoil_bounds(World* world) { world->height = NAN; }
+static void spoil_empty_bounds(World* world) { world->width = 0; }
+static void spoil_restitution(World* world) { world->restitution = -0.5f; }
+static void spoil_gravity(World* world) { world->gravity = INFINITY; }
+static void spoil_field_constant(World* world) { world->field_constant = NAN; }
+
+static bool check_binary_scene_validation(void) {
+    // An untouched scene must still load
+    World world;
+    setup_world(&world, CHECK_BODIES);
+    bool ok = save_scene(&world, CHECK_SCENE_PATH);
+    cleanup_physics(&world);
+    setup_world(&world, 0);
+    ok = ok && load_scene(&world, CHECK_SCENE_PATH) && world.bodyCount == CHECK_BODIES;
+    cleanup_physics(&world);
+    remove(CHECK_SCENE_PATH);
+
+    return ok && scene_rejected(spoil_position) && scene_rejected(spoil_velocity) &&
+           scene_rejected(spoil_mass) && scene_rejected(spoil_radius) &&
+           scene_rejected(spoil_bounds) && scene_rejected(spoil_empty_bounds) &&
+           scene_rejected(spoil_restitution) && scene_rejected(spoil_gravity) &&
+           scene_rejected(spoil_field_constant);
+}
+
+// Read a whole file into memory, or return NULL
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char* data = malloc(*size > 0 ? *size : 1);
+    if (fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+// Check that neither loader accepts a snapshot file's bytes, and that both
+// leave the world as it was
+static bool snapshot_bytes_rejected(const unsigned char* data, size_t size) {
+    FILE* file = fopen(CHECK_SNAPSHOT_PATH, "wb");
+    bool written = file && fwrite(data, 1, size, file) == size;
+    if (file) fclose(file);
+
+    World loaded;
+    setup_world(&loaded, CHECK_SMALL_BODIES);
+    bool rejected = written && !load_snapshot(&loaded, CHECK_SNAPSHOT_PATH) &&
+        !load_snapshot_data(&loaded, data, size) && loaded.bodyCount == CHECK_SMALL_BODIES;
+    cleanup_physics(&loaded);
+    remove(CHECK_SNAPSHOT_PATH);
+    return rejected;
+}
+
+// Save a stepped world with one value spoiled, and check the snapshot is
+// refused rather than installed
+static bool snapshot_rejected(void (*spoil)(World* world)) {
+    World world;
+    setup_world(&world, CHECK_BODIES);
+    step_world(&world, 2);
+    spoil(&world);
+    bool saved = save_snapshot(&world, CHECK_SNAPSHOT_PATH);
+    cleanup_physics(&world);
+
+    size_t size;
+    unsigned char* data = saved ? read_file(CHECK_SNAPSHOT_PATH, &size) : NULL;
+    bool rejected = data && snapshot_bytes_rejected(data, size);
+    free(data);
+    return rejected;
+}
+
+static void spoil_mesh_size(World* world) { world->mesh_size = 100; }
+static void spoil_solver(World* world) { world->solver = (SolverType)7; }
+static void spoil_substeps(World* world) { world->substeps = 0; }
+static void spoil_width(World* world) { world->width = NAN; }
+static void spoil_slot(World* world) { world->bodies[CHECK_BODIES / 2].slot = world->body_pool.capacity; }
+static void spoil_free_slot(World* world) { world->body_pool.free_slot = world->bodies[0].slot; }
+static void spoil_body(World* world) { world->bodies[CHECK_BODIES / 2].radius = NAN; }
+
+// Snapshots are embedded in sessions, so every value used as an index or
+// size must be range checked before it is installed
+static bool check_snapshot_validation(void) {
+    World world;
+    setup_world(&world, CHECK_BODIES);
+    step_world(&world, 2);
+    bool ok = world.contacts.count > 0 && save_snapshot(&world, CHECK_SNAPSHOT_PATH);
+    Contact contact = world.contacts.contacts[0];
+    cleanup_physics(&world);
+
+    // The untouched snapshot must still load both ways
+    size_t size;
+    unsigned char* data = ok ? read_file(CHECK_SNAPSHOT_PATH, &size) : NULL;
+    setup_world(&world, 0);
+    ok = data && load_snapshot(&world, CHECK_SNAPSHOT_PATH) && world.bodyCount == CHECK_BODIES &&
+         load_snapshot_data(&world, data, size) && world.bodyCount == CHECK_BODIES;
+    cleanup_physics(&world);
+
+    // Point a saved contact past the bodies, found by its bytes
+    bool patched = false;
+    for (size_t offset = 0; data && offset + sizeof(Contact) <= size && !patched; offset += sizeof(int)) {
+        if (memcmp(data + offset, &contact, sizeof(Contact)) != 0) continue;
+        Contact spoiled = contact;
+        spoiled.a = CHECK_BODIES * 4;
+        memcpy(data + offset, &spoiled, sizeof(Contact));
+        patched = true;
+    }
+    ok = ok && patched && snapshot_bytes_rejected(data, size);
+    free(data);
+
+    return ok && snapshot_rejected(spoil_mesh_size) && snapshot_rejected(spoil_solver) &&
+           snapshot_rejected(spoil_substeps) && snapshot_rejected(spoil_width) &&
+           snapshot_rejected(spoil_slot) && snapshot_rejected(spoil_free_slot) && snapshot_rejected(spoil_body);
+}
+
+// Record a run that starts from a snapshot, saves over it with F5 and
+// restores it with F9, then replay it with the file gone. The replay must
+// reach every recorded hash without writing the file back.
+static bool check_replay_stored_snapshots(void) {
+    World world;
+    setup_world(&world, CHECK_BODIES);
+    bool ok = save_snapshot(&world, CHECK_SNAPSHOT_PATH);
+    cleanup_physics(&world);
+
+    world = (World){0};
+    init_physics(&world);
+    seed_random(CHECK_SEED);
+    populate_world(&world, CHECK_SNAPSHOT_PATH);
+    SessionRecorder* recorder = start_session(CHECK_SESSION_PATH, CHECK_SEED, CHECK_SNAPSHOT_PATH);
+    ok = ok && recorder;
+    for (int s = 0; s < 60 && ok; s++) {
+        SessionEvent input = { .type = s == 20 ? SESSION_SAVE : SESSION_LOAD };
+        if (s == 20 || s == 40) {
+            record_session(recorder, &world, &input);
+            apply_session_event(&world, &input, CHECK_SNAPSHOT_PATH);
+        }
+        record_session(recorder, &world, &(SessionEvent){ .type = SESSION_STEP, .dt = CHECK_DT });
+        update_physics(&world, CHECK_DT);
+        record_session(recorder, &world, &(SessionEvent){ .type = SESSION_HASH, .hash = world.stats.state_hash });
+    }
+    ok = ok && stop_session(recorder);
+    cleanup_physics(&world);
+    remove(CHECK_SNAPSHOT_PATH);
+
+    SessionReader* reader = ok ? open_session(CHECK_SESSION_PATH) : NULL;
+    ok = ok && reader;
+    if (reader) {
+        world = (World){0};
+        init_physics(&world);
+        seed_random(session_seed(reader));
+        populate_session_world(&world, reader);
+        SessionEvent event;
+        int hashes = 0;
+        while (ok && read_session_event(reader, &event)) {
+            if (event.type == SESSION_STEP) {
+                update_physics(&world, event.dt);
+            } else if (event.type == SESSION_HASH) {
+                ok = event.hash == world.stats.state_hash;
+                hashes++;
+            } else {
+                apply_session_event(&world, &event, NULL);
+            }
+        }
+        ok = ok && hashes == 60;
+        cleanup_physics(&world);
+        close_session(reader);
+    }
+
+    // Nothing during the replay may have written the snapshot back
+    FILE* file = fopen(CHECK_SNAPSHOT_PATH, "rb");
+    if (file) {
+        fclose(file);
+        ok = false;
+    }
+    remove(CHECK_SNAPSHOT_PATH);
+    remove(CHECK_SESSION_PATH);
+    return ok;
+}
+
+// The particle-mesh field, the one parallel sum split across threads, must
+// come out the same on any number of them
+static bool check_mesh_thread_invariance(void) {
+    uint64_t expected = 0;
+    bool ok = true;
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        World world;
+        setup_world(&world, CHECK_MESH_BODIES);
+        world.field = FIELD_GRAVITATION;
+        world.field_method = FIELD_PARTICLE_MESH;
+        world.threads = threads;
+        step_world(&world, 20);
+        uint64_t hash = hash_world_state(&world);
+        if (threads == 1) expected = hash;
+        ok = ok && hash == expected;
+        cleanup_physics(&world);
+    }
+    return ok;
+}
+
+// Run with history, rewind to a step between keyframes and step on to the
+// end again. Everything the next step depends on must come back with the
+// bodies, so the rerun must reach the same hash at every step. Reordering
+// moves bodies after the step's contacts were found, so runs that reorder
+// every step check those contacts still name the right bodies.
+static bool rewind_retraces(int count, int threads, int reorderInterval) {
+    World world;
+    setup_world(&world, count);
+    world.threads = threads;
+    world.reorder_interval = reorderInterval;
+    world.history = start_history((size_t)HISTORY_MEMORY_MB << 20);
+    uint64_t hashes[CHECK_REWIND_STEPS];
+    bool ok = true;
+    for (int s = 0; s < CHECK_REWIND_STEPS; s++) {
+        update_physics(&world, CHECK_DT);
+        hashes[s] = world.stats.state_hash;
+    }
+
+    ok = ok && world.contacts.count > 0;
+    ok = ok && rewind_history(world.history, &world, CHECK_REWIND_TO);
+    ok = ok && world.stats.state_hash == hashes[CHECK_REWIND_TO] && hash_world_state(&world) == hashes[CHECK_REWIND_TO];
+    for (int s = CHECK_REWIND_TO + 1; s < CHECK_REWIND_STEPS && ok; s++) {
+        update_physics(&world, CHECK_DT);
+        ok = world.stats.state_hash == hashes[s];
+    }
+
+    // Steps captured again after the rewind must decode like the first ones
+    ok = ok && rewind_history(world.history, &world, CHECK_REWIND_AGAIN) &&
+         world.stats.state_hash == hashes[CHECK_REWIND_AGAIN];
+    ok = ok && rewind_history(world.history, &world, CHECK_REWIND_STEPS - 1) &&
+         world.stats.state_hash == hashes[CHECK_REWIND_STEPS - 1];
+    cleanup_physics(&world);
+    return ok;
+}
+
+static bool check_rewind_restep(void) {
+    // Large enough for the capture to be split across threads
+    return rewind_retraces(CHECK_BODIES, 1, REORDER_INTERVAL) && rewind_retraces(CHECK_BODIES, 1, 1) &&
+           rewind_retraces(HISTORY_PARALLEL_BODIES, 4, REORDER_INTERVAL);
+}
+
+// History must stay within its cap, buffers included, while still holding
+// the steps that fit
+static bool check_history_cap(void) {
+    World world;
+    setup_world(&world, CHECK_BODIES);
+    world.history = start_history(CHECK_HISTORY_CAP);
+    bool ok = true;
+    long oldest = 0, newest = 0;
+    for (int s = 0; s < CHECK_REWIND_STEPS * 4 && ok; s++) {
+        update_physics(&world, CHECK_DT);
+        ok = history_bytes(world.history) <= CHECK_HISTORY_CAP;
+    }
+    ok = ok && history_range(world.history, &oldest, &newest) && newest == CHECK_REWIND_STEPS * 4 - 1 &&
+         newest > oldest && rewind_history(world.history, &world, oldest);
+    cleanup_physics(&world);
+    return ok;
+}
+
+static bool slots_consistent(const World* world) {
+    for (int i = 0; i < world->bodyCount; i++) {
+        if (world->body_pool.index[world->bodies[i].slot] != i) return false;
+    }
+    return true;
+}
+
+// Reordering swaps body storage with its scratch, so once a smaller snapshot
+// has replaced the pool and it regrows, the scratch must still fit it
+static bool check_reorder_after_smaller_snapshot(void) {
+    World small;
+    setup_world(&small, CHECK_SMALL_BODIES);
+    bool ok = save_snapshot(&small, CHECK_SNAPSHOT_PATH);
+    cleanup_physics(&small);
+
+    World world;
+    setup_world(&world, CHECK_MESH_BODIES);
+    reorder_bodies(&world);
+    ok = ok && load_snapshot(&world, CHECK_SNAPSHOT_PATH);
+    reorder_bodies(&world);
+    for (int round = 0; round < 3 && ok; round++) {
+        while (world.bodyCount < CHECK_MESH_BODIES / 3 * (round + 1)) {
+            spawn_body(&world, create_body(random_float(50, WINDOW_WIDTH - 50), random_float(50, WINDOW_HEIGHT - 50),
+                0, 0, 1, 5, random_color()));
+        }
+        reorder_bodies(&world);
+        ok = slots_consistent(&world);
+    }
+    step_world(&world, 2);
+    cleanup_physics(&world);
+    remove(CHECK_SNAPSHOT_PATH);
+    return ok;
+}
+
+// Continuous collision only tests pairs the neighbor lists hold, so a bullet
+// crossing most of the world in one step must still stop at a distant peg
+static bool check_ccd_distant_peg(void) {
+    World world;
+    setup_world(&world, CHECK_BODIES);
+    float y = WINDOW_HEIGHT - 100;
+    BodyHandle peg = spawn_body(&world, create_body(WINDOW_WIDTH - 100, y, 0, 0, 1, 5, random_color()));
+    set_body_type(&world, get_body(&world, peg), BODY_STATIC);
+    BodyHandle bullet = spawn_body(&world, create_body(100, y, 1.2f * (WINDOW_WIDTH - 200) / CHECK_DT, 0, 1, 5, random_color()));
+    step_world(&world, 1);
+    bool ok = world.collision_mode == COLLISION_CCD && get_body(&world, bullet)->x < get_body(&world, peg)->x;
+    cleanup_physics(&world);
+    return ok;
+}
+
+// A body asleep under a mutual field must wake once a charge arrives beside
+// it, under either way of computing the field
+static bool charge_wakes_sleeper(FieldMethod method) {
+    World world = {0};
+    init_physics(&world);
+    world.field = FIELD_ELECTROSTATIC;
+    world.field_method = method;
+    Body sleeper = create_body(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, 0, 0, 1, 5, random_color());
+    sleeper.charge = 10;
+    sleeper.sleeping = true;
+    sleeper.island = 1;
+    BodyHandle handle = spawn_body(&world, sleeper);
+    Body visitor = create_body(WINDOW_WIDTH / 2 + 40, WINDOW_HEIGHT / 2, 0, 0, 1, 5, random_color());
+    visitor.charge = 10;
+    spawn_body(&world, visitor);
+    step_world(&world, 1);
+    bool ok = !get_body(&world, handle)->sleeping;
+    cleanup_physics(&world);
+    return ok;
+}
+
+static bool check_field_wakes_sleeper(void) {
+    return charge_wakes_sleeper(FIELD_BARNES_HUT) && charge_wakes_sleeper(FIELD_PARTICLE_MESH);
+}
+
+// Acceleration of the first of two equal masses under the tree with the
+// given opening angle
+static float pair_acceleration(float theta) {
+    World world = {0};
+    init_physics(&world);
+    world.field = FIELD_GRAVITATION;
+    world.opening_angle = theta;
+    BodyHandle handle = spawn_body(&world, create_body(100, 100, 0, 0, 1, 5, random_color()));
+    spawn_body(&world, create_body(200, 200, 0, 0, 1, 5, random_color()));
+    step_world(&world, 1);
+    float ax = get_body(&world, handle)->ax;
+    cleanup_physics(&world);
+    return ax;
+}
+
+// A wide opening angle must not let a body feel itself through a cell that
+// holds it
+static bool check_wide_opening_angle(void) {
+    float exact = pair_acceleration(0);
+    return fabsf(pair_acceleration(2) - exact) <= 1e-3f * fabsf(exact);
+}
+
+static const Check checks[] = {
+    { "snapshot save over loaded", check_snapshot_save_over_loaded },
+    { "binary scene validation", check_binary_scene_validation },
+    { "snapshot validation", check_snapshot_validation },
+    { "replay stored snapshots", check_replay_stored_snapshots },
+    { "mesh thread invariance", check_mesh_thread_invariance },
+    { "rewind restep", check_rewind_restep },
+    { "history cap", check_history_cap },
+    { "reorder after smaller snapshot", check_reorder_after_smaller_snapshot },
+    { "ccd distant peg", check_ccd_distant_peg },
+    { "field wakes sleeper", check_field_wakes_sleeper },
+    { "wide opening angle", check_wide_opening_angle },
+};
+
+int main(int argc, char** argv) {
+    // An optional check name filter
+    const char* only = argc > 1 ? argv[1] : NULL;
+    int failed = 0;
+    for (size_t c = 0; c < sizeof(checks) / sizeof(checks[0]); c++) {
+        if (only && strcmp(only, checks[c].name) != 0) continue;
+        bool passed = checks[c].run();
+        printf("%-32s %s\n", checks[c].name, passed ? "ok" : "FAILED");
+        if (!passed) failed++;
+    }
+    return failed > 0 ? 1 : 0;
+}
@@ -3,6 +3,7 @@
 
 #include <SDL.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 // Nuklear declarations only
 #define NK_INCLUDE_FIXED_TYPES
@@ -21,8 +22,60 @@
 #define TIME_SCALE 1.0f
 
 // Collision constants
-#define COLLISION_ITERATIONS 2  // Number of collision resolution iterations
+#define MIN_COLLISION_ITERATIONS 1    // Collision iterations always run per step
+#define MAX_COLLISION_ITERATIONS 8    // Upper bound on collision iterations per step
+#define PENETRATION_TOLERANCE 0.5f    // Max penetration (pixels) at which the solver counts as converged
+#define VELOCITY_TOLERANCE 1.0f       // Max approaching speed (pixels/s) at which the solver counts as converged
+#define XPBD_SUBSTEPS 8               // Default substeps per step for the XPBD solver
+#define MAX_EVENTS_PER_STEP 100000    // Collisions the event solver resolves before coasting out the step
 #define MIN_SEPARATION 0.01f   // Minimum separation distance after collision
+#define RESTITUTION_THRESHOLD 20.0f   // Approach speed (pixels/s) below which contacts don't bounce
+#define SPLIT_IMPULSE_BETA 0.5f       // Fraction of penetration a split impulse removes per step
+#define CCD_MOTION_THRESHOLD 0.5f     // Fraction of its radius a body must move in a step to be swept
+#define NEIGHBOR_SKIN 8.0f            // Extra distance (pixels) kept in neighbor lists so they last several steps
+#define REORDER_INTERVAL 0            // Default steps between Morton reorders of body storage, 0 for none
+#define REORDER_LOCALITY 2.0f         // Default growth in mean neighbor index gap that triggers a reorder
+
+// Sleeping constants
+#define SLEEP_ENERGY_THRESHOLD 50.0f  // Kinetic energy below which a body counts as resting
+#define TIME_TO_SLEEP 0.5f            // Seconds an island must rest before it is put to sleep
+
+// Force field constants
+#define FIELD_CONSTANT 2000.0f        // Gravitational or Coulomb constant for mutual forces
+#define FIELD_SOFTENING 4.0f          // Distance (pixels) that keeps close encounters finite
+#define BARNES_HUT_THETA 0.5f         // Opening angle below which a tree cell acts as one source
+#define QUADTREE_MAX_DEPTH 24         // Cells this deep hold every body that reaches them
+#define FIELD_PARALLEL_BODIES 256     // Bodies needed before the field is computed on several threads
+#define PARTICLE_MESH_SIZE 128        // Default particle-mesh cells per side of the domain
+#define PARTICLE_MESH_MAX_SIZE 512    // Largest particle mesh the debug window offers or a snapshot may hold
+#define MESH_DEPOSIT_PARTS 16         // Fixed split of the particle-mesh deposit, whatever the thread count
+#define HASH_PARALLEL_BODIES 8192     // Bodies needed before the state hash is computed on several threads
+
+// Trajectory recording constants
+#define TRAJECTORY_POSITION_QUANTUM 0.01f   // Position resolution (pixels) of recorded trajectories
+#define TRAJECTORY_VELOCITY_QUANTUM 0.01f   // Velocity resolution (pixels/s) of recorded trajectories
+#define TRAJECTORY_QUEUE_FRAMES 8           // Steps that can wait for the writer before frames are dropped
+#define TRAJECTORY_KEYFRAME_INTERVAL 256    // Frames between frames coded without reference to the last
+
+// Replication constants
+#define REPLICATION_ADDRESS "127.0.0.1:7878"  // Where the engine serves its state to replicas
+#define REPLICATION_POSITION_QUANTUM 0.05f    // Position change (pixels) that makes a body worth sending
+#define REPLICATION_VELOCITY_QUANTUM 0.5f     // Velocity change (pixels/s) that makes a body worth sending
+#define REPLICATION_KEYFRAME_INTERVAL 600     // Steps between keyframes sent to every replica
+#define REPLICATION_BACKLOG_BYTES (4 << 20)   // Unsent bytes at which a replica skips deltas until it catches up
+
+// Session recording constants
+#define SNAPSHOT_PATH "world.snapshot"    // Where F5 saves unless the world was resumed from a snapshot
+#define INITIAL_BODIES 15                 // Random bodies a world starts with when given no scene or snapshot
+#define IMPULSE_STRENGTH 1000.0f          // Impulse a left click gives the clicked body
+
+// Rewind history constants
+#define HISTORY_MEMORY_MB 64          // Memory cap of the rewind history when --history names none
+#define HISTORY_KEYFRAME_INTERVAL 64  // Most steps between full copies of the bodies in the rewind history
+#define HISTORY_PARALLEL_BODIES 2048  // Bodies needed before rewind history is captured on several threads
+
+// Domain decomposition constants
+#define DOMAIN_HALO_DIAMETERS 4       // Largest body diameters of ghosts kept beyond each slab edge
 
 // Window constants
 #define WINDOW_WIDTH 800
@@ -31,15 +84,326 @@
 #define DEBUG_WINDOW_HEIGHT 600
 #define FPS_CAP 120
 
+// How a body takes part in the simulation
+typedef enum {
+    BODY_DYNAMIC,       // Moved by forces and contacts
+    BODY_KINEMATIC,     // Moves at its own velocity and pushes dynamic bodies without being pushed back
+    BODY_STATIC         // Never moves; pairs with static or kinematic bodies are never tested
+} BodyType;
+
 typedef struct {
     float x, y;
     float vx, vy;
     float ax, ay;
     float mass;
+    float inv_mass;     // 1 / mass, or 0 for kinematic and static bodies
+    BodyType type;
     float radius;
     SDL_Color color;
+    float pvx, pvy;     // Pseudo-velocity for split-impulse position correction, discarded each step
+    bool sleeping;      // Skips integration and pair tests until woken
+    float sleep_time;   // Seconds this body has been resting
+    int island;         // Id of the sleeping island this body belongs to, 0 when none
+    float charge;       // Source strength in an electrostatic field
+    unsigned id;        // Unique among the world's bodies, 0 until spawned
+    int slot;           // Pool slot that tracks where this body is stored
 } Body;
 
+// Stable reference to a spawned body. It survives other bodies being added,
+// removed or moved and stops resolving once its own body is despawned.
+typedef struct {
+    int slot;
+    unsigned id;        // Id of the body the handle was made for, 0 for no body
+} BodyHandle;
+
+// Slot table behind body handles. Bodies stay densely packed in
+// world->bodies, and each slot records where its body currently lives.
+typedef struct {
+    int* index;         // Dense index of each slot's body, or the next free slot
+    unsigned* ids;      // Id of the body in each slot, 0 while the slot is free
+    int capacity;       // Slots, and bodies the dense array has room for
+    int free_slot;      // First free slot, -1 when none
+    unsigned next_id;
+    void* mapping;      // Snapshot mapping the bodies live in, NULL while they are on the heap
+    size_t mapping_size;
+} BodyPool;
+
+// Scratch and bookkeeping for sorting body storage along a Z-order curve, so
+// bodies near each other in space sit near each other in memory
+typedef struct {
+    unsigned* codes;    // Morton code of each body, twice the capacity for radix passes
+    int* order;         // Body indices being sorted, twice the capacity
+    Body* scratch;      // Bodies in their new order before the swap into world->bodies
+    int capacity;       // Bodies codes and order have room for
+    int scratch_capacity;   // Bodies scratch has room for, which swaps leave smaller than capacity
+    int steps;          // Steps since the last reorder
+    float base_gap;     // Mean neighbor index gap first measured after the last reorder, 0 until then
+    int reorders;       // Reorders since the world was created
+} BodyOrder;
+
+// How contacts between moving bodies are detected
+typedef enum {
+    COLLISION_DISCRETE,     // Overlap tests at the end of each step only
+    COLLISION_CCD,          // Fast bodies are swept and stopped at their time of impact
+    COLLISION_SPECULATIVE   // Pairs that could close their gap within a step get a contact early
+} CollisionMode;
+
+// Which forces act on bodies besides those applied directly
+typedef enum {
+    FIELD_UNIFORM,          // Constant downward gravity
+    FIELD_GRAVITATION,      // Mutual attraction between masses
+    FIELD_ELECTROSTATIC,    // Mutual forces between charges, like charges repel
+    FIELD_NONE              // Bodies coast unless pushed
+} ForceField;
+
+// How mutual forces are computed
+typedef enum {
+    FIELD_BARNES_HUT,       // Quadtree walk per body
+    FIELD_PARTICLE_MESH     // Grid deposit and FFT convolution, for large smooth scenes
+} FieldMethod;
+
+// How each step is solved
+typedef enum {
+    SOLVER_IMPULSE,         // Verlet integration, then iterated contact impulses
+    SOLVER_XPBD,            // Substeps with one position-projection pass each
+    SOLVER_EVENT            // Free flight from collision to collision, for hard-disk gases
+} SolverType;
+
+// How overlapping bodies are pushed apart
+typedef enum {
+    CORRECTION_PROJECTION,      // Shift positions directly inside every iteration
+    CORRECTION_SPLIT_IMPULSE    // Solve a separate pseudo-velocity that only moves positions
+} PositionCorrection;
+
+// Bodies swept by continuous collision detection this step
+typedef struct {
+    int* indices;               // Fast bodies that would hit something, in ascending order
+    float* fractions;           // Fraction of the step each can travel before impact
+    int* hits;                  // Body each one hits, -1 for a wall
+    float* normals;             // Impact normal pointing from each body to what it hits, x/y pairs
+    int* entries;               // Entry of each body while sweeping, -1 for slow ones
+    int count;
+    int capacity;
+} CcdSweep;
+
+// Boundary walls, stored in a contact's b index as -1 - wall
+typedef enum {
+    WALL_BOTTOM,
+    WALL_TOP,
+    WALL_RIGHT,
+    WALL_LEFT,
+    WALL_COUNT
+} Wall;
+
+// A square cell of the Barnes-Hut tree
+typedef struct {
+    float cx, cy, half;     // Cell centre and half-width
+    float x, y;             // Centre of the sources below this cell
+    float strength;         // Summed mass or charge below this cell
+    float weight;           // Summed absolute strength, which weights the centre
+    int child;              // Index of the first of four children, -1 for a leaf
+    int body;               // First body held by a leaf, -1 when empty
+} QuadNode;
+
+// Barnes-Hut quadtree, rebuilt each step
+typedef struct {
+    QuadNode* nodes;        // Root first; children always follow their parent
+    int count;
+    int capacity;
+    int* next;              // Next body sharing a leaf at the depth limit, -1 at the end
+    int next_capacity;
+} QuadTree;
+
+// Verlet neighbor lists: for each body, the later bodies that were within
+// touching distance plus the skin when the lists were built
+typedef struct {
+    int* start;             // Offset of each body's list in pairs, one past the last body too
+    int* pairs;             // Neighbor indices, ascending within each body's list
+    int pair_count;
+    int pair_capacity;
+    float* anchor;          // Position x/y pairs at the last rebuild
+    int body_count;         // Bodies when the lists were built
+    int body_capacity;
+    int* cell_start;        // Bucketing grid used while rebuilding
+    int* cell_bodies;
+    int cell_capacity;
+    float skin;             // Skin the lists were built with
+    float mean_gap;         // Mean index distance between the bodies of each listed pair
+    int rebuilds;           // Rebuilds since the world was created
+    int steps;              // Steps served since the world was created
+} NeighborList;
+
+// Event partner marking a body leaving its grid cell rather than colliding
+#define EVENT_CELL_CROSSING (-1 - WALL_COUNT)
+
+// A predicted event for the event solver
+typedef struct {
+    double time;            // When it happens on the event clock
+    int a;                  // Body whose prediction this is
+    int b;                  // Other body, -1 - wall for walls, or EVENT_CELL_CROSSING
+    int count_a;            // Collision counts when predicted; a changed count
+    int count_b;            // means the event is stale. Crossings keep the cell entered here.
+} Event;
+
+// Event solver state: a min-heap of predictions, invalidated lazily, each
+// body's position time, and a grid of cells at least a body wide so
+// predictions only look at adjacent cells. Bodies are only moved up to the
+// clock when they collide, change cell or a step ends.
+typedef struct {
+    Event* heap;
+    int count;
+    int capacity;
+    double* body_time;      // Event-clock time each body's position is at
+    int* collisions;        // Collisions each body has had
+    float* synced;          // x, y, vx, vy at the end of the last step, to spot outside changes
+    int* cell_of;           // Grid cell each body is filed under
+    int* next_in_cell;      // Doubly linked body lists per cell
+    int* prev_in_cell;
+    int body_count;         // Bodies the queue was primed for, 0 when it needs priming
+    int body_capacity;
+    int* cell_head;         // First body in each cell, -1 when empty
+    int cell_capacity;
+    int cols, rows;
+    float cell_size;
+    double clock;           // Event-clock time at the end of the last step
+} EventQueue;
+
+// Particle-mesh grid over the walled domain, zero padded to twice its size
+// so the periodic FFT convolution sees an isolated system
+typedef struct {
+    int size;               // Cells per side of the unpadded grid
+    float cell;             // Cell width in pixels
+    float* density;         // Padded complex grid: deposited strength, then potential
+    float* kernel;          // Transform of the softened 1/r potential on the padded grid
+    float* field;           // Field x/y pairs at the unpadded cells
+    float* partial;         // Unpadded strength grids deposited in parallel, summed into density
+    int partial_count;
+} ParticleMesh;
+
+typedef struct ThreadPool ThreadPool;
+typedef struct TrajectoryRecorder TrajectoryRecorder;
+typedef struct StatePublisher StatePublisher;
+typedef struct ReplicationServer ReplicationServer;
+typedef struct History History;
+
+// One step of a recorded trajectory, as read back from the file
+typedef struct {
+    long step;              // Steps since recording started, counting dropped ones
+    float dt;               // Duration of the step
+    int count;              // Bodies in the frame
+    unsigned* ids;          // Columns of count entries, in ascending pool slot order
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    int capacity;
+} TrajectoryFrame;
+
+// Inputs a recorded session holds, in the order they were applied
+typedef enum {
+    SESSION_STEP,       // One update_physics call
+    SESSION_CLICK,      // Mouse button pressed over the world
+    SESSION_SAVE,       // Snapshot saved
+    SESSION_LOAD,       // Snapshot restored
+    SESSION_SETTINGS,   // Settings changed from the debug window
+    SESSION_HASH        // State hash after the step before it
+} SessionEventType;
+
+// The world settings the debug window can change
+typedef struct {
+    int max_iterations;
+    float neighbor_skin;
+    int reorder_interval;
+    float reorder_locality;
+    float gravity;
+    float restitution;
+    ForceField field;
+    FieldMethod field_method;
+    int mesh_size;
+    float opening_angle;
+    int threads;
+    SolverType solver;
+    int substeps;
+    CollisionMode collision_mode;
+} SessionSettings;
+
+typedef struct {
+    SessionEventType type;
+    float dt;                   // Step duration
+    int button;                 // SDL mouse button and position of a click
+    int x, y;
+    SessionSettings settings;   // Settings from this event on
+    uint64_t hash;              // State hash the recorded run reached
+    const unsigned char* snapshot;  // Snapshot a replayed load restores, owned by the session reader
+    size_t snapshot_size;
+} SessionEvent;
+
+// Scratch storage for the XPBD solver
+typedef struct {
+    float* previous;            // Position at the start of the substep, x/y pairs
+    int capacity;
+} XpbdScratch;
+
+// A touching pair of bodies, kept between steps so its impulse can warm start the solver
+typedef struct {
+    int a, b;                   // Body indices, a < b when found, or b < 0 for a wall
+    unsigned key_a, key_b;      // Body ids matching contacts across steps, or the wall for key_b
+    float nx, ny;               // Collision normal from a to b
+    float normal_mass;          // 1 / (1/ma + 1/mb)
+    float bounce;               // Target separating speed from restitution
+    float normal_impulse;       // Accumulated normal impulse
+    float pseudo_impulse;       // Accumulated split impulse, restarted every step
+} Contact;
+
+// Contacts for the current step plus the previous step's, looked up by body pair
+typedef struct {
+    Contact* contacts;
+    int count;
+    int capacity;
+    Contact* previous;
+    int previous_count;
+    int previous_capacity;
+    int* slots;                 // Open-addressing table of indices into previous, -1 when empty
+    int slot_count;
+} ContactCache;
+
+// Scratch storage for grouping bodies into islands through the contact graph
+typedef struct {
+    int* parent;                // Union-find parent per body
+    float* min_sleep_time;      // Shortest sleep timer in each island, indexed by root
+    int* sleep_ids;             // Id given to each island falling asleep, indexed by root
+    int* wake_ids;              // Sleeping islands to wake this step
+    int capacity;
+    int next_id;                // Id handed to the next island put to sleep
+} IslandGraph;
+
+// Per-step solver counters, reset at the start of every update_physics call
+typedef struct {
+    int pairs_tested;           // Broadphase candidate pairs handed to the narrowphase
+    int contacts_found;         // Narrowphase overlaps
+    int speculative_contacts;   // Separated pairs closing fast enough to touch within a step
+    int separating_contacts;    // Overlaps skipped because the bodies were already separating
+    int impulses_applied;       // Collision impulses applied between bodies
+    int position_corrections;   // Positional corrections applied to overlapping pairs
+    int boundary_hits;          // Body-wall collisions
+    int ccd_bodies;             // Fast bodies swept for time of impact
+    int ccd_impacts;            // Swept bodies stopped short of their full step
+    int islands;                // Awake islands found in the contact graph
+    int sleeping_bodies;        // Bodies asleep at the end of the step
+    int iterations;             // Collision iterations run
+    int tree_nodes;             // Barnes-Hut cells built for mutual forces
+    int neighbor_pairs;         // Pairs held in the neighbor lists
+    int neighbor_rebuilds;      // Neighbor list rebuilds this step, 0 or 1
+    float steps_per_rebuild;    // Average steps served by each neighbor list build
+    float neighbor_gap;         // Mean index distance between neighbor pairs, lower is more cache friendly
+    int reorders;               // Morton reorders of body storage since the world was created
+    int events;                 // Collisions resolved by the event solver
+    int stale_events;           // Predictions discarded because a body collided first
+    float max_penetration;      // Deepest overlap seen in the last iteration
+    float max_approach_speed;   // Fastest approaching contact seen in the last iteration
+    uint64_t state_hash;        // Hash of every body's state after the step, the same for bit-identical states
+} PhysicsStats;
+
 typedef struct {
     SDL_Window* window;
     SDL_Renderer* renderer;
@@ -49,7 +413,48 @@ typedef struct {
     struct nk_font_atlas* atlas;
     Body* bodies;
     int bodyCount;
+    BodyPool body_pool;
+    BodyOrder body_order;
+    int reorder_interval;           // Steps between Morton reorders, 0 for none
+    float reorder_locality;         // Reorder once the mean neighbor index gap grows by this factor, 0 for never
+    float width;                    // Extent of the walled domain, which starts at the origin
+    float height;
+    float gravity;                  // Downward acceleration of the uniform field
+    float restitution;              // Bounce of contacts approaching faster than RESTITUTION_THRESHOLD
+    ForceField field;
+    FieldMethod field_method;
+    float field_constant;           // Gravitational or Coulomb constant for mutual forces
+    float opening_angle;            // Barnes-Hut theta; 0 sums every pair exactly
+    int mesh_size;                  // Particle-mesh cells per side, a power of two
+    int threads;                    // Threads computing mutual forces
+    SolverType solver;
+    int substeps;                   // Substeps per step for the XPBD solver
+    CollisionMode collision_mode;
+    PositionCorrection position_correction;
+    float step_dt;                  // Duration of the step being solved
+    int min_iterations;             // Collision iterations run before checking for convergence
+    int max_iterations;             // Collision iteration budget per step
+    float penetration_tolerance;    // Convergence threshold for max penetration
+    float velocity_tolerance;       // Convergence threshold for max approaching speed
+    float sleep_energy_threshold;   // Kinetic energy below which bodies may sleep, 0 disables sleeping
+    float time_to_sleep;            // Seconds an island must rest before sleeping
+    float neighbor_skin;            // Skin of the neighbor lists, 0 rebuilds them every step
+    NeighborList neighbors;
+    ContactCache contacts;
+    IslandGraph islands;
+    CcdSweep ccd;
+    XpbdScratch xpbd;
+    EventQueue events;
+    QuadTree tree;
+    ParticleMesh mesh;
+    ThreadPool* pool;
+    TrajectoryRecorder* recorder;   // Trajectory written after every step, NULL when not recording
+    StatePublisher* publisher;      // Shared-memory buffer each step is published to, NULL when not publishing
+    ReplicationServer* replication; // Server streaming each step's changes to replicas, NULL when not serving
+    History* history;               // Recent steps kept for rewinding, NULL when not kept
+    PhysicsStats stats;
     bool running;
+    bool paused;                    // Steps are skipped, as while looking back at a rewound one
 } World;
 
 #endif // TYPES_H 
\ No newline at end of file
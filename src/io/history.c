@@ -0,0 +1,504 @@
+#include "history.h"
+#include "../physics/body_pool.h"
+#include "../physics/state_hash.h"
+#include "../physics/physics.h"
+#include "../utils/encoding.h"
+#include "../utils/thread_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bodies are compared and coded as 32-bit words, one mask bit each
+#define BODY_WORDS (sizeof(Body) / sizeof(uint32_t))
+_Static_assert(sizeof(Body) % sizeof(uint32_t) == 0 && BODY_WORDS <= 32, "Body must fit a 32-bit word mask");
+// Longest varint a 32-bit value takes
+#define VARINT_BYTES 5
+// Most a changed body takes: the gap, the mask and every word
+#define CHANGED_BODY_BYTES ((BODY_WORDS + 2) * VARINT_BYTES)
+// Most a warm-started contact takes: two varints and the impulse
+#define CONTACT_BYTES (2 * VARINT_BYTES + sizeof(float))
+// A group closes early once it takes this share of the cap, so there is
+// always an older group to evict before the newest has to go
+#define HISTORY_GROUP_SHARE 8
+// Most parts a capture is split into
+#define HISTORY_MAX_PARTS 64
+
+// Solver state a step hands on to the next besides bodies and contacts
+typedef struct {
+    unsigned next_id;
+    int reorder_steps;
+    int reorders;
+    float reorder_base_gap;
+    int island_next_id;
+    double event_clock;
+} HistoryState;
+
+typedef struct {
+    long step;
+    bool keyframe;          // Coded against nothing rather than the step before
+    int count;              // Bodies after the step
+    int contact_count;      // Contacts carrying an impulse into the next step
+    HistoryState state;
+    unsigned char* data;    // Changed bodies, then the contacts
+    size_t body_size;       // Bytes of data holding the bodies
+    size_t size;
+} HistoryFrame;
+
+// One part of a capture's bodies or contacts, coded on its own into its
+// share of the scratch buffer as if nothing came before it
+typedef struct {
+    int first;              // First body or contact of the part
+    size_t offset;          // Where in the scratch buffer its bytes start
+    size_t size;
+    int last;               // Last body written, or a of the last contact kept
+    int kept;               // Contacts kept
+} HistoryPart;
+
+typedef struct {
+    History* history;
+    const World* world;
+    int reference_count;    // Bodies coded against, 0 for a keyframe
+    int parts;
+    HistoryPart bodies[HISTORY_MAX_PARTS];
+    HistoryPart contacts[HISTORY_MAX_PARTS];
+} CaptureJob;
+
+struct History {
+    size_t memory_cap;
+    size_t memory_used;     // Bytes of the kept frames' data
+    HistoryFrame* frames;   // Ring of consecutive steps, oldest at head
+    int head;
+    int frame_count;
+    int frame_capacity;
+    int group_steps;        // Steps in the newest group, which the next capture extends
+    size_t group_size;      // Bytes of their data
+    long cursor;            // Step the world shows, -1 before the first capture
+    Body* last;             // Bodies as of the cursor, which the next step is coded against
+    int last_count;
+    int last_capacity;
+    ByteBuffer encoded;     // Room for every part of a capture
+};
+
+History* start_history(size_t memory_cap) {
+    History* history = calloc(1, sizeof(History));
+    history->memory_cap = memory_cap;
+    history->cursor = -1;
+    return history;
+}
+
+static HistoryFrame* frame_at(const History* history, int k) {
+    return &history->frames[(history->head + k) % history->frame_capacity];
+}
+
+static void grow_bodies(Body** bodies, int* capacity, int count) {
+    if (count <= *capacity) return;
+    *capacity = count > *capacity * 2 ? count : *capacity * 2;
+    *bodies = realloc(*bodies, sizeof(Body) * *capacity);
+}
+
+// put_varint into room reserved up front, without a size check per byte
+static unsigned char* write_varint(unsigned char* out, uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+// For each body from first to end that differs from the one at its index
+// in reference, or from zero past referenceCount: the number of unchanged
+// bodies since the last one written, a mask of the words that changed, and
+// each changed word XORed with the old one. Nearby floats share their high
+// bits, so the XORs are short varints. Reference is brought up to date
+// along the way. Returns the bytes written.
+static size_t encode_bodies(unsigned char* out, const Body* bodies, Body* reference, int first, int end,
+                            int referenceCount, int* last) {
+    unsigned char* cursor = out;
+    *last = first - 1;
+    for (int i = first; i < end; i++) {
+        if (i >= referenceCount) memset(&reference[i], 0, sizeof(Body));
+        const unsigned char* body = (const unsigned char*)&bodies[i];
+        const unsigned char* old = (const unsigned char*)&reference[i];
+
+        // Compare two words at a time and split only the pairs that differ.
+        // A step changes a few of a moving body's words and none of a
+        // sleeping or static one's, so most pairs are passed over whole.
+        uint32_t mask = 0, changes[BODY_WORDS];
+        int changed = 0;
+        for (size_t w = 0; w < BODY_WORDS; w += 2) {
+            uint64_t word = 0, base = 0;
+            size_t size = w + 1 < BODY_WORDS ? 2 * sizeof(uint32_t) : sizeof(uint32_t);
+            memcpy(&word, body + w * sizeof(uint32_t), size);
+            memcpy(&base, old + w * sizeof(uint32_t), size);
+            if (word == base) continue;
+            for (size_t v = w; v < w + 2 && v < BODY_WORDS; v++) {
+                uint32_t now, then;
+                memcpy(&now, body + v * sizeof(uint32_t), sizeof(uint32_t));
+                memcpy(&then, old + v * sizeof(uint32_t), sizeof(uint32_t));
+                if (now == then) continue;
+                mask |= 1u << v;
+                changes[changed++] = now ^ then;
+            }
+        }
+        if (!mask) continue;
+
+        cursor = write_varint(cursor, (uint32_t)(i - *last - 1));
+        cursor = write_varint(cursor, mask);
+        for (int c = 0; c < changed; c++) {
+            cursor = write_varint(cursor, changes[c]);
+        }
+        reference[i] = bodies[i];
+        *last = i;
+    }
+    return (size_t)(cursor - out);
+}
+
+// Apply coded changes to the count bodies they were coded against
+static bool decode_bodies(const unsigned char* data, size_t size, Body* bodies, int count) {
+    const unsigned char* cursor = data;
+    const unsigned char* end = data + size;
+    int i = -1;
+    while (cursor < end) {
+        uint32_t gap, mask;
+        if (!get_varint(&cursor, end, &gap) || !get_varint(&cursor, end, &mask)) return false;
+        i += (int)gap + 1;
+        if (i < 0 || i >= count) return false;
+
+        uint32_t words[BODY_WORDS];
+        memcpy(words, &bodies[i], sizeof(Body));
+        for (size_t w = 0; w < BODY_WORDS; w++) {
+            if (!(mask & 1u << w)) continue;
+            uint32_t change;
+            if (!get_varint(&cursor, end, &change)) return false;
+            words[w] ^= change;
+        }
+        memcpy(&bodies[i], words, sizeof(Body));
+    }
+    return true;
+}
+
+// The only thing a step takes from the contacts of the one before is the
+// impulse of each pair still touching, so only contacts with an impulse
+// are kept: the change in a from the contact before, b relative to a, and
+// the impulse's bits. Their ids follow from the bodies at a and b.
+static size_t encode_contacts(unsigned char* out, const Contact* contacts, int first, int end,
+                              int* lastA, int* kept) {
+    unsigned char* cursor = out;
+    *lastA = 0;
+    *kept = 0;
+    for (int i = first; i < end; i++) {
+        const Contact* contact = &contacts[i];
+        if (contact->normal_impulse == 0) continue;
+        cursor = write_varint(cursor, zigzag(contact->a - *lastA));
+        cursor = write_varint(cursor, zigzag(contact->b - contact->a));
+        memcpy(cursor, &contact->normal_impulse, sizeof(float));
+        cursor += sizeof(float);
+        *lastA = contact->a;
+        (*kept)++;
+    }
+    return (size_t)(cursor - out);
+}
+
+static void capture_task(void* context, int begin, int end) {
+    CaptureJob* job = context;
+    const World* world = job->world;
+    History* history = job->history;
+    int count = world->bodyCount;
+    int contactCount = world->contacts.count;
+    for (int p = begin; p < end; p++) {
+        HistoryPart* part = &job->bodies[p];
+        part->first = (int)((long)count * p / job->parts);
+        part->offset = (size_t)part->first * CHANGED_BODY_BYTES;
+        part->size = encode_bodies(history->encoded.data + part->offset, world->bodies, history->last,
+            part->first, (int)((long)count * (p + 1) / job->parts), job->reference_count, &part->last);
+
+        part = &job->contacts[p];
+        part->first = (int)((long)contactCount * p / job->parts);
+        part->offset = (size_t)count * CHANGED_BODY_BYTES + (size_t)part->first * CONTACT_BYTES;
+        part->size = encode_contacts(history->encoded.data + part->offset, world->contacts.contacts,
+            part->first, (int)((long)contactCount * (p + 1) / job->parts), &part->last, &part->kept);
+    }
+}
+
+// Copy the parts one after another, recoding the first body of each against
+// the last one written before it, so the bytes come out as if coded in one
+// pass however the capture was split
+static unsigned char* join_bodies(unsigned char* out, const unsigned char* encoded, const HistoryPart* parts, int count) {
+    int last = -1;
+    for (int p = 0; p < count; p++) {
+        const HistoryPart* part = &parts[p];
+        if (part->size == 0) continue;
+        const unsigned char* cursor = encoded + part->offset;
+        const unsigned char* end = cursor + part->size;
+        uint32_t gap;
+        get_varint(&cursor, end, &gap);
+        out = write_varint(out, (uint32_t)(part->first + (int)gap - last - 1));
+        memcpy(out, cursor, (size_t)(end - cursor));
+        out += end - cursor;
+        last = part->last;
+    }
+    return out;
+}
+
+// The same for contacts, whose first a is coded against zero in each part
+static unsigned char* join_contacts(unsigned char* out, const unsigned char* encoded, const HistoryPart* parts, int count) {
+    int lastA = 0;
+    for (int p = 0; p < count; p++) {
+        const HistoryPart* part = &parts[p];
+        if (part->kept == 0) continue;
+        const unsigned char* cursor = encoded + part->offset;
+        const unsigned char* end = cursor + part->size;
+        uint32_t da;
+        get_varint(&cursor, end, &da);
+        out = write_varint(out, zigzag(unzigzag(da) - lastA));
+        memcpy(out, cursor, (size_t)(end - cursor));
+        out += end - cursor;
+        lastA = part->last;
+    }
+    return out;
+}
+
+// Rebuild count contacts against the bodies they were kept with
+static bool decode_contacts(const unsigned char* data, size_t size, Contact* contacts, int count,
+                            const Body* bodies, int bodyCount) {
+    const unsigned char* cursor = data;
+    const unsigned char* end = data + size;
+    int a = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t da, db;
+        if (!get_varint(&cursor, end, &da) || !get_varint(&cursor, end, &db)) return false;
+        a += unzigzag(da);
+        int b = a + unzigzag(db);
+        if (a < 0 || a >= bodyCount || b >= bodyCount || b == a || end - cursor < (ptrdiff_t)sizeof(float)) return false;
+
+        unsigned key_a = bodies[a].id;
+        unsigned key_b = b >= 0 ? bodies[b].id : (unsigned)b;
+        contacts[i] = (Contact){
+            .a = a, .b = b,
+            .key_a = key_a < key_b ? key_a : key_b,
+            .key_b = key_a < key_b ? key_b : key_a
+        };
+        memcpy(&contacts[i].normal_impulse, cursor, sizeof(float));
+        cursor += sizeof(float);
+    }
+    return cursor == end;
+}
+
+static void release_frame(History* history, HistoryFrame* frame) {
+    history->memory_used -= frame->size;
+    free(frame->data);
+}
+
+// Drop the oldest keyframe and the steps coded against it, unless they
+// are all that's left
+static bool evict_oldest(History* history) {
+    int group = 1;
+    while (group < history->frame_count && !frame_at(history, group)->keyframe) group++;
+    if (group == history->frame_count) return false;
+    for (int k = 0; k < group; k++) {
+        release_frame(history, frame_at(history, k));
+    }
+    history->head = (history->head + group) % history->frame_capacity;
+    history->frame_count -= group;
+    return true;
+}
+
+static void clear_frames(History* history) {
+    for (int k = 0; k < history->frame_count; k++) {
+        release_frame(history, frame_at(history, k));
+    }
+    history->frame_count = 0;
+    history->head = 0;
+    history->group_steps = 0;
+    history->group_size = 0;
+}
+
+// Count the newest group again after steps past the cursor were dropped
+static void measure_newest_group(History* history) {
+    history->group_steps = 0;
+    history->group_size = 0;
+    for (int k = history->frame_count - 1; k >= 0; k--) {
+        const HistoryFrame* frame = frame_at(history, k);
+        history->group_steps++;
+        history->group_size += frame->size;
+        if (frame->keyframe) break;
+    }
+}
+
+static void push_frame(History* history, HistoryFrame frame) {
+    if (history->frame_count == history->frame_capacity) {
+        // Unroll the ring into the larger array
+        int capacity = history->frame_capacity ? history->frame_capacity * 2 : 256;
+        HistoryFrame* frames = malloc(sizeof(HistoryFrame) * capacity);
+        for (int k = 0; k < history->frame_count; k++) {
+            frames[k] = *frame_at(history, k);
+        }
+        free(history->frames);
+        history->frames = frames;
+        history->frame_capacity = capacity;
+        history->head = 0;
+    }
+    *frame_at(history, history->frame_count++) = frame;
+    history->memory_used += frame.size;
+    if (frame.keyframe) {
+        history->group_steps = 0;
+        history->group_size = 0;
+    }
+    history->group_steps++;
+    history->group_size += frame.size;
+}
+
+void capture_history(History* history, World* world) {
+    // Steps past a rewound one belong to a run that won't happen now
+    if (history->frame_count > 0 && frame_at(history, history->frame_count - 1)->step > history->cursor) {
+        while (history->frame_count > 0 && frame_at(history, history->frame_count - 1)->step > history->cursor) {
+            release_frame(history, frame_at(history, --history->frame_count));
+        }
+        measure_newest_group(history);
+    }
+
+    long step = history->cursor + 1;
+    bool keyframe = history->frame_count == 0 || history->group_steps >= HISTORY_KEYFRAME_INTERVAL ||
+                    history->group_size >= history->memory_cap / HISTORY_GROUP_SHARE;
+    grow_bodies(&history->last, &history->last_capacity, world->bodyCount);
+    reserve_bytes(&history->encoded,
+        (size_t)world->bodyCount * CHANGED_BODY_BYTES + (size_t)world->contacts.count * CONTACT_BYTES);
+
+    ThreadPool* pool = world->bodyCount >= HISTORY_PARALLEL_BODIES ? world_thread_pool(world) : NULL;
+    CaptureJob job = {
+        .history = history,
+        .world = world,
+        .reference_count = keyframe ? 0 : history->last_count,
+        .parts = pool ? thread_pool_size(pool) * 4 : 1
+    };
+    if (job.parts > HISTORY_MAX_PARTS) job.parts = HISTORY_MAX_PARTS;
+    thread_pool_run(pool, job.parts, capture_task, &job);
+    history->last_count = world->bodyCount;
+
+    // Each part can grow by the varint recoded at its start
+    size_t bound = (size_t)job.parts * 2 * VARINT_BYTES;
+    int contactCount = 0;
+    for (int p = 0; p < job.parts; p++) {
+        bound += job.bodies[p].size + job.contacts[p].size;
+        contactCount += job.contacts[p].kept;
+    }
+    unsigned char* data = malloc(bound);
+    unsigned char* cursor = join_bodies(data, history->encoded.data, job.bodies, job.parts);
+    size_t bodySize = (size_t)(cursor - data);
+    cursor = join_contacts(cursor, history->encoded.data, job.contacts, job.parts);
+    size_t size = (size_t)(cursor - data);
+
+    HistoryFrame frame = {
+        .step = step,
+        .keyframe = keyframe,
+        .count = world->bodyCount,
+        .contact_count = contactCount,
+        .state = {
+            .next_id = world->body_pool.next_id,
+            .reorder_steps = world->body_order.steps,
+            .reorders = world->body_order.reorders,
+            .reorder_base_gap = world->body_order.base_gap,
+            .island_next_id = world->islands.next_id,
+            .event_clock = world->events.clock
+        },
+        .data = size > 0 ? realloc(data, size) : data,
+        .body_size = bodySize,
+        .size = size
+    };
+    push_frame(history, frame);
+    history->cursor = step;
+
+    while (history_bytes(history) > history->memory_cap && evict_oldest(history)) {}
+    // Only the newest group is left and it alone is over the cap
+    if (history_bytes(history) > history->memory_cap) clear_frames(history);
+}
+
+bool history_range(const History* history, long* oldest, long* newest) {
+    if (history->frame_count == 0) return false;
+    *oldest = frame_at(history, 0)->step;
+    *newest = frame_at(history, history->frame_count - 1)->step;
+    return true;
+}
+
+long history_step(const History* history) {
+    return history->cursor;
+}
+
+size_t history_bytes(const History* history) {
+    return history->memory_used +
+           sizeof(HistoryFrame) * (size_t)history->frame_capacity +
+           sizeof(Body) * (size_t)history->last_capacity +
+           history->encoded.capacity;
+}
+
+// Forget the bodies coded against, so the next capture is a keyframe
+static bool damaged_step(History* history, const HistoryFrame* frame) {
+    fprintf(stderr, "History step %ld is damaged\n", frame->step);
+    clear_frames(history);
+    history->last_count = 0;
+    history->cursor = -1;
+    return false;
+}
+
+bool rewind_history(History* history, World* world, long step) {
+    long oldest, newest;
+    if (!history_range(history, &oldest, &newest) || step < oldest || step > newest) return false;
+
+    // Start from the last keyframe at or before the step and play forward
+    int target = (int)(step - oldest);
+    int k = target;
+    while (!frame_at(history, k)->keyframe) k--;
+
+    int count = 0;
+    for (; k <= target; k++) {
+        const HistoryFrame* frame = frame_at(history, k);
+        grow_bodies(&history->last, &history->last_capacity, frame->count);
+        // Bodies past the previous step's were coded against zero
+        int from = frame->keyframe ? 0 : count;
+        if (frame->count > from) {
+            memset(history->last + from, 0, sizeof(Body) * (frame->count - from));
+        }
+        if (!decode_bodies(frame->data, frame->body_size, history->last, frame->count)) {
+            return damaged_step(history, frame);
+        }
+        count = frame->count;
+    }
+    history->last_count = count;
+    history->cursor = step;
+
+    // Contacts keep their impulses, so the next step warm starts as it did the first time
+    const HistoryFrame* frame = frame_at(history, target);
+    ContactCache* cache = &world->contacts;
+    if (cache->capacity < frame->contact_count) {
+        cache->capacity = frame->contact_count;
+        cache->contacts = realloc(cache->contacts, sizeof(Contact) * cache->capacity);
+    }
+    if (!decode_contacts(frame->data + frame->body_size, frame->size - frame->body_size,
+            cache->contacts, frame->contact_count, history->last, count)) {
+        cache->count = 0;
+        return damaged_step(history, frame);
+    }
+    cache->count = frame->contact_count;
+    restore_bodies(world, history->last, count);
+
+    const HistoryState* state = &frame->state;
+    world->body_pool.next_id = state->next_id;
+    world->body_order.steps = state->reorder_steps;
+    world->body_order.reorders = state->reorders;
+    world->body_order.base_gap = state->reorder_base_gap;
+    world->islands.next_id = state->island_next_id;
+    world->events.clock = state->event_clock;
+    world->stats.state_hash = hash_world_state(world);
+    return true;
+}
+
+void stop_history(History* history) {
+    for (int k = 0; k < history->frame_count; k++) {
+        free(frame_at(history, k)->data);
+    }
+    free(history->frames);
+    free(history->last);
+    free_bytes(&history->encoded);
+    free(history);
+}
@@ -0,0 +1,44 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "../core/types.h"
+
+// Recent steps of the world kept in memory for rewinding. A keyframe holds
+// a full copy of the bodies, and the steps after it hold only the words of
+// each body that changed since the step before. Every step also keeps the
+// impulses its contacts hand on to the next and the solver counters a step
+// carries, so stepping on from a rewound step retraces the original run.
+//
+// The cap covers the kept steps and the working copies alike, a few hundred
+// bytes a body. A keyframe starts every HISTORY_KEYFRAME_INTERVAL steps, or
+// sooner once the steps since the last one take an eighth of the cap. Once
+// over the cap, the oldest keyframe and the steps that depend on it are
+// dropped together, and if the newest keyframe's steps alone don't fit,
+// nothing is kept until the next one.
+
+// Start keeping history in at most memory_cap bytes
+History* start_history(size_t memory_cap);
+
+// Add the world as the step after the one it shows. Steps after that one,
+// left over from rewinding, are dropped first. Large worlds are coded on
+// the world's threads.
+void capture_history(History* history, World* world);
+
+// Oldest and newest steps held. Returns false while the history is empty.
+bool history_range(const History* history, long* oldest, long* newest);
+
+// Step the world shows: the newest, or the one it was last rewound to
+long history_step(const History* history);
+
+// Memory the kept steps and working copies take up, at most the cap
+size_t history_bytes(const History* history);
+
+// Rebuild the world as it was after step: the bodies in the slots they had,
+// the contacts' impulses and the state hash. Returns false if the step
+// isn't held.
+bool rewind_history(History* history, World* world, long step);
+
+// Release the history
+void stop_history(History* history);
+
+#endif // HISTORY_H
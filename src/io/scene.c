@@ -0,0 +1,800 @@
+#include "scene.h"
+#include "../physics/body_pool.h"
+#include "../physics/physics.h"
+#include "../utils/thread_pool.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SCENE_MAGIC "PHYSCNE"
+#define SCENE_VERSION 1
+#define SCENE_ENDIAN 0x01020304u
+#define SCENE_KEYWORD "scene"
+#define SCENE_SEED 1
+// Text scenes are split into pieces of about this many bytes for parsing
+#define SCENE_CHUNK_BYTES (1 << 20)
+#define SCENE_ERROR_LENGTH 128
+// Records packed at a time when writing a binary scene
+#define SCENE_WRITE_BATCH 4096
+
+// Settings a text scene can give; the rest keep the world's values
+enum {
+    SETTING_BOUNDS = 1 << 0,
+    SETTING_GRAVITY = 1 << 1,
+    SETTING_RESTITUTION = 1 << 2,
+    SETTING_FIELD = 1 << 3,
+    SETTING_FIELD_CONSTANT = 1 << 4,
+    SETTING_SOLVER = 1 << 5,
+    SETTING_COLLISION = 1 << 6,
+    SETTING_SEED = 1 << 7
+};
+
+typedef struct {
+    unsigned given;             // SETTING_* bits of the fields the scene set
+    float width;
+    float height;
+    float gravity;
+    float restitution;
+    float field_constant;
+    ForceField field;
+    SolverType solver;
+    CollisionMode collision_mode;
+    uint64_t seed;              // Seeds the sampled values of every body
+} SceneSettings;
+
+// Fixed-width header of a binary scene, followed by body_count records
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;            // SCENE_ENDIAN as the writer stored it
+    uint32_t header_size;
+    uint32_t record_size;
+    uint64_t body_count;
+    float width;
+    float height;
+    float gravity;
+    float restitution;
+    float field_constant;
+    int32_t field;
+    int32_t solver;
+    int32_t collision_mode;
+} SceneHeader;
+
+// A body as a binary scene stores it: only what create_body needs
+typedef struct {
+    float x, y;
+    float vx, vy;
+    float mass;
+    float radius;
+    float charge;
+    uint8_t r, g, b;
+    uint8_t type;
+} SceneRecord;
+
+// A value, or the range it is sampled uniformly from for each body
+typedef struct {
+    float min;
+    float max;
+} Range;
+
+typedef enum {
+    LINE_BLANK,
+    LINE_SETTING,
+    LINE_BODY,                  // body x y vx vy mass radius
+    LINE_UNIFORM,               // uniform count x y vx vy mass radius
+    LINE_LATTICE,               // lattice columns rows x y vx vy mass radius
+    LINE_DISK                   // disk count cx cy r speed mass radius
+} LineKind;
+
+// Bodies a line of a text scene adds
+typedef struct {
+    LineKind kind;
+    long count;
+    long columns;               // Lattice columns; x and y span the lattice
+    Range values[6];            // The six ranges in the order the line gives them
+    Range charge;
+    BodyType type;
+    bool colored;               // Whether color is fixed rather than random
+    SDL_Color color;
+    long first;                 // Scene index of the first body added
+} Directive;
+
+// A run of whole lines of a text scene, parsed as one task
+typedef struct {
+    const char* begin;
+    const char* end;
+    long lines;
+    long bodies;                // Bodies added by all the chunk's lines
+    long first;                 // Scene index of the chunk's first body
+    SceneSettings settings;     // Settings given in the chunk
+    Directive* distributions;   // Lines adding many bodies, generated once all chunks are parsed
+    int distribution_count;
+    int distribution_capacity;
+    long error_line;            // Line of the first error within the chunk, or -1
+    char error[SCENE_ERROR_LENGTH];
+} SceneChunk;
+
+typedef struct {
+    SceneChunk* chunks;
+    Body* bodies;               // Storage for the scene's first body
+    uint64_t seed;
+    const Directive* directive; // Distribution being generated
+    const SceneRecord* records;
+    atomic_bool invalid;        // Whether any body generated or converted failed valid_body
+} SceneLoad;
+
+static uint64_t mix_bits(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Uniform value in [0, 1) from a splitmix stream
+static float next_unit(uint64_t* state) {
+    *state += 0x9E3779B97F4A7C15ull;
+    return (mix_bits(*state) >> 40) * (1.0f / (1 << 24));
+}
+
+static float sample(const Range* range, uint64_t* state) {
+    return range->min + (range->max - range->min) * next_unit(state);
+}
+
+// Position of column i of count spread evenly across range
+static float spread(const Range* range, long i, long count) {
+    if (count <= 1) return (range->min + range->max) / 2;
+    return range->min + (range->max - range->min) * i / (count - 1);
+}
+
+// Note that a body failed valid_body; any task may, so the flag is atomic
+static void mark_invalid(SceneLoad* load) {
+    atomic_store_explicit(&load->invalid, true, memory_order_relaxed);
+}
+
+// Body k of a directive. Each body draws from its own stream, keyed by its
+// index in the scene, so the result doesn't depend on how parsing was split.
+static Body make_body(const Directive* directive, long k, uint64_t seed) {
+    uint64_t state = mix_bits(seed + (uint64_t)(directive->first + k) * 0xD1B54A32D192ED03ull);
+    const Range* v = directive->values;
+    float x, y, vx, vy;
+    if (directive->kind == LINE_LATTICE) {
+        long rows = directive->count / directive->columns;
+        x = spread(&v[0], k % directive->columns, directive->columns);
+        y = spread(&v[1], k / directive->columns, rows);
+        vx = sample(&v[2], &state);
+        vy = sample(&v[3], &state);
+    } else if (directive->kind == LINE_DISK) {
+        // Uniform over the annulus, moving around its center
+        float angle = 2 * (float)M_PI * next_unit(&state);
+        float inner = v[2].min * v[2].min;
+        float r = sqrtf(inner + (v[2].max * v[2].max - inner) * next_unit(&state));
+        float speed = sample(&v[3], &state);
+        x = sample(&v[0], &state) + cosf(angle) * r;
+        y = sample(&v[1], &state) + sinf(angle) * r;
+        vx = -sinf(angle) * speed;
+        vy = cosf(angle) * speed;
+    } else {
+        x = sample(&v[0], &state);
+        y = sample(&v[1], &state);
+        vx = sample(&v[2], &state);
+        vy = sample(&v[3], &state);
+    }
+    float mass = sample(&v[4], &state);
+    float radius = sample(&v[5], &state);
+
+    SDL_Color color = directive->color;
+    if (!directive->colored) {
+        uint64_t bits = mix_bits(state + 1);
+        color = (SDL_Color){ bits & 0xFF, (bits >> 8) & 0xFF, (bits >> 16) & 0xFF, 255 };
+    }
+    Body body = create_body(x, y, vx, vy, mass, radius, color);
+    body.charge = sample(&directive->charge, &state);
+    set_body_type(NULL, &body, directive->type);
+    return body;
+}
+
+// Next whitespace-separated token before end, stopping at a comment
+static bool next_token(const char** cursor, const char* end, const char** token, int* length) {
+    const char* p = *cursor;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    if (p == end || *p == '#') {
+        *cursor = end;
+        return false;
+    }
+    *token = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') p++;
+    *length = (int)(p - *token);
+    *cursor = p;
+    return true;
+}
+
+static bool token_is(const char* token, int length, const char* word) {
+    return (int)strlen(word) == length && memcmp(token, word, length) == 0;
+}
+
+// The text buffer ends in a terminator, so strtof stops at the token's end
+// at the latest
+static bool parse_float(const char* token, const char* end, float* value, const char** stop) {
+    char* after;
+    *value = strtof(token, &after);
+    *stop = after;
+    return after != token && after <= end && isfinite(*value);
+}
+
+// A value or min:max range
+static bool parse_range(const char* token, int length, Range* range) {
+    const char* end = token + length;
+    const char* stop;
+    if (!parse_float(token, end, &range->min, &stop)) return false;
+    range->max = range->min;
+    if (stop < end && *stop == ':') {
+        if (!parse_float(stop + 1, end, &range->max, &stop)) return false;
+    }
+    return stop == end && range->min <= range->max;
+}
+
+static bool parse_count(const char* token, int length, long* count) {
+    char* after;
+    *count = strtol(token, &after, 10);
+    return after == token + length && *count > 0 && *count <= INT_MAX;
+}
+
+// Parse one of the keywords in names, returning its index or -1
+static int parse_choice(const char* token, int length, const char* const* names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (token_is(token, length, names[i])) return i;
+    }
+    return -1;
+}
+
+static const char* const FIELD_NAMES[] = { "uniform", "gravitation", "electrostatic", "none" };
+static const char* const SOLVER_NAMES[] = { "impulse", "xpbd", "event" };
+static const char* const COLLISION_NAMES[] = { "discrete", "ccd", "speculative" };
+static const char* const TYPE_NAMES[] = { "dynamic", "kinematic", "static" };
+
+// Next token as a number
+static bool next_number(const char** cursor, const char* end, float* value) {
+    const char* token;
+    const char* stop;
+    int length;
+    return next_token(cursor, end, &token, &length) &&
+           parse_float(token, token + length, value, &stop) && stop == token + length;
+}
+
+// Next token as one of the keywords in names, returning its index or -1
+static int next_choice(const char** cursor, const char* end, const char* const* names, int count) {
+    const char* token;
+    int length;
+    if (!next_token(cursor, end, &token, &length)) return -1;
+    return parse_choice(token, length, names, count);
+}
+
+// Parse the rest of a setting line
+static bool parse_setting(const char* keyword, int keywordLength, const char** cursor, const char* end,
+                          SceneSettings* settings, char* error) {
+    float value;
+    int choice;
+    bool ok;
+    if (token_is(keyword, keywordLength, SCENE_KEYWORD)) {
+        ok = next_number(cursor, end, &value) && value == SCENE_VERSION;
+    } else if (token_is(keyword, keywordLength, "bounds")) {
+        ok = next_number(cursor, end, &settings->width) && next_number(cursor, end, &settings->height) &&
+             settings->width > 0 && settings->height > 0;
+        settings->given |= SETTING_BOUNDS;
+    } else if (token_is(keyword, keywordLength, "gravity")) {
+        ok = next_number(cursor, end, &settings->gravity);
+        settings->given |= SETTING_GRAVITY;
+    } else if (token_is(keyword, keywordLength, "restitution")) {
+        ok = next_number(cursor, end, &settings->restitution) && settings->restitution >= 0;
+        settings->given |= SETTING_RESTITUTION;
+    } else if (token_is(keyword, keywordLength, "field")) {
+        ok = (choice = next_choice(cursor, end, FIELD_NAMES, 4)) >= 0;
+        settings->field = (ForceField)choice;
+        settings->given |= SETTING_FIELD;
+    } else if (token_is(keyword, keywordLength, "field_constant")) {
+        ok = next_number(cursor, end, &settings->field_constant);
+        settings->given |= SETTING_FIELD_CONSTANT;
+    } else if (token_is(keyword, keywordLength, "solver")) {
+        ok = (choice = next_choice(cursor, end, SOLVER_NAMES, 3)) >= 0;
+        settings->solver = (SolverType)choice;
+        settings->given |= SETTING_SOLVER;
+    } else if (token_is(keyword, keywordLength, "collision")) {
+        ok = (choice = next_choice(cursor, end, COLLISION_NAMES, 3)) >= 0;
+        settings->collision_mode = (CollisionMode)choice;
+        settings->given |= SETTING_COLLISION;
+    } else {
+        const char* token;
+        int length;
+        char* after = NULL;
+        ok = next_token(cursor, end, &token, &length);
+        if (ok) settings->seed = strtoull(token, &after, 10);
+        ok = ok && after == token + length;
+        settings->given |= SETTING_SEED;
+    }
+
+    const char* extra;
+    int extraLength;
+    if (!ok || next_token(cursor, end, &extra, &extraLength)) {
+        snprintf(error, SCENE_ERROR_LENGTH, "bad value for %.*s", keywordLength, keyword);
+        return false;
+    }
+    return true;
+}
+
+// Parse the rest of a line adding bodies: its counts, six ranges and options
+static bool parse_directive(const char** cursor, const char* end, Directive* directive, char* error) {
+    const char* token;
+    int length;
+    directive->count = 1;
+    if (directive->kind == LINE_UNIFORM || directive->kind == LINE_DISK || directive->kind == LINE_LATTICE) {
+        if (!next_token(cursor, end, &token, &length) || !parse_count(token, length, &directive->count)) {
+            snprintf(error, SCENE_ERROR_LENGTH, "expected a positive body count");
+            return false;
+        }
+    }
+    if (directive->kind == LINE_LATTICE) {
+        long rows;
+        if (!next_token(cursor, end, &token, &length) || !parse_count(token, length, &rows) ||
+            directive->count * rows > INT_MAX) {
+            snprintf(error, SCENE_ERROR_LENGTH, "expected a positive lattice row count");
+            return false;
+        }
+        directive->columns = directive->count;
+        directive->count *= rows;
+    }
+
+    for (int i = 0; i < 6; i++) {
+        if (!next_token(cursor, end, &token, &length) || !parse_range(token, length, &directive->values[i])) {
+            snprintf(error, SCENE_ERROR_LENGTH, "expected six values or min:max ranges");
+            return false;
+        }
+    }
+    if (directive->values[4].min <= 0 || directive->values[5].min <= 0) {
+        snprintf(error, SCENE_ERROR_LENGTH, "mass and radius must be positive");
+        return false;
+    }
+
+    directive->charge = (Range){ 0, 0 };
+    directive->type = BODY_DYNAMIC;
+    directive->colored = false;
+    while (next_token(cursor, end, &token, &length)) {
+        const char* equals = memchr(token, '=', length);
+        int nameLength = equals ? (int)(equals - token) : length;
+        const char* value = equals ? equals + 1 : token + length;
+        int valueLength = (int)(token + length - value);
+        bool valid = false;
+        if (equals && token_is(token, nameLength, "type")) {
+            int type = parse_choice(value, valueLength, TYPE_NAMES, 3);
+            directive->type = (BodyType)type;
+            valid = type >= 0;
+        } else if (equals && token_is(token, nameLength, "charge")) {
+            valid = parse_range(value, valueLength, &directive->charge);
+        } else if (equals && token_is(token, nameLength, "color")) {
+            char* after;
+            unsigned long rgb = strtoul(value, &after, 16);
+            directive->color = (SDL_Color){ (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF, 255 };
+            directive->colored = true;
+            valid = valueLength > 0 && after == value + valueLength && rgb <= 0xFFFFFF;
+        }
+        if (!valid) {
+            snprintf(error, SCENE_ERROR_LENGTH, "bad option '%.*s'", length, token);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Classify a line by its keyword, then parse it if it is a body line and
+// bodies is set, or a setting or distribution and it isn't
+static bool parse_line(const char* line, const char* end, bool bodies, LineKind* kind,
+                       Directive* directive, SceneSettings* settings, char* error) {
+    const char* cursor = line;
+    const char* keyword;
+    int length;
+    if (!next_token(&cursor, end, &keyword, &length)) {
+        *kind = LINE_BLANK;
+        return true;
+    }
+
+    if (token_is(keyword, length, "body")) *kind = LINE_BODY;
+    else if (token_is(keyword, length, "uniform")) *kind = LINE_UNIFORM;
+    else if (token_is(keyword, length, "lattice")) *kind = LINE_LATTICE;
+    else if (token_is(keyword, length, "disk")) *kind = LINE_DISK;
+    else if (token_is(keyword, length, SCENE_KEYWORD) || token_is(keyword, length, "bounds") ||
+             token_is(keyword, length, "gravity") || token_is(keyword, length, "restitution") ||
+             token_is(keyword, length, "field") || token_is(keyword, length, "field_constant") ||
+             token_is(keyword, length, "solver") || token_is(keyword, length, "collision") ||
+             token_is(keyword, length, "seed")) {
+        *kind = LINE_SETTING;
+        return bodies || parse_setting(keyword, length, &cursor, end, settings, error);
+    } else {
+        snprintf(error, SCENE_ERROR_LENGTH, "unknown keyword '%.*s'", length, keyword);
+        return false;
+    }
+
+    if (bodies != (*kind == LINE_BODY)) return true;
+    directive->kind = *kind;
+    return parse_directive(&cursor, end, directive, error);
+}
+
+// First pass over a chunk: settings, distributions and how many bodies it adds
+static void scan_chunk(SceneChunk* chunk) {
+    for (const char* line = chunk->begin; line < chunk->end; chunk->lines++) {
+        const char* end = memchr(line, '\n', chunk->end - line);
+        if (!end) end = chunk->end;
+
+        LineKind kind;
+        Directive directive;
+        bool ok = parse_line(line, end, false, &kind, &directive, &chunk->settings, chunk->error);
+        if (ok && kind == LINE_BODY) {
+            chunk->bodies++;
+        } else if (ok && kind != LINE_BLANK && kind != LINE_SETTING) {
+            if (chunk->distribution_count == chunk->distribution_capacity) {
+                chunk->distribution_capacity = chunk->distribution_capacity ? chunk->distribution_capacity * 2 : 16;
+                chunk->distributions = realloc(chunk->distributions,
+                    sizeof(Directive) * chunk->distribution_capacity);
+            }
+            directive.first = chunk->bodies;
+            chunk->distributions[chunk->distribution_count++] = directive;
+            chunk->bodies += directive.count;
+        }
+        if (!ok || chunk->bodies > INT_MAX) {
+            if (ok) snprintf(chunk->error, SCENE_ERROR_LENGTH, "too many bodies");
+            chunk->error_line = chunk->lines;
+            return;
+        }
+        line = end + 1;
+    }
+}
+
+static void scan_task(void* context, int begin, int end) {
+    SceneLoad* load = context;
+    for (int c = begin; c < end; c++) {
+        scan_chunk(&load->chunks[c]);
+    }
+}
+
+// Second pass: write the body lines into place, leaving room for the
+// distributions between them
+static void fill_task(void* context, int begin, int end) {
+    SceneLoad* load = context;
+    for (int c = begin; c < end; c++) {
+        SceneChunk* chunk = &load->chunks[c];
+        long next = chunk->first;
+        int distribution = 0;
+        long lineNumber = 0;
+        for (const char* line = chunk->begin; line < chunk->end; lineNumber++) {
+            const char* lineEnd = memchr(line, '\n', chunk->end - line);
+            if (!lineEnd) lineEnd = chunk->end;
+
+            LineKind kind;
+            Directive directive;
+            if (!parse_line(line, lineEnd, true, &kind, &directive, NULL, chunk->error)) {
+                chunk->error_line = lineNumber;
+                break;
+            }
+            if (kind == LINE_BODY) {
+                directive.first = next;
+                load->bodies[next] = make_body(&directive, 0, load->seed);
+                if (!valid_body(&load->bodies[next++])) {
+                    snprintf(chunk->error, SCENE_ERROR_LENGTH, "body values out of range");
+                    chunk->error_line = lineNumber;
+                    break;
+                }
+            } else if (kind != LINE_BLANK && kind != LINE_SETTING) {
+                next += chunk->distributions[distribution++].count;
+            }
+            line = lineEnd + 1;
+        }
+    }
+}
+
+static void generate_task(void* context, int begin, int end) {
+    SceneLoad* load = context;
+    const Directive* directive = load->directive;
+    for (int k = begin; k < end; k++) {
+        Body* body = &load->bodies[directive->first + k];
+        *body = make_body(directive, k, load->seed);
+        if (!valid_body(body)) mark_invalid(load);
+    }
+}
+
+static void apply_settings(World* world, const SceneSettings* settings) {
+    if (settings->given & SETTING_BOUNDS) {
+        world->width = settings->width;
+        world->height = settings->height;
+    }
+    if (settings->given & SETTING_GRAVITY) world->gravity = settings->gravity;
+    if (settings->given & SETTING_RESTITUTION) world->restitution = settings->restitution;
+    if (settings->given & SETTING_FIELD) world->field = settings->field;
+    if (settings->given & SETTING_FIELD_CONSTANT) world->field_constant = settings->field_constant;
+    if (settings->given & SETTING_SOLVER) world->solver = settings->solver;
+    if (settings->given & SETTING_COLLISION) world->collision_mode = settings->collision_mode;
+}
+
+// Later chunks' settings override earlier ones, as later lines would
+static void merge_settings(SceneSettings* into, const SceneSettings* from) {
+    if (from->given & SETTING_BOUNDS) {
+        into->width = from->width;
+        into->height = from->height;
+    }
+    if (from->given & SETTING_GRAVITY) into->gravity = from->gravity;
+    if (from->given & SETTING_RESTITUTION) into->restitution = from->restitution;
+    if (from->given & SETTING_FIELD) into->field = from->field;
+    if (from->given & SETTING_FIELD_CONSTANT) into->field_constant = from->field_constant;
+    if (from->given & SETTING_SOLVER) into->solver = from->solver;
+    if (from->given & SETTING_COLLISION) into->collision_mode = from->collision_mode;
+    if (from->given & SETTING_SEED) into->seed = from->seed;
+    into->given |= from->given;
+}
+
+// Report the first error in any chunk, numbering lines across the file
+static bool report_error(const char* path, const SceneChunk* chunks, int count) {
+    long lines = 0;
+    for (int c = 0; c < count; c++) {
+        if (chunks[c].error_line >= 0) {
+            fprintf(stderr, "%s:%ld: %s\n", path, lines + chunks[c].error_line + 1, chunks[c].error);
+            return true;
+        }
+        lines += chunks[c].lines;
+    }
+    return false;
+}
+
+static bool load_text_scene(World* world, const char* path, const char* text, size_t size) {
+    // Split into chunks of whole lines
+    int count = (int)(size / SCENE_CHUNK_BYTES) + 1;
+    SceneChunk* chunks = calloc(count, sizeof(SceneChunk));
+    const char* begin = text;
+    for (int c = 0; c < count; c++) {
+        const char* end = text + size * (c + 1) / count;
+        if (end < begin) end = begin;
+        const char* newline = c + 1 < count ? memchr(end, '\n', text + size - end) : NULL;
+        end = newline ? newline + 1 : text + size;
+        chunks[c] = (SceneChunk){ .begin = begin, .end = end, .error_line = -1 };
+        begin = end;
+    }
+
+    ThreadPool* pool = world_thread_pool(world);
+    SceneLoad load = { .chunks = chunks };
+    thread_pool_run(pool, count, scan_task, &load);
+    bool ok = !report_error(path, chunks, count);
+
+    // Place each chunk's bodies after the previous chunk's
+    SceneSettings settings = { .seed = SCENE_SEED };
+    long total = 0;
+    for (int c = 0; c < count && ok; c++) {
+        chunks[c].first = total;
+        for (int d = 0; d < chunks[c].distribution_count; d++) {
+            chunks[c].distributions[d].first += total;
+        }
+        total += chunks[c].bodies;
+        merge_settings(&settings, &chunks[c].settings);
+    }
+    if (ok && total > INT_MAX - world->bodyCount) {
+        fprintf(stderr, "%s: too many bodies\n", path);
+        ok = false;
+    }
+
+    if (ok) {
+        reserve_bodies(world, world->bodyCount + (int)total);
+        load.bodies = world->bodies + world->bodyCount;
+        load.seed = settings.seed;
+        thread_pool_run(pool, count, fill_task, &load);
+        ok = !report_error(path, chunks, count);
+    }
+    for (int c = 0; c < count && ok; c++) {
+        for (int d = 0; d < chunks[c].distribution_count; d++) {
+            load.directive = &chunks[c].distributions[d];
+            thread_pool_run(pool, (int)load.directive->count, generate_task, &load);
+        }
+    }
+    // Ranges of finite values can still place a body out of range, as a disk
+    // far enough out does
+    if (ok && atomic_load(&load.invalid)) {
+        fprintf(stderr, "%s: a distribution generates bodies with values out of range\n", path);
+        ok = false;
+    }
+    if (ok) {
+        spawn_reserved_bodies(world, (int)total);
+        apply_settings(world, &settings);
+    }
+
+    for (int c = 0; c < count; c++) {
+        free(chunks[c].distributions);
+    }
+    free(chunks);
+    return ok;
+}
+
+static void convert_task(void* context, int begin, int end) {
+    SceneLoad* load = context;
+    for (int i = begin; i < end; i++) {
+        const SceneRecord* record = &load->records[i];
+        Body body = create_body(record->x, record->y, record->vx, record->vy, record->mass, record->radius,
+            (SDL_Color){ record->r, record->g, record->b, 255 });
+        body.charge = record->charge;
+        set_body_type(NULL, &body, record->type <= BODY_STATIC ? (BodyType)record->type : BODY_DYNAMIC);
+        if (!valid_body(&body)) mark_invalid(load);
+        load->bodies[i] = body;
+    }
+}
+
+// Hold a binary scene's settings to the same ranges parse_setting holds a
+// text scene's to
+static bool settings_in_range(const SceneHeader* header) {
+    return isfinite(header->width) && isfinite(header->height) && header->width > 0 && header->height > 0 &&
+           isfinite(header->gravity) && isfinite(header->field_constant) &&
+           isfinite(header->restitution) && header->restitution >= 0;
+}
+
+static bool load_binary_scene(World* world, const char* path, int fd, size_t size) {
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Failed to map scene %s\n", path);
+        return false;
+    }
+
+    const SceneHeader* header = mapping;
+    bool valid = size >= sizeof(SceneHeader) &&
+        header->version == SCENE_VERSION && header->endian == SCENE_ENDIAN &&
+        header->header_size == sizeof(SceneHeader) && header->record_size == sizeof(SceneRecord) &&
+        header->body_count <= (uint64_t)(INT_MAX - world->bodyCount) &&
+        header->body_count <= (size - sizeof(SceneHeader)) / sizeof(SceneRecord) &&
+        header->field >= 0 && header->field <= FIELD_NONE &&
+        header->solver >= 0 && header->solver <= SOLVER_EVENT &&
+        header->collision_mode >= 0 && header->collision_mode <= COLLISION_SPECULATIVE;
+    if (!valid) {
+        fprintf(stderr, "Scene %s is damaged or from an incompatible build\n", path);
+        munmap(mapping, size);
+        return false;
+    }
+    if (!settings_in_range(header)) {
+        fprintf(stderr, "Scene %s holds settings out of range\n", path);
+        munmap(mapping, size);
+        return false;
+    }
+
+    int count = (int)header->body_count;
+    reserve_bodies(world, world->bodyCount + count);
+    SceneLoad load = {
+        .bodies = world->bodies + world->bodyCount,
+        .records = (const SceneRecord*)(header + 1)
+    };
+    thread_pool_run(world_thread_pool(world), count, convert_task, &load);
+    if (atomic_load(&load.invalid)) {
+        fprintf(stderr, "Scene %s holds bodies with values out of range\n", path);
+        munmap(mapping, size);
+        return false;
+    }
+    spawn_reserved_bodies(world, count);
+
+    SceneSettings settings = {
+        .given = SETTING_BOUNDS | SETTING_GRAVITY | SETTING_RESTITUTION | SETTING_FIELD |
+                 SETTING_FIELD_CONSTANT | SETTING_SOLVER | SETTING_COLLISION,
+        .width = header->width,
+        .height = header->height,
+        .gravity = header->gravity,
+        .restitution = header->restitution,
+        .field_constant = header->field_constant,
+        .field = (ForceField)header->field,
+        .solver = (SolverType)header->solver,
+        .collision_mode = (CollisionMode)header->collision_mode
+    };
+    apply_settings(world, &settings);
+    munmap(mapping, size);
+    return true;
+}
+
+// Read the start of a file to tell binary scenes, text scenes and others apart
+static bool read_start(int fd, char start[8]) {
+    memset(start, 0, 8);
+    return pread(fd, start, 8, 0) >= 0;
+}
+
+static bool is_binary_start(const char start[8]) {
+    return memcmp(start, SCENE_MAGIC, sizeof(SCENE_MAGIC)) == 0;
+}
+
+static bool is_text_start(const char start[8]) {
+    size_t length = strlen(SCENE_KEYWORD);
+    return memcmp(start, SCENE_KEYWORD, length) == 0 && (start[length] == ' ' || start[length] == '\t');
+}
+
+bool is_scene_file(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    char start[8];
+    bool scene = read_start(fd, start) && (is_binary_start(start) || is_text_start(start));
+    close(fd);
+    return scene;
+}
+
+bool load_scene(World* world, const char* path) {
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    char start[8];
+    if (fd < 0 || fstat(fd, &info) != 0 || !read_start(fd, start)) {
+        fprintf(stderr, "Failed to open scene %s\n", path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    size_t size = (size_t)info.st_size;
+
+    bool loaded = false;
+    if (is_binary_start(start)) {
+        loaded = load_binary_scene(world, path, fd, size);
+    } else if (is_text_start(start)) {
+        // Terminated so number parsing can't run past the last line
+        char* text = malloc(size + 1);
+        if (pread(fd, text, size, 0) == (ssize_t)size) {
+            text[size] = '\0';
+            loaded = load_text_scene(world, path, text, size);
+        } else {
+            fprintf(stderr, "Failed to read scene %s\n", path);
+        }
+        free(text);
+    } else {
+        fprintf(stderr, "%s is not a scene: text scenes start with '%s %d'\n", path, SCENE_KEYWORD, SCENE_VERSION);
+    }
+    close(fd);
+    return loaded;
+}
+
+bool save_scene(const World* world, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open scene %s for writing\n", path);
+        return false;
+    }
+
+    SceneHeader header = {
+        .version = SCENE_VERSION,
+        .endian = SCENE_ENDIAN,
+        .header_size = sizeof(SceneHeader),
+        .record_size = sizeof(SceneRecord),
+        .body_count = (uint64_t)world->bodyCount,
+        .width = world->width,
+        .height = world->height,
+        .gravity = world->gravity,
+        .restitution = world->restitution,
+        .field_constant = world->field_constant,
+        .field = world->field,
+        .solver = world->solver,
+        .collision_mode = world->collision_mode
+    };
+    memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    SceneRecord* records = malloc(sizeof(SceneRecord) * SCENE_WRITE_BATCH);
+    for (int begin = 0; begin < world->bodyCount && written; begin += SCENE_WRITE_BATCH) {
+        int count = world->bodyCount - begin < SCENE_WRITE_BATCH ? world->bodyCount - begin : SCENE_WRITE_BATCH;
+        for (int i = 0; i < count; i++) {
+            const Body* body = &world->bodies[begin + i];
+            records[i] = (SceneRecord){
+                .x = body->x, .y = body->y,
+                .vx = body->vx, .vy = body->vy,
+                .mass = body->mass,
+                .radius = body->radius,
+                .charge = body->charge,
+                .r = body->color.r, .g = body->color.g, .b = body->color.b,
+                .type = (uint8_t)body->type
+            };
+        }
+        written = fwrite(records, sizeof(SceneRecord), count, file) == (size_t)count;
+    }
+    free(records);
+
+    if (fclose(file) != 0) written = false;
+    if (!written) {
+        fprintf(stderr, "Failed to write scene %s\n", path);
+    }
+    return written;
+}
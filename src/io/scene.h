@@ -0,0 +1,19 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "../core/types.h"
+
+// Whether path holds a scene, text or binary, rather than a snapshot
+bool is_scene_file(const char* path);
+
+// Add a scene's bodies to the world and apply the settings it gives. Text
+// scenes are parsed and binary ones converted across the world's threads,
+// straight into body storage. Scenes with a body whose values are out of
+// range fail to load. On failure the error is reported and the world is
+// left as it was.
+bool load_scene(World* world, const char* path);
+
+// Write the world's bodies and settings as a binary scene
+bool save_scene(const World* world, const char* path);
+
+#endif // SCENE_H
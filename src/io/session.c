@@ -0,0 +1,386 @@
+#include "session.h"
+#include "scene.h"
+#include "snapshot.h"
+#include "../physics/physics.h"
+#include "../physics/body_pool.h"
+#include "../utils/random.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SESSION_MAGIC "PHYSSES"
+#define SESSION_VERSION 5
+#define MAX_WORLD_PATH 4096
+#define MAX_SESSION_SNAPSHOT ((uint64_t)1 << 34)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t seed;
+    uint32_t path_length;   // Bytes of the world path that follows, 0 for none
+    uint32_t world_snapshot;    // Whether the world path is a snapshot, whose bytes follow the path
+    uint64_t snapshot_size;
+} SessionHeader;
+
+struct SessionRecorder {
+    FILE* file;
+    char* snapshot_path;        // Where loads recorded in the session read from
+    SessionSettings settings;   // Settings as of the last event written
+    bool has_settings;
+    bool ok;
+};
+
+struct SessionReader {
+    FILE* file;
+    unsigned seed;
+    char* world_path;
+    bool world_snapshot;
+    unsigned char* start;       // Snapshot the run started from, when world_snapshot
+    size_t start_size;
+    unsigned char** snapshots;  // Snapshots read for load events, kept until the reader closes
+    int snapshot_count;
+    int snapshot_capacity;
+};
+
+static SessionSettings get_settings(const World* world) {
+    SessionSettings settings;
+    // Zeroed so padding compares equal
+    memset(&settings, 0, sizeof(settings));
+    settings.max_iterations = world->max_iterations;
+    settings.neighbor_skin = world->neighbor_skin;
+    settings.reorder_interval = world->reorder_interval;
+    settings.reorder_locality = world->reorder_locality;
+    settings.gravity = world->gravity;
+    settings.restitution = world->restitution;
+    settings.field = world->field;
+    settings.field_method = world->field_method;
+    settings.mesh_size = world->mesh_size;
+    settings.opening_angle = world->opening_angle;
+    settings.threads = world->threads;
+    settings.solver = world->solver;
+    settings.substeps = world->substeps;
+    settings.collision_mode = world->collision_mode;
+    return settings;
+}
+
+static void set_settings(World* world, const SessionSettings* settings) {
+    world->max_iterations = settings->max_iterations;
+    world->neighbor_skin = settings->neighbor_skin;
+    world->reorder_interval = settings->reorder_interval;
+    world->reorder_locality = settings->reorder_locality;
+    world->gravity = settings->gravity;
+    world->restitution = settings->restitution;
+    world->field = settings->field;
+    world->field_method = settings->field_method;
+    world->mesh_size = settings->mesh_size;
+    world->opening_angle = settings->opening_angle;
+    world->threads = settings->threads;
+    world->solver = settings->solver;
+    world->substeps = settings->substeps;
+    world->collision_mode = settings->collision_mode;
+}
+
+// Whole contents of the file at path, or NULL with size 0 if it can't be
+// read. A session stores what a missing snapshot would have loaded as empty.
+static unsigned char* read_file(const char* path, size_t* size) {
+    *size = 0;
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    unsigned char* data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) length = ftell(file);
+    if (length >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(length > 0 ? (size_t)length : 1);
+        if (fread(data, 1, (size_t)length, file) == (size_t)length) {
+            *size = (size_t)length;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+SessionRecorder* start_session(const char* path, unsigned seed, const char* world_path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open session %s for writing\n", path);
+        return NULL;
+    }
+
+    // A snapshot may be overwritten by a later F5, so the one the run started
+    // from is stored in the session rather than read again at replay time
+    bool worldSnapshot = world_path && !is_scene_file(world_path);
+    size_t snapshotSize = 0;
+    unsigned char* snapshot = worldSnapshot ? read_file(world_path, &snapshotSize) : NULL;
+    SessionHeader header = {
+        .version = SESSION_VERSION,
+        .seed = seed,
+        .path_length = world_path ? (uint32_t)strlen(world_path) : 0,
+        .world_snapshot = worldSnapshot,
+        .snapshot_size = snapshotSize
+    };
+    memcpy(header.magic, SESSION_MAGIC, sizeof(SESSION_MAGIC));
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(world_path ? world_path : "", 1, header.path_length, file) == header.path_length &&
+        fwrite(snapshot ? snapshot : (unsigned char*)"", 1, snapshotSize, file) == snapshotSize;
+    free(snapshot);
+    if (!written) {
+        fprintf(stderr, "Failed to write session %s\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    SessionRecorder* recorder = calloc(1, sizeof(SessionRecorder));
+    recorder->file = file;
+    recorder->snapshot_path = strdup(world_snapshot_path(world_path));
+    recorder->ok = true;
+    return recorder;
+}
+
+static void write_value(SessionRecorder* recorder, const void* data, size_t size) {
+    if (recorder->ok && fwrite(data, 1, size, recorder->file) != size) {
+        recorder->ok = false;
+    }
+}
+
+static void write_event(SessionRecorder* recorder, const SessionEvent* event) {
+    uint8_t type = (uint8_t)event->type;
+    write_value(recorder, &type, 1);
+    if (event->type == SESSION_STEP) {
+        write_value(recorder, &event->dt, sizeof(float));
+    } else if (event->type == SESSION_CLICK) {
+        uint8_t button = (uint8_t)event->button;
+        int32_t position[2] = { event->x, event->y };
+        write_value(recorder, &button, 1);
+        write_value(recorder, position, sizeof(position));
+    } else if (event->type == SESSION_SETTINGS) {
+        write_value(recorder, &event->settings, sizeof(SessionSettings));
+    } else if (event->type == SESSION_HASH) {
+        write_value(recorder, &event->hash, sizeof(uint64_t));
+    } else if (event->type == SESSION_LOAD) {
+        // The snapshot the load is about to restore, as it is on disk now
+        size_t size;
+        unsigned char* snapshot = read_file(recorder->snapshot_path, &size);
+        uint64_t length = size;
+        write_value(recorder, &length, sizeof(length));
+        write_value(recorder, snapshot, size);
+        free(snapshot);
+    }
+}
+
+void record_session(SessionRecorder* recorder, const World* world, const SessionEvent* event) {
+    SessionSettings settings = get_settings(world);
+    if (!recorder->has_settings || memcmp(&settings, &recorder->settings, sizeof(settings)) != 0) {
+        SessionEvent changed = { .type = SESSION_SETTINGS, .settings = settings };
+        write_event(recorder, &changed);
+        recorder->settings = settings;
+        recorder->has_settings = true;
+    }
+    write_event(recorder, event);
+}
+
+bool stop_session(SessionRecorder* recorder) {
+    bool ok = recorder->ok;
+    if (fclose(recorder->file) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Failed to write session\n");
+    free(recorder->snapshot_path);
+    free(recorder);
+    return ok;
+}
+
+SessionReader* open_session(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open session %s\n", path);
+        return NULL;
+    }
+    SessionHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, SESSION_MAGIC, sizeof(SESSION_MAGIC)) != 0 ||
+        header.version != SESSION_VERSION || header.path_length > MAX_WORLD_PATH ||
+        header.snapshot_size > MAX_SESSION_SNAPSHOT) {
+        fprintf(stderr, "%s is not a session from this build\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    char* worldPath = NULL;
+    if (header.path_length > 0) {
+        worldPath = malloc(header.path_length + 1);
+        if (fread(worldPath, 1, header.path_length, file) != header.path_length) {
+            fprintf(stderr, "Session %s is truncated\n", path);
+            free(worldPath);
+            fclose(file);
+            return NULL;
+        }
+        worldPath[header.path_length] = '\0';
+    }
+    unsigned char* start = NULL;
+    if (header.world_snapshot) {
+        start = malloc(header.snapshot_size > 0 ? (size_t)header.snapshot_size : 1);
+        if (fread(start, 1, (size_t)header.snapshot_size, file) != header.snapshot_size) {
+            fprintf(stderr, "Session %s is truncated\n", path);
+            free(start);
+            free(worldPath);
+            fclose(file);
+            return NULL;
+        }
+    }
+
+    SessionReader* reader = calloc(1, sizeof(SessionReader));
+    reader->file = file;
+    reader->seed = header.seed;
+    reader->world_path = worldPath;
+    reader->world_snapshot = header.world_snapshot;
+    reader->start = start;
+    reader->start_size = (size_t)header.snapshot_size;
+    return reader;
+}
+
+unsigned session_seed(const SessionReader* reader) {
+    return reader->seed;
+}
+
+const char* session_world_path(const SessionReader* reader) {
+    return reader->world_path;
+}
+
+bool read_session_event(SessionReader* reader, SessionEvent* event) {
+    uint8_t type;
+    if (fread(&type, 1, 1, reader->file) != 1) return false;
+    memset(event, 0, sizeof(*event));
+    event->type = (SessionEventType)type;
+    switch (type) {
+    case SESSION_STEP:
+        return fread(&event->dt, sizeof(float), 1, reader->file) == 1;
+    case SESSION_CLICK: {
+        uint8_t button;
+        int32_t position[2];
+        if (fread(&button, 1, 1, reader->file) != 1 ||
+            fread(position, sizeof(position), 1, reader->file) != 1) return false;
+        event->button = button;
+        event->x = position[0];
+        event->y = position[1];
+        return true;
+    }
+    case SESSION_SAVE:
+        return true;
+    case SESSION_LOAD: {
+        uint64_t length;
+        if (fread(&length, sizeof(length), 1, reader->file) != 1 || length > MAX_SESSION_SNAPSHOT) return false;
+        unsigned char* snapshot = malloc(length > 0 ? (size_t)length : 1);
+        if (fread(snapshot, 1, (size_t)length, reader->file) != length) {
+            free(snapshot);
+            return false;
+        }
+        if (reader->snapshot_count == reader->snapshot_capacity) {
+            reader->snapshot_capacity = reader->snapshot_capacity ? reader->snapshot_capacity * 2 : 8;
+            reader->snapshots = realloc(reader->snapshots, sizeof(unsigned char*) * reader->snapshot_capacity);
+        }
+        reader->snapshots[reader->snapshot_count++] = snapshot;
+        event->snapshot = snapshot;
+        event->snapshot_size = (size_t)length;
+        return true;
+    }
+    case SESSION_SETTINGS:
+        return fread(&event->settings, sizeof(SessionSettings), 1, reader->file) == 1;
+    case SESSION_HASH:
+        return fread(&event->hash, sizeof(uint64_t), 1, reader->file) == 1;
+    default:
+        return false;
+    }
+}
+
+void close_session(SessionReader* reader) {
+    fclose(reader->file);
+    free(reader->world_path);
+    free(reader->start);
+    for (int k = 0; k < reader->snapshot_count; k++) {
+        free(reader->snapshots[k]);
+    }
+    free(reader->snapshots);
+    free(reader);
+}
+
+const char* world_snapshot_path(const char* path) {
+    return path && !is_scene_file(path) ? path : SNAPSHOT_PATH;
+}
+
+static void spawn_initial_bodies(World* world) {
+    for (int i = 0; i < INITIAL_BODIES; i++) {
+        spawn_body(world, create_body(
+            random_float(50, WINDOW_WIDTH - 50),   // x
+            random_float(50, WINDOW_HEIGHT / 2),   // y
+            random_float(-200, 200),              // vx
+            random_float(-100, 100),              // vy
+            random_float(0.5f, 2.0f),             // mass
+            random_float(10, 30),                 // radius
+            random_color()                        // color
+        ));
+    }
+}
+
+void populate_world(World* world, const char* path) {
+    bool loaded = path &&
+        (is_scene_file(path) ? load_scene(world, path) : load_snapshot(world, path));
+    if (!loaded) spawn_initial_bodies(world);
+}
+
+void populate_session_world(World* world, const SessionReader* reader) {
+    if (!reader->world_snapshot) {
+        populate_world(world, reader->world_path);
+    } else if (!load_snapshot_data(world, reader->start, reader->start_size)) {
+        spawn_initial_bodies(world);
+    }
+}
+
+void apply_click(World* world, int button, int x, int y) {
+    Body* clickedBody = get_body_at_position(world, x, y);
+    if (button == SDL_BUTTON_LEFT && clickedBody) {
+        // Apply impulse in the direction of the normal at the closest edge point
+        float edgeX, edgeY, normalX, normalY;
+        get_closest_edge_info(clickedBody, x, y, &edgeX, &edgeY, &normalX, &normalY);
+        apply_impulse(clickedBody, normalX * IMPULSE_STRENGTH, normalY * IMPULSE_STRENGTH);
+    } else if (button == SDL_BUTTON_MIDDLE && clickedBody) {
+        set_body_type(world, clickedBody,
+            clickedBody->type == BODY_STATIC ? BODY_DYNAMIC : BODY_STATIC);
+    } else if (button == SDL_BUTTON_RIGHT) {
+        if (clickedBody) {
+            despawn_body(world, body_handle(world, (int)(clickedBody - world->bodies)));
+        } else {
+            spawn_body(world, create_body(
+                x, y, 0, 0,
+                random_float(0.5f, 2.0f),
+                random_float(10, 30),
+                random_color()
+            ));
+        }
+    }
+}
+
+void apply_session_event(World* world, const SessionEvent* event, const char* snapshot_path) {
+    switch (event->type) {
+    case SESSION_CLICK:
+        apply_click(world, event->button, event->x, event->y);
+        break;
+    case SESSION_SAVE:
+        if (snapshot_path) save_snapshot(world, snapshot_path);
+        break;
+    case SESSION_LOAD:
+        if (snapshot_path) {
+            load_snapshot(world, snapshot_path);
+        } else {
+            load_snapshot_data(world, event->snapshot, event->snapshot_size);
+        }
+        break;
+    case SESSION_SETTINGS:
+        set_settings(world, &event->settings);
+        break;
+    case SESSION_STEP:
+    case SESSION_HASH:
+        break;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "../core/types.h"
+
+// A recorded session holds everything that decided how a run went: the
+// random seed, the scene or snapshot it started from, then every step's dt
+// and every input in the order they were applied. Replaying those onto a
+// world set up the same way repeats the run step for step. The snapshot a
+// run starts from and the one each load restores are stored in the session,
+// so a replay never reads or writes snapshot files. Scenes are read from
+// disk at replay time. Settings and snapshots are stored with this build's
+// layouts, so a session only replays in a build with the same ones.
+typedef struct SessionRecorder SessionRecorder;
+typedef struct SessionReader SessionReader;
+
+// Start recording to path for a run seeded with seed that starts from
+// world_path, or NULL for random bodies. Returns NULL if the file can't be
+// created.
+SessionRecorder* start_session(const char* path, unsigned seed, const char* world_path);
+
+// Append event, preceded by the world's settings if the debug window has
+// changed them since the last event. Record each input as it is applied,
+// each step just before update_physics and the state hash it reached just
+// after, so a replay can tell at which step it first diverged.
+void record_session(SessionRecorder* recorder, const World* world, const SessionEvent* event);
+
+// Close the file. Returns false if any write failed.
+bool stop_session(SessionRecorder* recorder);
+
+// Open a recorded session for reading, or return NULL if it isn't one
+SessionReader* open_session(const char* path);
+
+// Seed the run was recorded with
+unsigned session_seed(const SessionReader* reader);
+
+// Scene or snapshot the run started from, NULL for random bodies
+const char* session_world_path(const SessionReader* reader);
+
+// Read the next event. Returns false at the end of the file or on a
+// damaged event.
+bool read_session_event(SessionReader* reader, SessionEvent* event);
+
+// Close a session opened for reading
+void close_session(SessionReader* reader);
+
+// Where F5 and F9 save and restore snapshots for a world started from path:
+// the snapshot itself if path is one, otherwise SNAPSHOT_PATH
+const char* world_snapshot_path(const char* path);
+
+// Load the scene or snapshot at path into world, or spawn INITIAL_BODIES
+// random bodies if path is NULL or fails to load
+void populate_world(World* world, const char* path);
+
+// Populate world as the recorded run started: from its scene, the snapshot
+// stored in the session, or random bodies
+void populate_session_world(World* world, const SessionReader* reader);
+
+// Left click pushes the clicked body away from the click, middle click pins
+// it in place or releases it, and right click removes it or spawns a body in
+// empty space
+void apply_click(World* world, int button, int x, int y);
+
+// Apply an input other than a step to world, saving and restoring snapshots
+// at snapshot_path. A replay passes NULL: saves are skipped and loads
+// restore the snapshot stored with the event.
+void apply_session_event(World* world, const SessionEvent* event, const char* snapshot_path);
+
+#endif // SESSION_H
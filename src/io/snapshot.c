@@ -0,0 +1,417 @@
+#include "snapshot.h"
+#include "../physics/body_pool.h"
+#include "../physics/physics.h"
+#include "../physics/reorder.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "PHYSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_ENDIAN 0x01020304u
+// Sections start on a boundary at least as coarse as any page size in use,
+// so the bodies can be mapped straight from their offset
+#define SNAPSHOT_ALIGNMENT 65536
+#define SNAPSHOT_TEMP_SUFFIX ".tmp"
+
+// Fixed-width header at the start of a snapshot. The sections it points to
+// hold raw Body, slot table and Contact arrays, so a snapshot only loads in
+// a build with the same layouts, which body_size and contact_size check.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;            // SNAPSHOT_ENDIAN as the writer stored it
+    uint32_t header_size;
+    uint32_t body_size;
+    uint32_t contact_size;
+    uint32_t body_count;
+    uint32_t capacity;          // Slots, and bodies the bodies section has room for
+    int32_t free_slot;
+    uint32_t next_id;
+    uint32_t contact_count;
+    uint64_t bodies_offset;     // Room for capacity bodies; the tail past body_count is a hole
+    uint64_t index_offset;
+    uint64_t ids_offset;
+    uint64_t contacts_offset;
+    uint64_t file_size;
+
+    // Solver settings and state carried across a restart
+    int32_t field;
+    int32_t field_method;
+    int32_t solver;
+    int32_t collision_mode;
+    int32_t position_correction;
+    int32_t mesh_size;
+    int32_t substeps;
+    int32_t min_iterations;
+    int32_t max_iterations;
+    int32_t reorder_interval;
+    int32_t reorder_steps;
+    int32_t reorders;
+    int32_t island_next_id;
+    float field_constant;
+    float opening_angle;
+    float penetration_tolerance;
+    float velocity_tolerance;
+    float sleep_energy_threshold;
+    float time_to_sleep;
+    float neighbor_skin;
+    float reorder_locality;
+    float reorder_base_gap;
+    float width;
+    float height;
+    float gravity;
+    float restitution;
+    double event_clock;
+} SnapshotHeader;
+
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+// Write size bytes at offset, leaving any gap before it as a hole
+static bool write_section(FILE* file, uint64_t offset, const void* data, size_t size) {
+    if (size == 0) return true;
+    if (fseeko(file, (off_t)offset, SEEK_SET) != 0) return false;
+    return fwrite(data, 1, size, file) == size;
+}
+
+// Whether a contact names bodies below count, or a wall, whose ids match its
+// keys. Contacts found before bodies were despawned can name the wrong ones.
+static bool contact_names_bodies(const Contact* contact, const Body* bodies, int count) {
+    if (contact->a < 0 || contact->a >= count || contact->b >= count || contact->b == contact->a) return false;
+    if (contact->b < -WALL_COUNT) return false;
+    unsigned key_a = bodies[contact->a].id;
+    unsigned key_b = contact->b >= 0 ? bodies[contact->b].id : (unsigned)contact->b;
+    return contact->key_a == (key_a < key_b ? key_a : key_b) && contact->key_b == (key_a < key_b ? key_b : key_a);
+}
+
+bool save_snapshot(const World* world, const char* path) {
+    const BodyPool* pool = &world->body_pool;
+
+    // Keep only the contacts a load will accept
+    Contact* contacts = malloc(sizeof(Contact) * (world->contacts.count + 1));
+    int contactCount = 0;
+    for (int k = 0; k < world->contacts.count; k++) {
+        if (contact_names_bodies(&world->contacts.contacts[k], world->bodies, world->bodyCount)) {
+            contacts[contactCount++] = world->contacts.contacts[k];
+        }
+    }
+
+    SnapshotHeader header = {
+        .version = SNAPSHOT_VERSION,
+        .endian = SNAPSHOT_ENDIAN,
+        .header_size = sizeof(SnapshotHeader),
+        .body_size = sizeof(Body),
+        .contact_size = sizeof(Contact),
+        .body_count = (uint32_t)world->bodyCount,
+        .capacity = (uint32_t)pool->capacity,
+        .free_slot = world->bodyCount < pool->capacity ? pool->free_slot : -1,
+        .next_id = pool->next_id,
+        .contact_count = (uint32_t)contactCount,
+        .field = world->field,
+        .field_method = world->field_method,
+        .solver = world->solver,
+        .collision_mode = world->collision_mode,
+        .position_correction = world->position_correction,
+        .mesh_size = world->mesh_size,
+        .substeps = world->substeps,
+        .min_iterations = world->min_iterations,
+        .max_iterations = world->max_iterations,
+        .reorder_interval = world->reorder_interval,
+        .reorder_steps = world->body_order.steps,
+        .reorders = world->body_order.reorders,
+        .island_next_id = world->islands.next_id,
+        .field_constant = world->field_constant,
+        .opening_angle = world->opening_angle,
+        .penetration_tolerance = world->penetration_tolerance,
+        .velocity_tolerance = world->velocity_tolerance,
+        .sleep_energy_threshold = world->sleep_energy_threshold,
+        .time_to_sleep = world->time_to_sleep,
+        .neighbor_skin = world->neighbor_skin,
+        .reorder_locality = world->reorder_locality,
+        .reorder_base_gap = world->body_order.base_gap,
+        .width = world->width,
+        .height = world->height,
+        .gravity = world->gravity,
+        .restitution = world->restitution,
+        .event_clock = world->events.clock
+    };
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+
+    // Bodies come first so the hole after them is inside the file and their
+    // mapping can be written up to capacity without running past its end
+    header.bodies_offset = align_offset(sizeof(SnapshotHeader));
+    header.index_offset = align_offset(header.bodies_offset + (uint64_t)pool->capacity * sizeof(Body));
+    header.ids_offset = header.index_offset + (uint64_t)pool->capacity * sizeof(int);
+    header.contacts_offset = header.ids_offset + (uint64_t)pool->capacity * sizeof(unsigned);
+    header.file_size = header.contacts_offset + (uint64_t)contactCount * sizeof(Contact);
+
+    // Written beside the snapshot and renamed over it, since the world's
+    // bodies may be mapped from the snapshot being replaced. The mapping
+    // keeps the old file alive until it is released.
+    size_t pathLength = strlen(path);
+    char* tempPath = malloc(pathLength + sizeof(SNAPSHOT_TEMP_SUFFIX));
+    memcpy(tempPath, path, pathLength);
+    memcpy(tempPath + pathLength, SNAPSHOT_TEMP_SUFFIX, sizeof(SNAPSHOT_TEMP_SUFFIX));
+    FILE* file = fopen(tempPath, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open snapshot %s for writing\n", tempPath);
+        free(tempPath);
+        free(contacts);
+        return false;
+    }
+    bool written =
+        write_section(file, 0, &header, sizeof(header)) &&
+        write_section(file, header.bodies_offset, world->bodies, sizeof(Body) * world->bodyCount) &&
+        write_section(file, header.index_offset, pool->index, sizeof(int) * pool->capacity) &&
+        write_section(file, header.ids_offset, pool->ids, sizeof(unsigned) * pool->capacity) &&
+        write_section(file, header.contacts_offset, contacts, sizeof(Contact) * contactCount);
+
+    // Empty trailing sections would otherwise leave the file short of its size
+    written = written && fflush(file) == 0 && ftruncate(fileno(file), (off_t)header.file_size) == 0;
+    if (fclose(file) != 0) written = false;
+    written = written && rename(tempPath, path) == 0;
+    if (!written) {
+        fprintf(stderr, "Failed to write snapshot %s\n", path);
+        remove(tempPath);
+    }
+    free(tempPath);
+    free(contacts);
+    return written;
+}
+
+// Check that a header was written by this build and that its sections fit
+static bool header_matches(const SnapshotHeader* header, uint64_t fileSize) {
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) return false;
+    if (header->version != SNAPSHOT_VERSION || header->endian != SNAPSHOT_ENDIAN) return false;
+    if (header->header_size != sizeof(SnapshotHeader)) return false;
+    if (header->body_size != sizeof(Body) || header->contact_size != sizeof(Contact)) return false;
+    if (header->body_count > header->capacity || header->capacity > INT32_MAX) return false;
+    if (header->bodies_offset % SNAPSHOT_ALIGNMENT != 0) return false;
+    return header->file_size <= fileSize;
+}
+
+// Check that the settings a header restores are ones the engine could have
+// saved, since enums and sizes index arrays and size allocations
+static bool settings_in_range(const SnapshotHeader* header) {
+    return header->field >= 0 && header->field <= FIELD_NONE &&
+        header->field_method >= 0 && header->field_method <= FIELD_PARTICLE_MESH &&
+        header->solver >= 0 && header->solver <= SOLVER_EVENT &&
+        header->collision_mode >= 0 && header->collision_mode <= COLLISION_SPECULATIVE &&
+        header->position_correction >= 0 && header->position_correction <= CORRECTION_SPLIT_IMPULSE &&
+        header->mesh_size > 1 && header->mesh_size <= PARTICLE_MESH_MAX_SIZE &&
+        (header->mesh_size & (header->mesh_size - 1)) == 0 &&
+        header->substeps > 0 && header->min_iterations >= 0 && header->max_iterations >= 0 &&
+        isfinite(header->width) && isfinite(header->height) && header->width > 0 && header->height > 0 &&
+        isfinite(header->gravity) && isfinite(header->field_constant) &&
+        isfinite(header->restitution) && header->restitution >= 0;
+}
+
+// Check that the bodies, slot table and contacts read from a snapshot agree
+// with each other before any of them is trusted as an index: every body owns
+// the slot it names, the free chain runs through exactly the other slots, and
+// contacts name the bodies or wall their keys do
+static bool contents_consistent(const SnapshotHeader* header, const Body* bodies, const int* index,
+                                const unsigned* ids, const Contact* contacts) {
+    int count = (int)header->body_count;
+    int capacity = (int)header->capacity;
+    for (int i = 0; i < count; i++) {
+        const Body* body = &bodies[i];
+        if (!valid_body(body) || (unsigned)body->type > BODY_STATIC) return false;
+        if (body->slot < 0 || body->slot >= capacity || body->id == 0) return false;
+        if (index[body->slot] != i || ids[body->slot] != body->id) return false;
+    }
+
+    // Bodies own count distinct slots, so a chain of capacity - count free
+    // slots ending at -1 holds every other slot once
+    int slot = header->free_slot;
+    for (int k = count; k < capacity; k++) {
+        if (slot < 0 || slot >= capacity || ids[slot] != 0) return false;
+        slot = index[slot];
+    }
+    if (slot != -1) return false;
+
+    for (uint32_t k = 0; k < header->contact_count; k++) {
+        if (!contact_names_bodies(&contacts[k], bodies, count)) return false;
+    }
+    return true;
+}
+
+// Replace the world's bodies and solver state with a snapshot's, taking
+// ownership of the arrays read from it. bodies is the mapping, if mapped.
+static void install_snapshot(World* world, const SnapshotHeader* header, Body* bodies, void* mapping,
+                             size_t mappingSize, int* index, unsigned* ids, Contact* contacts) {
+    // Sorting scratch sized for the old pool doesn't fit the new one
+    free_body_order(&world->body_order);
+    free_bodies(world);
+    world->bodies = bodies;
+    world->bodyCount = (int)header->body_count;
+    world->body_pool = (BodyPool){
+        .index = index,
+        .ids = ids,
+        .capacity = (int)header->capacity,
+        .free_slot = header->free_slot,
+        .next_id = header->next_id,
+        .mapping = mapping,
+        .mapping_size = mappingSize
+    };
+
+    // Restored contacts become the previous step's, so the next step warm starts
+    ContactCache* cache = &world->contacts;
+    free(cache->contacts);
+    cache->contacts = contacts;
+    cache->count = (int)header->contact_count;
+    cache->capacity = (int)header->contact_count + 1;
+
+    world->field = header->field;
+    world->field_method = header->field_method;
+    world->solver = header->solver;
+    world->collision_mode = header->collision_mode;
+    world->position_correction = header->position_correction;
+    world->mesh_size = header->mesh_size;
+    world->substeps = header->substeps;
+    world->min_iterations = header->min_iterations;
+    world->max_iterations = header->max_iterations;
+    world->reorder_interval = header->reorder_interval;
+    world->body_order.steps = header->reorder_steps;
+    world->body_order.reorders = header->reorders;
+    world->body_order.base_gap = header->reorder_base_gap;
+    world->islands.next_id = header->island_next_id;
+    world->field_constant = header->field_constant;
+    world->opening_angle = header->opening_angle;
+    world->penetration_tolerance = header->penetration_tolerance;
+    world->velocity_tolerance = header->velocity_tolerance;
+    world->sleep_energy_threshold = header->sleep_energy_threshold;
+    world->time_to_sleep = header->time_to_sleep;
+    world->neighbor_skin = header->neighbor_skin;
+    world->reorder_locality = header->reorder_locality;
+    world->width = header->width;
+    world->height = header->height;
+    world->gravity = header->gravity;
+    world->restitution = header->restitution;
+    world->events.clock = header->event_clock;
+
+    invalidate_body_indices(world);
+}
+
+bool load_snapshot(World* world, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open snapshot %s\n", path);
+        return false;
+    }
+
+    SnapshotHeader header;
+    struct stat info;
+    if (fstat(fd, &info) != 0 ||
+        pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        !header_matches(&header, (uint64_t)info.st_size)) {
+        fprintf(stderr, "Snapshot %s is unreadable or from an incompatible build\n", path);
+        close(fd);
+        return false;
+    }
+    if (!settings_in_range(&header)) {
+        fprintf(stderr, "Snapshot %s holds values out of range\n", path);
+        close(fd);
+        return false;
+    }
+
+    // Map the bodies privately: writes stay in memory and never reach the file
+    int capacity = (int)header.capacity;
+    size_t mappingSize = (size_t)capacity * sizeof(Body);
+    void* mapping = NULL;
+    if (mappingSize > 0) {
+        mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)header.bodies_offset);
+        if (mapping == MAP_FAILED) {
+            fprintf(stderr, "Failed to map snapshot %s\n", path);
+            close(fd);
+            return false;
+        }
+    }
+
+    // The slot table and contacts are small next to the bodies and must be
+    // resizable, so they are read onto the heap
+    int* index = malloc(sizeof(int) * capacity);
+    unsigned* ids = malloc(sizeof(unsigned) * capacity);
+    Contact* contacts = malloc(sizeof(Contact) * (header.contact_count + 1));
+    size_t indexSize = sizeof(int) * capacity;
+    size_t idsSize = sizeof(unsigned) * capacity;
+    size_t contactsSize = sizeof(Contact) * header.contact_count;
+    bool read =
+        pread(fd, index, indexSize, (off_t)header.index_offset) == (ssize_t)indexSize &&
+        pread(fd, ids, idsSize, (off_t)header.ids_offset) == (ssize_t)idsSize &&
+        pread(fd, contacts, contactsSize, (off_t)header.contacts_offset) == (ssize_t)contactsSize;
+    close(fd);
+    if (read && !contents_consistent(&header, mapping, index, ids, contacts)) {
+        fprintf(stderr, "Snapshot %s holds values out of range\n", path);
+        read = false;
+    } else if (!read) {
+        fprintf(stderr, "Failed to read snapshot %s\n", path);
+    }
+    if (!read) {
+        if (mapping) munmap(mapping, mappingSize);
+        free(index);
+        free(ids);
+        free(contacts);
+        return false;
+    }
+
+    install_snapshot(world, &header, mapping, mapping, mappingSize, index, ids, contacts);
+    return true;
+}
+
+static bool section_fits(uint64_t offset, uint64_t bytes, size_t size) {
+    return offset <= size && bytes <= size - offset;
+}
+
+bool load_snapshot_data(World* world, const void* data, size_t size) {
+    SnapshotHeader header;
+    bool valid = size >= sizeof(header);
+    if (valid) {
+        memcpy(&header, data, sizeof(header));
+        valid = header_matches(&header, size);
+    }
+    // Unlike a file, a buffer can't be read past its end to fill a section
+    size_t capacity = valid ? header.capacity : 0;
+    valid = valid &&
+        section_fits(header.bodies_offset, (uint64_t)header.body_count * sizeof(Body), size) &&
+        section_fits(header.index_offset, (uint64_t)capacity * sizeof(int), size) &&
+        section_fits(header.ids_offset, (uint64_t)capacity * sizeof(unsigned), size) &&
+        section_fits(header.contacts_offset, (uint64_t)header.contact_count * sizeof(Contact), size);
+    if (!valid) {
+        fprintf(stderr, "Snapshot data is unreadable or from an incompatible build\n");
+        return false;
+    }
+    if (!settings_in_range(&header)) {
+        fprintf(stderr, "Snapshot data holds values out of range\n");
+        return false;
+    }
+
+    const unsigned char* bytes = data;
+    // Zeroed past the bodies, like the hole a mapped snapshot has there
+    Body* bodies = calloc(capacity > 0 ? capacity : 1, sizeof(Body));
+    int* index = malloc(sizeof(int) * (capacity > 0 ? capacity : 1));
+    unsigned* ids = malloc(sizeof(unsigned) * (capacity > 0 ? capacity : 1));
+    Contact* contacts = malloc(sizeof(Contact) * (header.contact_count + 1));
+    memcpy(bodies, bytes + header.bodies_offset, sizeof(Body) * header.body_count);
+    memcpy(index, bytes + header.index_offset, sizeof(int) * capacity);
+    memcpy(ids, bytes + header.ids_offset, sizeof(unsigned) * capacity);
+    memcpy(contacts, bytes + header.contacts_offset, sizeof(Contact) * header.contact_count);
+    if (!contents_consistent(&header, bodies, index, ids, contacts)) {
+        fprintf(stderr, "Snapshot data holds values out of range\n");
+        free(bodies);
+        free(index);
+        free(ids);
+        free(contacts);
+        return false;
+    }
+    install_snapshot(world, &header, bodies, NULL, 0, index, ids, contacts);
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "../core/types.h"
+
+// Write the world's bodies, body pool and solver state to path, by way of
+// a temporary file renamed over it, so a world restored from path can save
+// back to it. Returns false if the file can't be written.
+bool save_snapshot(const World* world, const char* path);
+
+// Replace the world's bodies and solver state with a snapshot's. The bodies
+// are mapped from the file copy-on-write rather than read, so restoring costs
+// little until they are touched. Returns false, leaving the world as it was,
+// if the file can't be read, was written by an incompatible build or holds
+// settings, slots or contacts out of range.
+bool load_snapshot(World* world, const char* path);
+
+// Restore a snapshot held in memory, as a file's bytes, copying the bodies
+// rather than mapping them. Returns false, leaving the world as it was, if
+// data isn't a whole snapshot from this build or fails the same range checks.
+bool load_snapshot_data(World* world, const void* data, size_t size);
+
+#endif // SNAPSHOT_H
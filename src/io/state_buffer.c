@@ -0,0 +1,102 @@
+#include "state_buffer.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct StateReader {
+    char* name;
+    SharedStateHeader* header;
+    size_t size;
+};
+
+// Map the segment currently published under the reader's name
+static bool map_segment(StateReader* reader) {
+    int fd = shm_open(reader->name, O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(SharedStateHeader)) {
+        mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    const SharedStateHeader* header = mapping;
+    size_t size = (size_t)info.st_size;
+    bool valid = memcmp(header->magic, STATE_BUFFER_MAGIC, sizeof(STATE_BUFFER_MAGIC)) == 0 &&
+        header->version == STATE_BUFFER_VERSION &&
+        header->body_size == sizeof(SharedBody) &&
+        header->frame_count > 0 &&
+        header->frame_stride >= sizeof(SharedFrame) + (uint64_t)header->capacity * sizeof(SharedBody) &&
+        sizeof(SharedStateHeader) + header->frame_count * header->frame_stride <= size;
+    if (!valid) {
+        munmap(mapping, size);
+        return false;
+    }
+
+    reader->header = mapping;
+    reader->size = size;
+    return true;
+}
+
+StateReader* open_state_reader(const char* name) {
+    StateReader* reader = calloc(1, sizeof(StateReader));
+    reader->name = strdup(name);
+    if (!map_segment(reader)) {
+        free(reader->name);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+static SharedFrame* frame_at(const SharedStateHeader* header, uint64_t step) {
+    char* frames = (char*)(header + 1);
+    return (SharedFrame*)(frames + step % header->frame_count * header->frame_stride);
+}
+
+bool begin_shared_frame(StateReader* reader, SharedFrameView* view) {
+    // Follow the writer to its new buffer once it has outgrown this one
+    if (atomic_load_explicit(&reader->header->retired, memory_order_acquire)) {
+        SharedStateHeader* old = reader->header;
+        size_t oldSize = reader->size;
+        if (!map_segment(reader)) return false;
+        munmap(old, oldSize);
+    }
+
+    const SharedStateHeader* header = reader->header;
+    uint64_t latest = atomic_load_explicit(&header->latest, memory_order_acquire);
+    if (latest == 0) return false;
+
+    const SharedFrame* frame = frame_at(header, latest - 1);
+    uint64_t seq = atomic_load_explicit(&frame->seq, memory_order_acquire);
+    if (seq & 1) return false;
+
+    int count = frame->count;
+    *view = (SharedFrameView){
+        .step = frame->step,
+        .dt = frame->dt,
+        .count = count < 0 ? 0 : count > (int)header->capacity ? (int)header->capacity : count,
+        .bodies = (const SharedBody*)(frame + 1),
+        .width = frame->width,
+        .height = frame->height,
+        .frame = frame,
+        .seq = seq
+    };
+    return true;
+}
+
+bool end_shared_frame(const SharedFrameView* view) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&view->frame->seq, memory_order_relaxed) == view->seq;
+}
+
+void close_state_reader(StateReader* reader) {
+    munmap(reader->header, reader->size);
+    free(reader->name);
+    free(reader);
+}
@@ -0,0 +1,80 @@
+#ifndef STATE_BUFFER_H
+#define STATE_BUFFER_H
+
+// Layout of the shared-memory ring the engine publishes each step's body
+// state into, and the reader side of it. This header stands alone, without
+// SDL or the engine's types, so external tools can include it.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STATE_BUFFER_MAGIC "PHYSHM"
+#define STATE_BUFFER_VERSION 1
+#define STATE_BUFFER_NAME "/physics-state" // Shared-memory object the engine publishes under
+#define STATE_BUFFER_FRAMES 4           // Steps kept, so a slow reader has this many steps to finish a frame
+#define STATE_BUFFER_ALIGNMENT 64       // Frames start on cache line boundaries
+
+// Body as published: what a viewer needs to draw and inspect it
+typedef struct {
+    float x, y;
+    float vx, vy;
+    float radius;
+    float mass;
+    uint32_t id;
+    uint8_t r, g, b;
+    uint8_t type;                       // BodyType
+} SharedBody;
+
+// One step's frame. seq is odd while the writer is filling the frame; a
+// reader's copy is consistent if seq was even and unchanged around it.
+typedef struct {
+    _Atomic uint64_t seq;
+    uint64_t step;                      // Steps published before this one
+    float dt;
+    int32_t count;
+    float width;                        // Walled domain of the world
+    float height;
+    uint8_t padding[32];                // Keeps the bodies on their own cache lines
+} SharedFrame;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t frame_count;
+    uint32_t capacity;                  // Bodies each frame has room for
+    uint32_t body_size;
+    uint64_t frame_stride;              // Bytes from one frame to the next
+    _Atomic uint64_t latest;            // Step + 1 of the newest complete frame, 0 before the first
+    _Atomic uint32_t retired;           // Set once the writer has moved to a larger buffer under the same name
+} SharedStateHeader;
+
+typedef struct StateReader StateReader;
+
+// A frame being read in place, between begin_shared_frame and end_shared_frame
+typedef struct {
+    uint64_t step;
+    float dt;
+    int count;
+    const SharedBody* bodies;
+    float width;
+    float height;
+    const SharedFrame* frame;
+    uint64_t seq;
+} SharedFrameView;
+
+// Map the state buffer published under name, or return NULL if there is none
+StateReader* open_state_reader(const char* name);
+
+// Start reading the newest complete frame in place. Returns false if none has
+// been published yet or the writer is replacing it.
+bool begin_shared_frame(StateReader* reader, SharedFrameView* view);
+
+// Whether the writer left the frame alone while it was read. If not, what was
+// read from it may be torn and must be discarded.
+bool end_shared_frame(const SharedFrameView* view);
+
+// Unmap the buffer
+void close_state_reader(StateReader* reader);
+
+#endif // STATE_BUFFER_H
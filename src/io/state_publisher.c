@@ -0,0 +1,117 @@
+#include "state_publisher.h"
+#include "state_buffer.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct StatePublisher {
+    char* name;
+    SharedStateHeader* header;
+    size_t size;
+    uint64_t steps;             // Frames published, across every buffer
+};
+
+// Replace whatever is published under the publisher's name with a new
+// buffer for capacity bodies, retiring the old one once the new one exists
+static bool create_buffer(StatePublisher* publisher, int capacity) {
+    uint64_t stride = sizeof(SharedFrame) + (uint64_t)capacity * sizeof(SharedBody);
+    stride = (stride + STATE_BUFFER_ALIGNMENT - 1) / STATE_BUFFER_ALIGNMENT * STATE_BUFFER_ALIGNMENT;
+    size_t size = sizeof(SharedStateHeader) + STATE_BUFFER_FRAMES * stride;
+
+    // Some systems only size a shared-memory object once, so a larger buffer
+    // is a new object rather than the old one grown
+    shm_unlink(publisher->name);
+    int fd = shm_open(publisher->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create shared state %s\n", publisher->name);
+        return false;
+    }
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Failed to map shared state %s\n", publisher->name);
+        shm_unlink(publisher->name);
+        return false;
+    }
+
+    // A new object reads as zeros, so every frame starts with an even seq
+    SharedStateHeader* header = mapping;
+    memcpy(header->magic, STATE_BUFFER_MAGIC, sizeof(STATE_BUFFER_MAGIC));
+    header->version = STATE_BUFFER_VERSION;
+    header->frame_count = STATE_BUFFER_FRAMES;
+    header->capacity = (uint32_t)capacity;
+    header->body_size = sizeof(SharedBody);
+    header->frame_stride = stride;
+
+    if (publisher->header) {
+        atomic_store_explicit(&publisher->header->retired, 1, memory_order_release);
+        munmap(publisher->header, publisher->size);
+    }
+    publisher->header = header;
+    publisher->size = size;
+    return true;
+}
+
+StatePublisher* start_publishing(const char* name, int capacity) {
+    StatePublisher* publisher = calloc(1, sizeof(StatePublisher));
+    publisher->name = strdup(name);
+    if (!create_buffer(publisher, capacity > 0 ? capacity : 1)) {
+        free(publisher->name);
+        free(publisher);
+        return NULL;
+    }
+    return publisher;
+}
+
+void publish_state(StatePublisher* publisher, const World* world, float dt) {
+    if (world->bodyCount > (int)publisher->header->capacity &&
+        !create_buffer(publisher, world->body_pool.capacity)) {
+        return;
+    }
+
+    SharedStateHeader* header = publisher->header;
+    uint64_t step = publisher->steps++;
+    char* frames = (char*)(header + 1);
+    SharedFrame* frame = (SharedFrame*)(frames + step % header->frame_count * header->frame_stride);
+
+    // Mark the frame as being written before touching its contents
+    uint64_t seq = atomic_load_explicit(&frame->seq, memory_order_relaxed);
+    atomic_store_explicit(&frame->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    frame->step = step;
+    frame->dt = dt;
+    frame->count = world->bodyCount;
+    frame->width = world->width;
+    frame->height = world->height;
+    SharedBody* bodies = (SharedBody*)(frame + 1);
+    for (int i = 0; i < world->bodyCount; i++) {
+        const Body* body = &world->bodies[i];
+        bodies[i] = (SharedBody){
+            .x = body->x, .y = body->y,
+            .vx = body->vx, .vy = body->vy,
+            .radius = body->radius,
+            .mass = body->mass,
+            .id = body->id,
+            .r = body->color.r, .g = body->color.g, .b = body->color.b,
+            .type = (uint8_t)body->type
+        };
+    }
+
+    atomic_store_explicit(&frame->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&header->latest, step + 1, memory_order_release);
+}
+
+void stop_publishing(StatePublisher* publisher) {
+    atomic_store_explicit(&publisher->header->retired, 1, memory_order_release);
+    munmap(publisher->header, publisher->size);
+    shm_unlink(publisher->name);
+    free(publisher->name);
+    free(publisher);
+}
@@ -0,0 +1,18 @@
+#ifndef STATE_PUBLISHER_H
+#define STATE_PUBLISHER_H
+
+#include "../core/types.h"
+
+// Create the shared state buffer under name, with room for capacity bodies
+// per frame. Returns NULL if the shared-memory object can't be created.
+StatePublisher* start_publishing(const char* name, int capacity);
+
+// Write the world's bodies into the oldest frame of the ring and make it the
+// newest. Readers are never waited on. A world that has outgrown the buffer
+// moves to a larger one under the same name, which readers follow.
+void publish_state(StatePublisher* publisher, const World* world, float dt);
+
+// Remove the buffer; readers keep their mapping until they close it
+void stop_publishing(StatePublisher* publisher);
+
+#endif // STATE_PUBLISHER_H
@@ -0,0 +1,427 @@
+#include "trajectory.h"
+#include "../utils/encoding.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRAJECTORY_MAGIC "PHYSTRJ"
+#define TRAJECTORY_VERSION 1
+#define FRAME_KEYFRAME 1
+
+// Columns of a frame in file order: slot gaps, ids, then the quantized state
+enum { COLUMN_SLOT, COLUMN_ID, COLUMN_X, COLUMN_Y, COLUMN_VX, COLUMN_VY, COLUMN_COUNT };
+#define VALUE_COLUMNS 4
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    float position_quantum;
+    float velocity_quantum;
+} TrajectoryHeader;
+
+// Body state copied out of the world for the writer to encode
+typedef struct {
+    long step;
+    float dt;
+    int count;
+    int capacity;
+    int* slots;
+    unsigned* ids;
+    float* values[VALUE_COLUMNS];   // x, y, vx, vy
+} QueuedFrame;
+
+// Per-slot reference the next frame is coded against: the body that last
+// held the slot and its quantized state. Encoder and decoder keep the same.
+typedef struct {
+    unsigned* ids;
+    int32_t* values[VALUE_COLUMNS];
+    int capacity;
+} SlotHistory;
+
+struct TrajectoryRecorder {
+    FILE* file;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;           // Signalled when a frame is queued or recording stops
+    QueuedFrame queue[TRAJECTORY_QUEUE_FRAMES];
+    int head;                       // Next frame the writer takes
+    int queued;                     // Frames waiting for the writer
+    bool stopping;
+    long steps;                     // Frames offered, including dropped ones
+    long dropped;
+    float quanta[VALUE_COLUMNS];
+
+    // Writer thread only
+    SlotHistory history;
+    int* record_of_slot;            // Record in the current frame at each slot, -1 when none
+    ByteBuffer columns[COLUMN_COUNT];
+    long frames_written;
+    bool failed;
+};
+
+struct TrajectoryReader {
+    FILE* file;
+    float quanta[VALUE_COLUMNS];
+    SlotHistory history;
+    ByteBuffer column;
+    uint32_t* raw;                  // Varints of the column being decoded
+    int* slots;
+    bool* same;                     // Whether each record continues the slot's last body
+    int capacity;
+};
+
+// Grow a slot history to cover slot, starting new slots with no body
+static void reserve_history(SlotHistory* history, int slot) {
+    if (slot < history->capacity) return;
+    int capacity = history->capacity ? history->capacity : 256;
+    while (capacity <= slot) capacity *= 2;
+    history->ids = realloc(history->ids, sizeof(unsigned) * capacity);
+    memset(history->ids + history->capacity, 0, sizeof(unsigned) * (capacity - history->capacity));
+    for (int c = 0; c < VALUE_COLUMNS; c++) {
+        history->values[c] = realloc(history->values[c], sizeof(int32_t) * capacity);
+    }
+    history->capacity = capacity;
+}
+
+static void free_history(SlotHistory* history) {
+    free(history->ids);
+    for (int c = 0; c < VALUE_COLUMNS; c++) {
+        free(history->values[c]);
+    }
+}
+
+static void reserve_queued(QueuedFrame* frame, int count) {
+    if (count <= frame->capacity) return;
+    frame->slots = realloc(frame->slots, sizeof(int) * count);
+    frame->ids = realloc(frame->ids, sizeof(unsigned) * count);
+    for (int c = 0; c < VALUE_COLUMNS; c++) {
+        frame->values[c] = realloc(frame->values[c], sizeof(float) * count);
+    }
+    frame->capacity = count;
+}
+
+// Encode a frame in slot order, each body's state as the zigzag delta from
+// the slot's last frame when the same body held it, and append it to the file
+static void write_frame(TrajectoryRecorder* recorder, const QueuedFrame* frame) {
+    SlotHistory* history = &recorder->history;
+    bool keyframe = recorder->frames_written % TRAJECTORY_KEYFRAME_INTERVAL == 0;
+
+    // Bucket records by slot; slots are unique, so this sorts them
+    int maxSlot = -1;
+    for (int i = 0; i < frame->count; i++) {
+        if (frame->slots[i] > maxSlot) maxSlot = frame->slots[i];
+    }
+    if (maxSlot >= history->capacity) {
+        reserve_history(history, maxSlot);
+        recorder->record_of_slot = realloc(recorder->record_of_slot, sizeof(int) * history->capacity);
+    }
+    for (int s = 0; s <= maxSlot; s++) {
+        recorder->record_of_slot[s] = -1;
+    }
+    for (int i = 0; i < frame->count; i++) {
+        recorder->record_of_slot[frame->slots[i]] = i;
+    }
+
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+        recorder->columns[c].size = 0;
+    }
+    int previousSlot = -1;
+    for (int s = 0; s <= maxSlot; s++) {
+        int i = recorder->record_of_slot[s];
+        if (i < 0) continue;
+
+        put_varint(&recorder->columns[COLUMN_SLOT], (uint32_t)(s - previousSlot - 1));
+        previousSlot = s;
+
+        unsigned id = frame->ids[i];
+        unsigned lastId = keyframe ? 0 : history->ids[s];
+        bool same = !keyframe && id == lastId;
+        put_varint(&recorder->columns[COLUMN_ID], zigzag((int32_t)(id - lastId)));
+        history->ids[s] = id;
+
+        for (int c = 0; c < VALUE_COLUMNS; c++) {
+            int32_t value = quantize(frame->values[c][i], recorder->quanta[c]);
+            int32_t reference = same ? history->values[c][s] : 0;
+            put_varint(&recorder->columns[COLUMN_X + c], zigzag((int32_t)((uint32_t)value - (uint32_t)reference)));
+            history->values[c][s] = value;
+        }
+    }
+
+    // Frame header, then each column prefixed by its length so readers can skip it
+    ByteBuffer header = {0};
+    unsigned char flags = keyframe ? FRAME_KEYFRAME : 0;
+    put_varint(&header, (uint32_t)frame->step);
+    put_bytes(&header, &frame->dt, sizeof(float));
+    put_bytes(&header, &flags, 1);
+    put_varint(&header, (uint32_t)frame->count);
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+        put_varint(&header, (uint32_t)recorder->columns[c].size);
+    }
+
+    bool written = fwrite(header.data, 1, header.size, recorder->file) == header.size;
+    for (int c = 0; c < COLUMN_COUNT && written; c++) {
+        ByteBuffer* column = &recorder->columns[c];
+        written = fwrite(column->data, 1, column->size, recorder->file) == column->size;
+    }
+    free_bytes(&header);
+    if (!written) recorder->failed = true;
+    recorder->frames_written++;
+}
+
+static void* writer_main(void* arg) {
+    TrajectoryRecorder* recorder = arg;
+    pthread_mutex_lock(&recorder->lock);
+    for (;;) {
+        while (recorder->queued == 0 && !recorder->stopping) {
+            pthread_cond_wait(&recorder->ready, &recorder->lock);
+        }
+        if (recorder->queued == 0) break;
+
+        // The producer never touches queued frames, so encode without the lock
+        QueuedFrame* frame = &recorder->queue[recorder->head];
+        pthread_mutex_unlock(&recorder->lock);
+        write_frame(recorder, frame);
+        pthread_mutex_lock(&recorder->lock);
+
+        recorder->head = (recorder->head + 1) % TRAJECTORY_QUEUE_FRAMES;
+        recorder->queued--;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+    return NULL;
+}
+
+TrajectoryRecorder* start_trajectory(const char* path, float position_quantum, float velocity_quantum) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open trajectory %s for writing\n", path);
+        return NULL;
+    }
+
+    TrajectoryHeader header = {
+        .version = TRAJECTORY_VERSION,
+        .position_quantum = position_quantum,
+        .velocity_quantum = velocity_quantum
+    };
+    memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fprintf(stderr, "Failed to write trajectory %s\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    TrajectoryRecorder* recorder = calloc(1, sizeof(TrajectoryRecorder));
+    recorder->file = file;
+    recorder->quanta[0] = position_quantum;
+    recorder->quanta[1] = position_quantum;
+    recorder->quanta[2] = velocity_quantum;
+    recorder->quanta[3] = velocity_quantum;
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->ready, NULL);
+    pthread_create(&recorder->writer, NULL, writer_main, recorder);
+    return recorder;
+}
+
+void record_trajectory(TrajectoryRecorder* recorder, const World* world, float dt) {
+    long step = recorder->steps++;
+
+    pthread_mutex_lock(&recorder->lock);
+    bool full = recorder->queued == TRAJECTORY_QUEUE_FRAMES;
+    int tail = (recorder->head + recorder->queued) % TRAJECTORY_QUEUE_FRAMES;
+    pthread_mutex_unlock(&recorder->lock);
+    if (full) {
+        recorder->dropped++;
+        return;
+    }
+
+    // The writer only reads frames already queued, so fill the tail unlocked
+    QueuedFrame* frame = &recorder->queue[tail];
+    reserve_queued(frame, world->bodyCount);
+    frame->step = step;
+    frame->dt = dt;
+    frame->count = world->bodyCount;
+    for (int i = 0; i < world->bodyCount; i++) {
+        const Body* body = &world->bodies[i];
+        frame->slots[i] = body->slot;
+        frame->ids[i] = body->id;
+        frame->values[0][i] = body->x;
+        frame->values[1][i] = body->y;
+        frame->values[2][i] = body->vx;
+        frame->values[3][i] = body->vy;
+    }
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->queued++;
+    pthread_cond_signal(&recorder->ready);
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+long trajectory_dropped_frames(const TrajectoryRecorder* recorder) {
+    return recorder->dropped;
+}
+
+bool stop_trajectory(TrajectoryRecorder* recorder) {
+    pthread_mutex_lock(&recorder->lock);
+    recorder->stopping = true;
+    pthread_cond_signal(&recorder->ready);
+    pthread_mutex_unlock(&recorder->lock);
+    pthread_join(recorder->writer, NULL);
+
+    bool ok = !recorder->failed;
+    if (fclose(recorder->file) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Failed to write trajectory\n");
+
+    pthread_mutex_destroy(&recorder->lock);
+    pthread_cond_destroy(&recorder->ready);
+    for (int f = 0; f < TRAJECTORY_QUEUE_FRAMES; f++) {
+        QueuedFrame* frame = &recorder->queue[f];
+        free(frame->slots);
+        free(frame->ids);
+        for (int c = 0; c < VALUE_COLUMNS; c++) {
+            free(frame->values[c]);
+        }
+    }
+    free_history(&recorder->history);
+    free(recorder->record_of_slot);
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+        free_bytes(&recorder->columns[c]);
+    }
+    free(recorder);
+    return ok;
+}
+
+TrajectoryReader* open_trajectory(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    TrajectoryHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0 ||
+        header.version != TRAJECTORY_VERSION) {
+        fclose(file);
+        return NULL;
+    }
+
+    TrajectoryReader* reader = calloc(1, sizeof(TrajectoryReader));
+    reader->file = file;
+    reader->quanta[0] = header.position_quantum;
+    reader->quanta[1] = header.position_quantum;
+    reader->quanta[2] = header.velocity_quantum;
+    reader->quanta[3] = header.velocity_quantum;
+    return reader;
+}
+
+static bool read_varint(FILE* file, uint32_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int byte = getc(file);
+        if (byte == EOF) return false;
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Read one column of count varints, handing each decoded value to the caller
+// through values; the column must hold exactly count of them
+static bool read_column(TrajectoryReader* reader, uint32_t size, int count, uint32_t* values) {
+    reserve_bytes(&reader->column, size);
+    if (fread(reader->column.data, 1, size, reader->file) != size) return false;
+    const unsigned char* cursor = reader->column.data;
+    const unsigned char* end = cursor + size;
+    for (int i = 0; i < count; i++) {
+        if (!get_varint(&cursor, end, &values[i])) return false;
+    }
+    return cursor == end;
+}
+
+bool read_trajectory_frame(TrajectoryReader* reader, TrajectoryFrame* frame) {
+    uint32_t step, count, sizes[COLUMN_COUNT];
+    float dt;
+    int flags;
+    if (!read_varint(reader->file, &step) ||
+        fread(&dt, sizeof(float), 1, reader->file) != 1 ||
+        (flags = getc(reader->file)) == EOF ||
+        !read_varint(reader->file, &count) ||
+        count > INT32_MAX / 2) {
+        return false;
+    }
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+        if (!read_varint(reader->file, &sizes[c])) return false;
+    }
+    bool keyframe = flags & FRAME_KEYFRAME;
+
+    int n = (int)count;
+    if (n > reader->capacity) {
+        reader->raw = realloc(reader->raw, sizeof(uint32_t) * n);
+        reader->slots = realloc(reader->slots, sizeof(int) * n);
+        reader->same = realloc(reader->same, sizeof(bool) * n);
+        reader->capacity = n;
+    }
+    if (n > frame->capacity) {
+        frame->ids = realloc(frame->ids, sizeof(unsigned) * n);
+        frame->x = realloc(frame->x, sizeof(float) * n);
+        frame->y = realloc(frame->y, sizeof(float) * n);
+        frame->vx = realloc(frame->vx, sizeof(float) * n);
+        frame->vy = realloc(frame->vy, sizeof(float) * n);
+        frame->capacity = n;
+    }
+    frame->step = step;
+    frame->dt = dt;
+    frame->count = n;
+
+    uint32_t* raw = reader->raw;
+    SlotHistory* history = &reader->history;
+
+    if (!read_column(reader, sizes[COLUMN_SLOT], n, raw)) return false;
+    int slot = -1;
+    for (int i = 0; i < n; i++) {
+        slot += (int)raw[i] + 1;
+        if (slot < 0) return false;
+        reader->slots[i] = slot;
+    }
+    if (n > 0) reserve_history(history, slot);
+
+    if (!read_column(reader, sizes[COLUMN_ID], n, raw)) return false;
+    for (int i = 0; i < n; i++) {
+        int s = reader->slots[i];
+        unsigned lastId = keyframe ? 0 : history->ids[s];
+        unsigned id = lastId + (unsigned)unzigzag(raw[i]);
+        reader->same[i] = !keyframe && id == lastId;
+        history->ids[s] = id;
+        frame->ids[i] = id;
+    }
+
+    float* outputs[VALUE_COLUMNS] = { frame->x, frame->y, frame->vx, frame->vy };
+    for (int c = 0; c < VALUE_COLUMNS; c++) {
+        if (!read_column(reader, sizes[COLUMN_X + c], n, raw)) return false;
+        for (int i = 0; i < n; i++) {
+            int s = reader->slots[i];
+            int32_t reference = reader->same[i] ? history->values[c][s] : 0;
+            int32_t value = (int32_t)((uint32_t)reference + (uint32_t)unzigzag(raw[i]));
+            history->values[c][s] = value;
+            outputs[c][i] = value * reader->quanta[c];
+        }
+    }
+    return true;
+}
+
+void close_trajectory(TrajectoryReader* reader) {
+    fclose(reader->file);
+    free_history(&reader->history);
+    free_bytes(&reader->column);
+    free(reader->raw);
+    free(reader->slots);
+    free(reader->same);
+    free(reader);
+}
+
+void free_trajectory_frame(TrajectoryFrame* frame) {
+    free(frame->ids);
+    free(frame->x);
+    free(frame->y);
+    free(frame->vx);
+    free(frame->vy);
+    *frame = (TrajectoryFrame){0};
+}
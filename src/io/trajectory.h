@@ -0,0 +1,37 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "../core/types.h"
+
+typedef struct TrajectoryReader TrajectoryReader;
+
+// Start recording to path, quantizing positions and velocities to the given
+// resolutions. Frames are encoded and written on a background thread.
+// Returns NULL if the file can't be created.
+TrajectoryRecorder* start_trajectory(const char* path, float position_quantum, float velocity_quantum);
+
+// Queue the bodies' current positions and velocities as one frame. Never waits
+// for the writer: if it is a whole queue behind, the frame is dropped.
+void record_trajectory(TrajectoryRecorder* recorder, const World* world, float dt);
+
+// Frames dropped so far because the writer fell behind
+long trajectory_dropped_frames(const TrajectoryRecorder* recorder);
+
+// Write out every queued frame and close the file. Returns false if any
+// write failed.
+bool stop_trajectory(TrajectoryRecorder* recorder);
+
+// Open a recorded trajectory for reading, or return NULL if it isn't one
+TrajectoryReader* open_trajectory(const char* path);
+
+// Decode the next frame into frame, growing its columns as needed. Returns
+// false at the end of the file or on a damaged frame.
+bool read_trajectory_frame(TrajectoryReader* reader, TrajectoryFrame* frame);
+
+// Close a trajectory opened for reading
+void close_trajectory(TrajectoryReader* reader);
+
+// Release a frame's columns
+void free_trajectory_frame(TrajectoryFrame* frame);
+
+#endif // TRAJECTORY_H
@@ -1,28 +1,89 @@
 #include "core/types.h"
 #include "physics/physics.h"
+#include "physics/body_pool.h"
+#include "io/snapshot.h"
+#include "io/scene.h"
+#include "io/history.h"
+#include "io/session.h"
+#include "io/state_buffer.h"
+#include "io/state_publisher.h"
+#include "io/trajectory.h"
+#include "net/replication.h"
 #include "render/renderer.h"
 #include "ui/ui.h"
 #include "utils/random.h"
+#include <ctype.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-// Constants for impulse behavior
-#define IMPULSE_STRENGTH 1000.0f
+#define TRAJECTORY_PATH "trajectory.bin"
+#define SCENE_PATH "world.bscene"
+
+// Apply an input to the world, recording it first if a session is being recorded
+static void apply_input(World* world, SessionRecorder* recorder, const SessionEvent* input,
+                        const char* snapshotPath) {
+    if (recorder) record_session(recorder, world, input);
+    apply_session_event(world, input, snapshotPath);
+}
+
+int main(int argc, char** argv) {
+    // An optional scene to start from, or snapshot to resume from and save
+    // back to with F5. --record writes the session to a file, and --replay
+    // plays one back in place of live input. --history keeps recent steps
+    // for rewinding, in at most the given megabytes or HISTORY_MEMORY_MB.
+    const char* worldPath = NULL;
+    const char* recordPath = NULL;
+    const char* replayPath = NULL;
+    int historyMegabytes = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--history") == 0) {
+            historyMegabytes = HISTORY_MEMORY_MB;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                historyMegabytes = atoi(argv[++i]);
+            }
+        } else {
+            worldPath = argv[i];
+        }
+    }
+    if (recordPath && replayPath) {
+        fprintf(stderr, "Record or replay a session, not both\n");
+        return 1;
+    }
+
+    // A replay starts from the world and seed it was recorded with
+    SessionReader* replay = NULL;
+    if (replayPath) {
+        replay = open_session(replayPath);
+        if (!replay) return 1;
+        worldPath = session_world_path(replay);
+    }
+    const char* snapshotPath = world_snapshot_path(worldPath);
+    bool replaying = replay != NULL;
+    bool diverged = false;
+    long replayedSteps = 0;
 
-int main() {
     World world = {0};
     world.running = true;
-    world.bodyCount = 15;
-    world.bodies = malloc(sizeof(Body) * world.bodyCount);
+    init_physics(&world);
+    reserve_bodies(&world, INITIAL_BODIES);
     
     // Initialize systems
-    init_random();
+    unsigned seed = replay ? session_seed(replay) : init_random();
+    if (replay) {
+        seed_random(seed);
+    }
     if (!init_renderer(&world)) {
-        free(world.bodies);
+        cleanup_physics(&world);
         return 1;
     }
     if (!init_ui(&world)) {
         cleanup_renderer(&world);
-        free(world.bodies);
+        cleanup_physics(&world);
         return 1;
     }
     
@@ -30,19 +91,23 @@ int main() {
     Uint32 main_window_id = SDL_GetWindowID(world.window);
     Uint32 debug_window_id = SDL_GetWindowID(world.debug_window);
     
-    // Create initial bodies
-    for (int i = 0; i < world.bodyCount; i++) {
-        world.bodies[i] = create_body(
-            random_float(50, WINDOW_WIDTH - 50),   // x
-            random_float(50, WINDOW_HEIGHT / 2),   // y
-            random_float(-200, 200),              // vx
-            random_float(-100, 100),              // vy
-            random_float(0.5f, 2.0f),             // mass
-            random_float(10, 30),                 // radius
-            random_color()                        // color
-        );
+    // Load the scene or snapshot if one was given, otherwise create initial bodies
+    if (replay) {
+        populate_session_world(&world, replay);
+    } else {
+        populate_world(&world, worldPath);
+    }
+    SessionRecorder* recorder = recordPath ? start_session(recordPath, seed, worldPath) : NULL;
+
+    // Rewinding isn't an input a replay could repeat, so no history is kept
+    // while recording
+    if (!recorder && historyMegabytes > 0) {
+        world.history = start_history((size_t)historyMegabytes << 20);
     }
     
+    // Publish every step for viewers in other processes
+    world.publisher = start_publishing(STATE_BUFFER_NAME, world.body_pool.capacity);
+    
     Uint32 lastTime = SDL_GetTicks();
     while (world.running) {
         Uint32 currentTime = SDL_GetTicks();
@@ -67,35 +132,91 @@ int main() {
                 }
             }
             
+            // F5 saves a snapshot of the world and F9 restores it. F6 starts
+            // or stops recording the trajectory, F7 saves a binary scene and
+            // F8 starts or stops serving replicas. Inputs that change the
+            // world are ignored while a replay is supplying them.
+            if (event.type == SDL_KEYDOWN && event.key.windowID == main_window_id) {
+                if (event.key.keysym.sym == SDLK_F5 && !replaying) {
+                    apply_input(&world, recorder, &(SessionEvent){ .type = SESSION_SAVE }, snapshotPath);
+                } else if (event.key.keysym.sym == SDLK_F9 && !replaying) {
+                    apply_input(&world, recorder, &(SessionEvent){ .type = SESSION_LOAD }, snapshotPath);
+                } else if (event.key.keysym.sym == SDLK_F6) {
+                    if (world.recorder) {
+                        stop_trajectory(world.recorder);
+                        world.recorder = NULL;
+                    } else {
+                        world.recorder = start_trajectory(TRAJECTORY_PATH,
+                            TRAJECTORY_POSITION_QUANTUM, TRAJECTORY_VELOCITY_QUANTUM);
+                    }
+                } else if (event.key.keysym.sym == SDLK_F7) {
+                    save_scene(&world, SCENE_PATH);
+                } else if (event.key.keysym.sym == SDLK_F8) {
+                    if (world.replication) {
+                        stop_replication(world.replication);
+                        world.replication = NULL;
+                    } else {
+                        world.replication = start_replication(REPLICATION_ADDRESS);
+                    }
+                }
+            }
+            
             // If event is in debug window, let Nuklear handle it
             if (event.window.windowID == debug_window_id) {
                 nk_sdl_handle_event(&event);
             }
-            // If event is in main window, handle physics
-            else if (event.window.windowID == main_window_id && 
-                     event.type == SDL_MOUSEBUTTONDOWN && 
-                     event.button.button == SDL_BUTTON_LEFT) {
-                
-                int mouseX = event.button.x;
-                int mouseY = event.button.y;
-                
-                // Find clicked body
-                Body* clickedBody = get_body_at_position(&world, mouseX, mouseY);
-                if (clickedBody) {
-                    // Get edge point and normal
-                    float edgeX, edgeY, normalX, normalY;
-                    get_closest_edge_info(clickedBody, mouseX, mouseY, &edgeX, &edgeY, &normalX, &normalY);
-                    
-                    // Apply impulse in the direction of the normal
-                    apply_impulse(clickedBody, normalX * IMPULSE_STRENGTH, normalY * IMPULSE_STRENGTH);
-                }
+            // Clicks in the main window push, pin, remove or spawn bodies
+            else if (event.window.windowID == main_window_id &&
+                     event.type == SDL_MOUSEBUTTONDOWN && !replaying) {
+                SessionEvent click = {
+                    .type = SESSION_CLICK,
+                    .button = event.button.button,
+                    .x = event.button.x,
+                    .y = event.button.y
+                };
+                apply_input(&world, recorder, &click, snapshotPath);
             }
         }
         
         // End UI input handling
         nk_input_end(world.nk_ctx);
         
-        update_physics(&world, dt);
+        // Apply the recorded inputs up to the next step and take its dt,
+        // then carry on live once the session runs out. Nothing steps while
+        // paused, as the world is while looking back at a rewound step.
+        if (replaying && !world.paused) {
+            SessionEvent recorded;
+            bool stepped = false;
+            while (!stepped && read_session_event(replay, &recorded)) {
+                if (recorded.type == SESSION_STEP) {
+                    dt = recorded.dt;
+                    stepped = true;
+                    replayedSteps++;
+                } else if (recorded.type == SESSION_HASH) {
+                    // Report the first step whose state differs from the recording
+                    if (!diverged && recorded.hash != world.stats.state_hash) {
+                        printf("Replay diverged from the recording at step %ld\n", replayedSteps);
+                        diverged = true;
+                    }
+                } else {
+                    apply_session_event(&world, &recorded, NULL);
+                }
+            }
+            if (!stepped) {
+                replaying = false;
+                printf("Replay finished\n");
+            }
+        }
+        if (recorder) {
+            record_session(recorder, &world, &(SessionEvent){ .type = SESSION_STEP, .dt = dt });
+        }
+        if (!world.paused) {
+            update_physics(&world, dt);
+        }
+        if (recorder) {
+            record_session(recorder, &world,
+                &(SessionEvent){ .type = SESSION_HASH, .hash = world.stats.state_hash });
+        }
         render_world(&world);
         update_ui(&world);
         
@@ -103,9 +224,11 @@ int main() {
     }
     
     // Cleanup
+    if (recorder) stop_session(recorder);
+    if (replay) close_session(replay);
+    cleanup_physics(&world);
     cleanup_ui(&world);
     cleanup_renderer(&world);
-    free(world.bodies);
     
     return 0;
 }
\ No newline at end of file
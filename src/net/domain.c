@@ -0,0 +1,320 @@
+#include "domain.h"
+#include "../physics/body_pool.h"
+#include "../physics/physics.h"
+#include "../utils/encoding.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // Where it's missing, SO_NOSIGPIPE is set on the socket instead
+#endif
+
+#define MAX_EXCHANGED_BODIES (1 << 26)
+
+enum { LINK_LEFT, LINK_RIGHT, LINK_COUNT };
+
+// One exchange with a neighbor: a count and that many bodies each way
+typedef struct {
+    int fd;                 // -1 at the ends of the domain
+    ByteBuffer out;
+    size_t sent;
+    ByteBuffer in;
+    size_t expected;        // Size of the incoming message, known once its count is in
+} Link;
+
+struct Domain {
+    int rank;
+    int ranks;
+    float left;             // Owned x range [left, right)
+    float right;
+    float halo;
+    Link links[LINK_COUNT];
+    BodyHandle* ghosts;
+    int ghost_count;
+    int ghost_capacity;
+};
+
+float domain_halo(const World* world, float dt) {
+    float maxRadius = 0;
+    for (int i = 0; i < world->bodyCount; i++) {
+        if (world->bodies[i].radius > maxRadius) maxRadius = world->bodies[i].radius;
+    }
+    // Either body of a pair may move towards the other during the step
+    return DOMAIN_HALO_DIAMETERS * 2 * maxRadius + world->neighbor_skin + 2 * max_body_speed(world) * dt;
+}
+
+static int compare_floats(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// Whether every slab between the outer two is at least halo wide
+static bool slabs_fit(const float* bounds, int ranks, float halo) {
+    for (int r = 1; r < ranks - 1; r++) {
+        if (!(bounds[r + 1] - bounds[r] >= halo)) return false;
+    }
+    return true;
+}
+
+bool split_domain(const World* world, int ranks, float halo, float* bounds) {
+    bounds[0] = -INFINITY;
+    bounds[ranks] = INFINITY;
+    if (ranks == 1) return true;
+
+    // Equal shares of the bodies, at the quantiles of their x
+    int count = world->bodyCount;
+    float* xs = malloc(sizeof(float) * (count > 0 ? count : 1));
+    for (int i = 0; i < count; i++) {
+        xs[i] = world->bodies[i].x;
+    }
+    qsort(xs, count, sizeof(float), compare_floats);
+    for (int r = 1; r < ranks; r++) {
+        bounds[r] = count > 0 ? xs[(long)count * r / ranks] : world->width * r / ranks;
+    }
+    free(xs);
+    if (slabs_fit(bounds, ranks, halo)) return true;
+
+    for (int r = 1; r < ranks; r++) {
+        bounds[r] = world->width * r / ranks;
+    }
+    return slabs_fit(bounds, ranks, halo);
+}
+
+Domain* join_domain(int rank, int ranks, const float* bounds, float halo, int left, int right) {
+    Domain* domain = calloc(1, sizeof(Domain));
+    domain->rank = rank;
+    domain->ranks = ranks;
+    domain->left = bounds[rank];
+    domain->right = bounds[rank + 1];
+    domain->halo = halo;
+    domain->links[LINK_LEFT].fd = left;
+    domain->links[LINK_RIGHT].fd = right;
+    for (int side = 0; side < LINK_COUNT; side++) {
+        int fd = domain->links[side].fd;
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    }
+    return domain;
+}
+
+// Whether x lies in the slab. Positions that aren't numbers stay where they are.
+static bool owns(const Domain* domain, float x) {
+    return !(x < domain->left) && !(x >= domain->right);
+}
+
+void keep_domain_bodies(const Domain* domain, World* world) {
+    // Walking down, the body swapped into a removed one's place was already kept
+    for (int i = world->bodyCount - 1; i >= 0; i--) {
+        if (!owns(domain, world->bodies[i].x)) {
+            despawn_body(world, body_handle(world, i));
+        }
+    }
+}
+
+static void begin_messages(Domain* domain) {
+    for (int side = 0; side < LINK_COUNT; side++) {
+        uint32_t count = 0;     // Filled in by exchange_links
+        domain->links[side].out.size = 0;
+        put_bytes(&domain->links[side].out, &count, sizeof(count));
+    }
+}
+
+static void put_body(Domain* domain, int side, const Body* body) {
+    if (domain->links[side].fd >= 0) {
+        put_bytes(&domain->links[side].out, body, sizeof(Body));
+    }
+}
+
+// Send every link's message while receiving its neighbor's, so neither side
+// waits for the other to read first
+static bool exchange_links(Domain* domain) {
+    for (int side = 0; side < LINK_COUNT; side++) {
+        Link* link = &domain->links[side];
+        uint32_t count = (uint32_t)((link->out.size - sizeof(count)) / sizeof(Body));
+        memcpy(link->out.data, &count, sizeof(count));
+        link->sent = 0;
+        link->in.size = 0;
+        link->expected = sizeof(count);
+    }
+
+    for (;;) {
+        struct pollfd polls[LINK_COUNT];
+        Link* polled[LINK_COUNT];
+        int count = 0;
+        for (int side = 0; side < LINK_COUNT; side++) {
+            Link* link = &domain->links[side];
+            if (link->fd < 0) continue;
+            short events = 0;
+            if (link->sent < link->out.size) events |= POLLOUT;
+            if (link->in.size < link->expected) events |= POLLIN;
+            if (!events) continue;
+            polls[count] = (struct pollfd){ .fd = link->fd, .events = events };
+            polled[count++] = link;
+        }
+        if (count == 0) return true;
+        if (poll(polls, count, -1) < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        for (int k = 0; k < count; k++) {
+            Link* link = polled[k];
+            if (polls[k].revents & (POLLERR | POLLNVAL)) return false;
+            if (polls[k].revents & POLLOUT) {
+                ssize_t sent = send(link->fd, link->out.data + link->sent, link->out.size - link->sent, MSG_NOSIGNAL);
+                if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+                if (sent > 0) link->sent += (size_t)sent;
+            }
+            if (polls[k].revents & (POLLIN | POLLHUP)) {
+                // Read no further than this message; the next may follow right behind it
+                reserve_bytes(&link->in, link->expected);
+                ssize_t received = recv(link->fd, link->in.data + link->in.size, link->expected - link->in.size, 0);
+                if (received == 0) return false;
+                if (received < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+                    continue;
+                }
+                link->in.size += (size_t)received;
+
+                uint32_t bodies;
+                if (link->expected == sizeof(bodies) && link->in.size == sizeof(bodies)) {
+                    memcpy(&bodies, link->in.data, sizeof(bodies));
+                    if (bodies > MAX_EXCHANGED_BODIES) return false;
+                    link->expected += (size_t)bodies * sizeof(Body);
+                }
+            }
+        }
+    }
+}
+
+// Add the bodies each neighbor sent, recording their handles if they are ghosts
+static void adopt_received(Domain* domain, World* world, bool ghosts) {
+    for (int side = 0; side < LINK_COUNT; side++) {
+        Link* link = &domain->links[side];
+        if (link->fd < 0) continue;
+        int count = (int)((link->in.size - sizeof(uint32_t)) / sizeof(Body));
+        for (int k = 0; k < count; k++) {
+            Body body;
+            memcpy(&body, link->in.data + sizeof(uint32_t) + (size_t)k * sizeof(Body), sizeof(Body));
+            BodyHandle handle = adopt_body(world, body);
+            if (!ghosts) continue;
+            if (domain->ghost_count == domain->ghost_capacity) {
+                domain->ghost_capacity = domain->ghost_capacity ? domain->ghost_capacity * 2 : 256;
+                domain->ghosts = realloc(domain->ghosts, sizeof(BodyHandle) * domain->ghost_capacity);
+            }
+            domain->ghosts[domain->ghost_count++] = handle;
+        }
+    }
+}
+
+static int compare_ids(const void* a, const void* b) {
+    unsigned x = ((const Body*)a)->id, y = ((const Body*)b)->id;
+    return (x > y) - (x < y);
+}
+
+// Store the bodies in id order, which is the order a world that hasn't
+// reordered or replaced any keeps them in. The solver visits contacts in
+// storage order, so this keeps it visiting them as one process would.
+static void sort_by_id(World* world) {
+    qsort(world->bodies, world->bodyCount, sizeof(Body), compare_ids);
+    for (int i = 0; i < world->bodyCount; i++) {
+        update_body_slot(world, i);
+    }
+    invalidate_body_indices(world);
+}
+
+bool exchange_domain(Domain* domain, World* world) {
+    // Bodies that crossed an edge during the last step go to that side's rank
+    begin_messages(domain);
+    for (int i = world->bodyCount - 1; i >= 0; i--) {
+        const Body* body = &world->bodies[i];
+        int side = body->x < domain->left ? LINK_LEFT : body->x >= domain->right ? LINK_RIGHT : -1;
+        if (side < 0) continue;
+        put_body(domain, side, body);
+        despawn_body(world, body_handle(world, i));
+    }
+    if (!exchange_links(domain)) return false;
+    adopt_received(domain, world, false);
+
+    // Then ghosts of the bodies near each edge, counting those just taken in
+    begin_messages(domain);
+    for (int i = 0; i < world->bodyCount; i++) {
+        const Body* body = &world->bodies[i];
+        if (body->x < domain->left + domain->halo) put_body(domain, LINK_LEFT, body);
+        if (body->x >= domain->right - domain->halo) put_body(domain, LINK_RIGHT, body);
+    }
+    if (!exchange_links(domain)) return false;
+    adopt_received(domain, world, true);
+    sort_by_id(world);
+    return true;
+}
+
+void drop_ghosts(Domain* domain, World* world) {
+    for (int k = 0; k < domain->ghost_count; k++) {
+        despawn_body(world, domain->ghosts[k]);
+    }
+    domain->ghost_count = 0;
+}
+
+void leave_domain(Domain* domain) {
+    for (int side = 0; side < LINK_COUNT; side++) {
+        Link* link = &domain->links[side];
+        if (link->fd >= 0) close(link->fd);
+        free_bytes(&link->out);
+        free_bytes(&link->in);
+    }
+    free(domain->ghosts);
+    free(domain);
+}
+
+static bool write_fully(int fd, const void* data, size_t size) {
+    const char* cursor = data;
+    while (size > 0) {
+        ssize_t written = write(fd, cursor, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        cursor += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+static bool read_fully(int fd, void* data, size_t size) {
+    char* cursor = data;
+    while (size > 0) {
+        ssize_t got = read(fd, cursor, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        cursor += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+bool send_bodies(int fd, const Body* bodies, int count) {
+    uint32_t header = (uint32_t)count;
+    return write_fully(fd, &header, sizeof(header)) &&
+        write_fully(fd, bodies, sizeof(Body) * (size_t)count);
+}
+
+Body* receive_bodies(int fd, int* count) {
+    uint32_t header;
+    if (!read_fully(fd, &header, sizeof(header)) || header > MAX_EXCHANGED_BODIES) return NULL;
+    Body* bodies = malloc(sizeof(Body) * (header > 0 ? header : 1));
+    if (!read_fully(fd, bodies, sizeof(Body) * header)) {
+        free(bodies);
+        return NULL;
+    }
+    *count = (int)header;
+    return bodies;
+}
@@ -0,0 +1,50 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include "../core/types.h"
+
+// One process's share of a world split into vertical slabs. The process owns
+// the bodies whose x lies in its slab and steps them with update_physics,
+// alongside ghost copies of its neighbors' bodies within the halo of its
+// edges. Bodies keep the id they had in the whole world wherever they go.
+typedef struct Domain Domain;
+
+// Halo that covers the contacts of bodies up to DOMAIN_HALO_DIAMETERS of the
+// largest body away, plus how far bodies at the current top speed move in dt
+float domain_halo(const World* world, float dt);
+
+// Fill bounds[0..ranks] with slab edges that give each of ranks processes an
+// equal share of the bodies, or equal widths if that makes a slab narrower
+// than halo. The outer edges are infinite. Returns false if even equal slabs
+// are narrower than halo, as ghosts only come from the adjacent slab.
+bool split_domain(const World* world, int ranks, float halo, float* bounds);
+
+// Take part as rank in a domain split at bounds, talking to the neighboring
+// ranks over the connected sockets left and right, -1 at either end
+Domain* join_domain(int rank, int ranks, const float* bounds, float halo, int left, int right);
+
+// Remove the bodies outside this rank's slab
+void keep_domain_bodies(const Domain* domain, World* world);
+
+// Hand the bodies that have left the slab to the neighbor they moved
+// towards, take the ones that moved in, then swap ghosts of the bodies
+// within the halo of each edge. Bodies are left stored in id order, as a
+// world that never reorders keeps them, so the solver meets contacts in the
+// same order as it would in one process. Call before each step, and
+// drop_ghosts after it. Returns false if a neighbor has gone.
+bool exchange_domain(Domain* domain, World* world);
+
+// Remove the ghosts added by the last exchange
+void drop_ghosts(Domain* domain, World* world);
+
+// Close the links to the neighbors
+void leave_domain(Domain* domain);
+
+// Write count bodies to a blocking socket or pipe, prefixed by the count
+bool send_bodies(int fd, const Body* bodies, int count);
+
+// Read bodies written by send_bodies into a new array. Returns NULL if the
+// stream ends first.
+Body* receive_bodies(int fd, int* count);
+
+#endif // DOMAIN_H
@@ -0,0 +1,301 @@
+#include "replica.h"
+#include "../utils/encoding.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define RECEIVE_CHUNK 65536
+
+struct ReplicaClient {
+    int fd;
+    bool greeted;                   // Magic and version have been checked
+    bool synced;                    // A keyframe has been applied, so deltas have a reference
+    ByteBuffer input;
+    size_t offset;                  // First byte of input not yet applied
+    int32_t* quantized[4];          // x, y, vx, vy of each slot in quanta, what deltas apply to
+    float quanta[4];
+    Replica replica;
+};
+
+static int open_unix_socket(const char* path, bool listening) {
+    struct sockaddr_un local = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(local.sun_path)) return -1;
+    strcpy(local.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (listening) {
+        // Replace a socket left behind by an earlier server, but nothing else
+        struct stat info;
+        if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path);
+        if (bind(fd, (struct sockaddr*)&local, sizeof(local)) == 0 && listen(fd, SOMAXCONN) == 0) return fd;
+    } else if (connect(fd, (struct sockaddr*)&local, sizeof(local)) == 0) {
+        return fd;
+    }
+    close(fd);
+    return -1;
+}
+
+static int open_tcp_socket(const char* address, bool listening) {
+    const char* colon = strrchr(address, ':');
+    if (!colon) return -1;
+    char host[256];
+    size_t length = (size_t)(colon - address);
+    if (length >= sizeof(host)) return -1;
+    memcpy(host, address, length);
+    host[length] = '\0';
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = listening ? AI_PASSIVE : 0
+    };
+    struct addrinfo* found;
+    if (getaddrinfo(length ? host : NULL, colon + 1, &hints, &found) != 0) return -1;
+
+    int fd = -1;
+    for (struct addrinfo* candidate = found; candidate && fd < 0; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (fd < 0) continue;
+        int on = 1;
+        bool opened;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            opened = bind(fd, candidate->ai_addr, candidate->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+        } else {
+            // Messages are sent whole, once a step, so don't hold them back
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            opened = connect(fd, candidate->ai_addr, candidate->ai_addrlen) == 0;
+        }
+        if (!opened) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+int open_replica_socket(const char* address, bool listening) {
+    int fd = strncmp(address, "unix:", 5) == 0
+        ? open_unix_socket(address + 5, listening)
+        : open_tcp_socket(address, listening);
+    if (fd >= 0 && listening) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+ReplicaClient* connect_replica(const char* address) {
+    int fd = open_replica_socket(address, false);
+    if (fd < 0) return NULL;
+    ReplicaClient* client = calloc(1, sizeof(ReplicaClient));
+    client->fd = fd;
+    return client;
+}
+
+static bool get_raw(const unsigned char** cursor, const unsigned char* end, void* value, size_t size) {
+    if ((size_t)(end - *cursor) < size) return false;
+    memcpy(value, *cursor, size);
+    *cursor += size;
+    return true;
+}
+
+// Advance slot past gap empty slots, as long as it stays below limit
+static bool next_slot(int* slot, uint32_t gap, int limit) {
+    int64_t next = (int64_t)*slot + 1 + gap;
+    if (next >= limit) return false;
+    *slot = (int)next;
+    return true;
+}
+
+// Grow the replica to cover slot, starting new slots empty
+static void reserve_slots(ReplicaClient* client, int slot) {
+    Replica* replica = &client->replica;
+    if (slot < replica->slots) return;
+    int slots = replica->slots ? replica->slots : 256;
+    while (slots <= slot) slots *= 2;
+    replica->bodies = realloc(replica->bodies, sizeof(ReplicaBody) * slots);
+    memset(replica->bodies + replica->slots, 0, sizeof(ReplicaBody) * (slots - replica->slots));
+    for (int c = 0; c < 4; c++) {
+        client->quantized[c] = realloc(client->quantized[c], sizeof(int32_t) * slots);
+    }
+    replica->slots = slots;
+}
+
+// Apply one message to the replica. Returns false if it is malformed, in
+// which case the replica may be left partly updated.
+static bool apply_message(ReplicaClient* client, const unsigned char* cursor, const unsigned char* end) {
+    Replica* replica = &client->replica;
+    unsigned char kind;
+    uint32_t step;
+    float dt, width, height;
+    if (!get_raw(&cursor, end, &kind, 1) || !get_varint(&cursor, end, &step) ||
+        !get_raw(&cursor, end, &dt, sizeof(float)) ||
+        !get_raw(&cursor, end, &width, sizeof(float)) ||
+        !get_raw(&cursor, end, &height, sizeof(float))) {
+        return false;
+    }
+
+    if (kind == REPLICA_KEYFRAME) {
+        float quanta[2];
+        if (!get_raw(&cursor, end, quanta, sizeof(quanta))) return false;
+        client->quanta[0] = client->quanta[1] = quanta[0];
+        client->quanta[2] = client->quanta[3] = quanta[1];
+        for (int s = 0; s < replica->slots; s++) {
+            replica->bodies[s].id = 0;
+        }
+        replica->count = 0;
+        replica->keyframes++;
+        client->synced = true;
+    } else if (kind != REPLICA_DELTA || !client->synced) {
+        return false;
+    }
+
+    uint32_t removed;
+    if (!get_varint(&cursor, end, &removed)) return false;
+    int slot = -1;
+    for (uint32_t i = 0; i < removed; i++) {
+        uint32_t gap;
+        if (!get_varint(&cursor, end, &gap) || !next_slot(&slot, gap, replica->slots)) return false;
+        if (replica->bodies[slot].id == 0) return false;
+        replica->bodies[slot].id = 0;
+        replica->count--;
+    }
+
+    uint32_t records;
+    if (!get_varint(&cursor, end, &records)) return false;
+    slot = -1;
+    for (uint32_t i = 0; i < records; i++) {
+        uint32_t gap;
+        unsigned char flags;
+        if (!get_varint(&cursor, end, &gap) || !next_slot(&slot, gap, REPLICA_MAX_SLOTS) ||
+            !get_raw(&cursor, end, &flags, 1)) {
+            return false;
+        }
+        reserve_slots(client, slot);
+        ReplicaBody* body = &replica->bodies[slot];
+
+        if (flags & REPLICA_APPEARANCE) {
+            uint32_t id;
+            unsigned char look[4];
+            if (!get_varint(&cursor, end, &id) || id == 0 ||
+                !get_raw(&cursor, end, &body->radius, sizeof(float)) ||
+                !get_raw(&cursor, end, &body->mass, sizeof(float)) ||
+                !get_raw(&cursor, end, look, sizeof(look))) {
+                return false;
+            }
+            if (body->id == 0) replica->count++;
+            body->id = id;
+            body->r = look[0];
+            body->g = look[1];
+            body->b = look[2];
+            body->type = look[3];
+            for (int c = 0; c < 4; c++) {
+                client->quantized[c][slot] = 0;
+            }
+        } else if (body->id == 0) {
+            return false;
+        }
+
+        float* values[4] = { &body->x, &body->y, &body->vx, &body->vy };
+        for (int c = 0; c < 4; c++) {
+            uint32_t delta;
+            if (!get_varint(&cursor, end, &delta)) return false;
+            int32_t value = (int32_t)((uint32_t)client->quantized[c][slot] + (uint32_t)unzigzag(delta));
+            client->quantized[c][slot] = value;
+            *values[c] = value * client->quanta[c];
+        }
+    }
+    if (cursor != end) return false;
+
+    replica->step = step;
+    replica->dt = dt;
+    replica->width = width;
+    replica->height = height;
+    replica->messages++;
+    return true;
+}
+
+// Apply every complete message in the input. Returns how many, or -1 if the
+// stream is malformed.
+static int apply_messages(ReplicaClient* client) {
+    int applied = 0;
+    for (;;) {
+        const unsigned char* start = client->input.data + client->offset;
+        size_t available = client->input.size - client->offset;
+
+        if (!client->greeted) {
+            char magic[8];
+            uint32_t version;
+            if (available < sizeof(magic) + sizeof(version)) break;
+            memcpy(magic, start, sizeof(magic));
+            memcpy(&version, start + sizeof(magic), sizeof(version));
+            if (memcmp(magic, REPLICA_MAGIC, sizeof(REPLICA_MAGIC)) != 0 || version != REPLICA_VERSION) return -1;
+            client->offset += sizeof(magic) + sizeof(version);
+            client->greeted = true;
+            continue;
+        }
+
+        uint32_t length;
+        if (available < sizeof(length)) break;
+        memcpy(&length, start, sizeof(length));
+        if (length > REPLICA_MAX_MESSAGE) return -1;
+        if (available - sizeof(length) < length) break;
+        if (!apply_message(client, start + sizeof(length), start + sizeof(length) + length)) return -1;
+        client->offset += sizeof(length) + length;
+        applied++;
+    }
+    return applied;
+}
+
+int receive_replica(ReplicaClient* client, bool wait) {
+    ByteBuffer* input = &client->input;
+    int applied = 0;
+    for (;;) {
+        // Drop what has been applied before reading more
+        memmove(input->data, input->data + client->offset, input->size - client->offset);
+        input->size -= client->offset;
+        client->offset = 0;
+        reserve_bytes(input, input->size + RECEIVE_CHUNK);
+
+        // Block only until the first message is in
+        bool block = wait && applied == 0;
+        ssize_t received = recv(client->fd, input->data + input->size, input->capacity - input->size,
+            block ? 0 : MSG_DONTWAIT);
+        if (received == 0) return -1;
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return applied;
+            return -1;
+        }
+        input->size += (size_t)received;
+        client->replica.bytes += (uint64_t)received;
+
+        int result = apply_messages(client);
+        if (result < 0) return -1;
+        applied += result;
+    }
+}
+
+const Replica* client_replica(const ReplicaClient* client) {
+    return &client->replica;
+}
+
+void close_replica(ReplicaClient* client) {
+    close(client->fd);
+    free_bytes(&client->input);
+    for (int c = 0; c < 4; c++) {
+        free(client->quantized[c]);
+    }
+    free(client->replica.bodies);
+    free(client);
+}
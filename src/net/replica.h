@@ -0,0 +1,82 @@
+#ifndef REPLICA_H
+#define REPLICA_H
+
+// Wire format of the engine's state replication and the client side of it,
+// which keeps a replica of the world's bodies from the stream. This header
+// stands alone, without SDL or the engine's types, so external tools can
+// include it.
+//
+// A connection starts with the magic and a uint32 version, then carries
+// messages, each a uint32 length followed by:
+//   kind byte, varint step, float dt, float width, float height
+//   keyframes only: float position quantum, float velocity quantum
+//   varint removed count, then the removed slots as varint gaps
+//   varint record count, then per record in slot order:
+//     varint slot gap, flags byte
+//     REPLICA_APPEARANCE: varint id, float radius, float mass, r, g, b, type
+//     x, y, vx, vy in quanta as zigzag varint deltas from the slot's last
+//     record, or from 0 for a new appearance
+// Fixed-size fields are in the host's byte order, as in the engine's files.
+// A keyframe replaces the whole replica; a delta only lists the bodies whose
+// quantized state changed, so its size follows motion, not body count.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REPLICA_MAGIC "PHYSNET"
+#define REPLICA_VERSION 1
+#define REPLICA_MAX_MESSAGE (256 << 20)  // Longest message a client accepts
+#define REPLICA_MAX_SLOTS (1 << 26)      // Highest slot a client will make room for
+
+enum { REPLICA_KEYFRAME = 1, REPLICA_DELTA = 2 };
+#define REPLICA_APPEARANCE 1             // Record carries the body's id and appearance
+
+// A replicated body, at the resolution the server sends
+typedef struct {
+    uint32_t id;                         // 0 for an empty slot
+    float x, y;
+    float vx, vy;
+    float radius;
+    float mass;
+    uint8_t r, g, b;
+    uint8_t type;                        // BodyType
+} ReplicaBody;
+
+// Bodies by the slot they hold on the server, which keeps them stable
+// across steps; count of them are live
+typedef struct {
+    ReplicaBody* bodies;
+    int slots;
+    int count;
+    uint64_t step;
+    float dt;
+    float width;                         // Walled domain of the world
+    float height;
+    long messages;                       // Messages applied, keyframes included
+    long keyframes;
+    uint64_t bytes;                      // Bytes received
+} Replica;
+
+typedef struct ReplicaClient ReplicaClient;
+
+// Open a socket at address: "unix:<path>" for a Unix socket, otherwise
+// "<host>:<port>" for TCP. Listening sockets are non-blocking. Returns -1 on
+// failure.
+int open_replica_socket(const char* address, bool listening);
+
+// Connect to the server at address. Returns NULL if none is there.
+ReplicaClient* connect_replica(const char* address);
+
+// Apply every complete message received so far, first waiting for one if
+// wait is set. Returns the number applied, or -1 once the connection has
+// closed or sent something malformed.
+int receive_replica(ReplicaClient* client, bool wait);
+
+// The client's replica, as of the last message applied
+const Replica* client_replica(const ReplicaClient* client);
+
+// Disconnect and release the replica
+void close_replica(ReplicaClient* client);
+
+#endif // REPLICA_H
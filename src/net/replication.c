@@ -0,0 +1,311 @@
+#include "replication.h"
+#include "replica.h"
+#include "../utils/encoding.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // Where it's missing, SO_NOSIGPIPE is set on the socket instead
+#endif
+
+// What replicas were last sent for a slot, which the next delta is coded against
+typedef struct {
+    uint32_t id;            // 0 when the slot was last sent empty
+    int32_t values[4];      // x, y, vx, vy in quanta
+    float radius;
+    float mass;
+    uint8_t look[4];        // r, g, b, type
+    bool resting;           // Sent while asleep, so unchanged until woken
+} SentBody;
+
+typedef struct {
+    int fd;
+    ByteBuffer pending;     // Whole messages the socket hasn't taken yet
+    size_t offset;          // First pending byte not yet sent
+    bool needs_keyframe;
+} Subscriber;
+
+struct ReplicationServer {
+    int listener;
+    char* path;             // Unix socket to remove when stopping, NULL for TCP
+    Subscriber* subscribers;
+    int subscriber_count;
+    int subscriber_capacity;
+    SentBody* sent;
+    int slots;
+    bool synced;            // sent matches what every replica was last sent
+    long steps;
+    ByteBuffer removed;     // Scratch for the removed and record lists of a message
+    ByteBuffer records;
+    ByteBuffer delta;
+    ByteBuffer keyframe;
+};
+
+ReplicationServer* start_replication(const char* address) {
+    int listener = open_replica_socket(address, true);
+    if (listener < 0) {
+        fprintf(stderr, "Failed to listen for replicas on %s\n", address);
+        return NULL;
+    }
+    ReplicationServer* server = calloc(1, sizeof(ReplicationServer));
+    server->listener = listener;
+    if (strncmp(address, "unix:", 5) == 0) {
+        server->path = strdup(address + 5);
+    }
+    return server;
+}
+
+static void accept_subscribers(ReplicationServer* server) {
+    int fd;
+    while ((fd = accept(server->listener, NULL, NULL)) >= 0) {
+        int on = 1;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+        if (server->subscriber_count == server->subscriber_capacity) {
+            server->subscriber_capacity = server->subscriber_capacity ? server->subscriber_capacity * 2 : 4;
+            server->subscribers = realloc(server->subscribers, sizeof(Subscriber) * server->subscriber_capacity);
+        }
+        Subscriber* subscriber = &server->subscribers[server->subscriber_count++];
+        *subscriber = (Subscriber){ .fd = fd, .needs_keyframe = true };
+
+        char magic[8] = REPLICA_MAGIC;
+        uint32_t version = REPLICA_VERSION;
+        put_bytes(&subscriber->pending, magic, sizeof(magic));
+        put_bytes(&subscriber->pending, &version, sizeof(version));
+    }
+}
+
+static void remove_subscriber(ReplicationServer* server, int index) {
+    Subscriber* subscriber = &server->subscribers[index];
+    close(subscriber->fd);
+    free_bytes(&subscriber->pending);
+    *subscriber = server->subscribers[--server->subscriber_count];
+}
+
+// Send as much of the queue as the socket will take without waiting.
+// Returns false once the replica has gone.
+static bool flush_subscriber(Subscriber* subscriber) {
+    ByteBuffer* pending = &subscriber->pending;
+    while (subscriber->offset < pending->size) {
+        ssize_t sent = send(subscriber->fd, pending->data + subscriber->offset,
+            pending->size - subscriber->offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            break;
+        }
+        subscriber->offset += (size_t)sent;
+    }
+
+    // Drop sent bytes once they make up half the queue
+    if (subscriber->offset > 0 && subscriber->offset * 2 >= pending->size) {
+        memmove(pending->data, pending->data + subscriber->offset, pending->size - subscriber->offset);
+        pending->size -= subscriber->offset;
+        subscriber->offset = 0;
+    }
+    return true;
+}
+
+static void reserve_sent(ReplicationServer* server, int slots) {
+    if (slots <= server->slots) return;
+    server->sent = realloc(server->sent, sizeof(SentBody) * slots);
+    memset(server->sent + server->slots, 0, sizeof(SentBody) * (slots - server->slots));
+    server->slots = slots;
+}
+
+static void begin_message(ByteBuffer* message, unsigned char kind, long step, float dt, const World* world) {
+    uint32_t length = 0;    // Filled in by end_message
+    message->size = 0;
+    put_bytes(message, &length, sizeof(length));
+    put_bytes(message, &kind, 1);
+    put_varint(message, (uint32_t)step);
+    put_bytes(message, &dt, sizeof(float));
+    put_bytes(message, &world->width, sizeof(float));
+    put_bytes(message, &world->height, sizeof(float));
+}
+
+static void end_message(ByteBuffer* message, uint32_t removed, const ByteBuffer* removedSlots,
+                        uint32_t records, const ByteBuffer* recordBytes) {
+    put_varint(message, removed);
+    put_bytes(message, removedSlots->data, removedSlots->size);
+    put_varint(message, records);
+    put_bytes(message, recordBytes->data, recordBytes->size);
+    uint32_t length = (uint32_t)(message->size - sizeof(length));
+    memcpy(message->data, &length, sizeof(length));
+}
+
+// Append a body's record, its state coded against reference, or against 0
+// with its id and appearance when reference is NULL
+static void put_record(ByteBuffer* records, int gap, const SentBody* body, const int32_t* reference) {
+    unsigned char flags = reference ? 0 : REPLICA_APPEARANCE;
+    put_varint(records, (uint32_t)gap);
+    put_bytes(records, &flags, 1);
+    if (!reference) {
+        put_varint(records, body->id);
+        put_bytes(records, &body->radius, sizeof(float));
+        put_bytes(records, &body->mass, sizeof(float));
+        put_bytes(records, body->look, sizeof(body->look));
+    }
+    for (int c = 0; c < 4; c++) {
+        int32_t base = reference ? reference[c] : 0;
+        put_varint(records, zigzag((int32_t)((uint32_t)body->values[c] - (uint32_t)base)));
+    }
+}
+
+// Compare each slot with what was last sent, encoding the differences as a
+// delta and bringing the sent state up to date
+static void build_delta(ReplicationServer* server, const World* world, long step, float dt) {
+    const BodyPool* pool = &world->body_pool;
+    const float quanta[4] = {
+        REPLICATION_POSITION_QUANTUM, REPLICATION_POSITION_QUANTUM,
+        REPLICATION_VELOCITY_QUANTUM, REPLICATION_VELOCITY_QUANTUM
+    };
+    reserve_sent(server, pool->capacity);
+    server->removed.size = 0;
+    server->records.size = 0;
+    uint32_t removed = 0, records = 0;
+    int lastRemoved = -1, lastRecord = -1;
+
+    for (int s = 0; s < server->slots; s++) {
+        SentBody* sent = &server->sent[s];
+        unsigned id = s < pool->capacity ? pool->ids[s] : 0;
+        if (id == 0) {
+            if (sent->id != 0) {
+                put_varint(&server->removed, (uint32_t)(s - lastRemoved - 1));
+                lastRemoved = s;
+                removed++;
+                sent->id = 0;
+            }
+            continue;
+        }
+
+        const Body* body = &world->bodies[pool->index[s]];
+        if (body->sleeping && sent->resting && sent->id == id) continue;
+
+        const float state[4] = { body->x, body->y, body->vx, body->vy };
+        SentBody current = {
+            .id = id,
+            .radius = body->radius,
+            .mass = body->mass,
+            .look = { body->color.r, body->color.g, body->color.b, (uint8_t)body->type },
+            .resting = body->sleeping
+        };
+        for (int c = 0; c < 4; c++) {
+            current.values[c] = quantize(state[c], quanta[c]);
+        }
+
+        bool appearance = sent->id != id || sent->radius != current.radius ||
+            sent->mass != current.mass || memcmp(sent->look, current.look, sizeof(current.look)) != 0;
+        if (!appearance && memcmp(sent->values, current.values, sizeof(current.values)) == 0) {
+            sent->resting = current.resting;
+            continue;
+        }
+        put_record(&server->records, s - lastRecord - 1, &current, appearance ? NULL : sent->values);
+        lastRecord = s;
+        records++;
+        *sent = current;
+    }
+
+    begin_message(&server->delta, REPLICA_DELTA, step, dt, world);
+    end_message(&server->delta, removed, &server->removed, records, &server->records);
+}
+
+// Encode every body as last sent, for replicas starting over
+static void build_keyframe(ReplicationServer* server, const World* world, long step, float dt) {
+    const float quanta[2] = { REPLICATION_POSITION_QUANTUM, REPLICATION_VELOCITY_QUANTUM };
+    server->removed.size = 0;
+    server->records.size = 0;
+    uint32_t records = 0;
+    int lastRecord = -1;
+    for (int s = 0; s < server->slots; s++) {
+        if (server->sent[s].id == 0) continue;
+        put_record(&server->records, s - lastRecord - 1, &server->sent[s], NULL);
+        lastRecord = s;
+        records++;
+    }
+
+    begin_message(&server->keyframe, REPLICA_KEYFRAME, step, dt, world);
+    put_bytes(&server->keyframe, quanta, sizeof(quanta));
+    end_message(&server->keyframe, 0, &server->removed, records, &server->records);
+}
+
+void replicate_state(ReplicationServer* server, const World* world, float dt) {
+    long step = server->steps++;
+    accept_subscribers(server);
+    if (server->subscriber_count == 0) {
+        server->synced = false;
+        return;
+    }
+
+    // A periodic keyframe starts the sent state over, which also picks up
+    // changes made to sleeping bodies without waking them
+    bool keyframeStep = !server->synced || step % REPLICATION_KEYFRAME_INTERVAL == 0;
+    if (keyframeStep) {
+        memset(server->sent, 0, sizeof(SentBody) * server->slots);
+    }
+    build_delta(server, world, step, dt);
+    server->synced = true;
+
+    // Every replica gets the same bytes, encoded once
+    bool keyframeBuilt = false;
+    for (int i = 0; i < server->subscriber_count; i++) {
+        Subscriber* subscriber = &server->subscribers[i];
+        if (subscriber->pending.size - subscriber->offset > REPLICATION_BACKLOG_BYTES) {
+            subscriber->needs_keyframe = true;
+        } else if (keyframeStep || subscriber->needs_keyframe) {
+            if (!keyframeBuilt) {
+                build_keyframe(server, world, step, dt);
+                keyframeBuilt = true;
+            }
+            put_bytes(&subscriber->pending, server->keyframe.data, server->keyframe.size);
+            subscriber->needs_keyframe = false;
+        } else {
+            put_bytes(&subscriber->pending, server->delta.data, server->delta.size);
+        }
+    }
+
+    for (int i = 0; i < server->subscriber_count;) {
+        if (flush_subscriber(&server->subscribers[i])) {
+            i++;
+        } else {
+            remove_subscriber(server, i);
+        }
+    }
+}
+
+int replication_clients(const ReplicationServer* server) {
+    return server->subscriber_count;
+}
+
+size_t replication_delta_bytes(const ReplicationServer* server) {
+    return server->delta.size;
+}
+
+void stop_replication(ReplicationServer* server) {
+    while (server->subscriber_count > 0) {
+        remove_subscriber(server, server->subscriber_count - 1);
+    }
+    close(server->listener);
+    if (server->path) {
+        unlink(server->path);
+        free(server->path);
+    }
+    free(server->subscribers);
+    free(server->sent);
+    free_bytes(&server->removed);
+    free_bytes(&server->records);
+    free_bytes(&server->delta);
+    free_bytes(&server->keyframe);
+    free(server);
+}
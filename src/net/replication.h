@@ -0,0 +1,28 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include "../core/types.h"
+
+// Listen for replicas at address ("unix:<path>" or "<host>:<port>"). Returns
+// NULL if the address can't be listened on.
+ReplicationServer* start_replication(const char* address);
+
+// Accept waiting replicas and send each the bodies whose state moved by at
+// least a quantum since it was last sent, or a keyframe of every body when
+// one joins, falls behind or REPLICATION_KEYFRAME_INTERVAL steps have
+// passed. Never waits on a replica: what a socket won't take yet stays
+// queued, and a replica queued past REPLICATION_BACKLOG_BYTES skips deltas
+// until it drains and gets a keyframe instead. Sleeping bodies that have
+// already been sent at rest are skipped without being compared.
+void replicate_state(ReplicationServer* server, const World* world, float dt);
+
+// Replicas connected
+int replication_clients(const ReplicationServer* server);
+
+// Size of the last delta, in bytes
+size_t replication_delta_bytes(const ReplicationServer* server);
+
+// Disconnect every replica and stop listening
+void stop_replication(ReplicationServer* server);
+
+#endif // REPLICATION_H
@@ -0,0 +1,158 @@
+#include "body_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+void invalidate_body_indices(World* world) {
+    world->neighbors.body_count = -1;
+    world->events.body_count = 0;
+}
+
+void reserve_bodies(World* world, int capacity) {
+    BodyPool* pool = &world->body_pool;
+    if (capacity <= pool->capacity) return;
+
+    if (pool->mapping) {
+        // Bodies restored from a snapshot move to the heap once they outgrow it
+        Body* bodies = malloc(sizeof(Body) * capacity);
+        memcpy(bodies, world->bodies, sizeof(Body) * world->bodyCount);
+        munmap(pool->mapping, pool->mapping_size);
+        pool->mapping = NULL;
+        world->bodies = bodies;
+    } else {
+        world->bodies = realloc(world->bodies, sizeof(Body) * capacity);
+    }
+    pool->index = realloc(pool->index, sizeof(int) * capacity);
+    pool->ids = realloc(pool->ids, sizeof(unsigned) * capacity);
+
+    // Chain the new slots in front of whatever is still free
+    int tail = world->bodyCount < pool->capacity ? pool->free_slot : -1;
+    for (int slot = pool->capacity; slot < capacity; slot++) {
+        pool->ids[slot] = 0;
+        pool->index[slot] = slot + 1 < capacity ? slot + 1 : tail;
+    }
+    pool->free_slot = pool->capacity;
+    pool->capacity = capacity;
+}
+
+// Give the body just past the last one a free slot under id
+static void place_reserved_body(World* world, unsigned id) {
+    BodyPool* pool = &world->body_pool;
+    int slot = pool->free_slot;
+    pool->free_slot = pool->index[slot];
+
+    int index = world->bodyCount++;
+    world->bodies[index].id = id;
+    world->bodies[index].slot = slot;
+    pool->index[slot] = index;
+    pool->ids[slot] = id;
+}
+
+BodyHandle spawn_body(World* world, Body body) {
+    BodyPool* pool = &world->body_pool;
+    if (world->bodyCount == pool->capacity) {
+        reserve_bodies(world, pool->capacity > 0 ? pool->capacity * 2 : 64);
+    }
+
+    int index = world->bodyCount;
+    world->bodies[index] = body;
+    spawn_reserved_bodies(world, 1);
+    return body_handle(world, index);
+}
+
+BodyHandle adopt_body(World* world, Body body) {
+    BodyPool* pool = &world->body_pool;
+    if (world->bodyCount == pool->capacity) {
+        reserve_bodies(world, pool->capacity > 0 ? pool->capacity * 2 : 64);
+    }
+
+    int index = world->bodyCount;
+    world->bodies[index] = body;
+    place_reserved_body(world, body.id);
+    invalidate_body_indices(world);
+    return body_handle(world, index);
+}
+
+void spawn_reserved_bodies(World* world, int count) {
+    BodyPool* pool = &world->body_pool;
+    for (int k = 0; k < count; k++) {
+        // Skip 0, which marks free slots and empty handles
+        if (pool->next_id == 0) pool->next_id = 1;
+        place_reserved_body(world, pool->next_id++);
+    }
+    invalidate_body_indices(world);
+}
+
+void restore_bodies(World* world, const Body* bodies, int count) {
+    BodyPool* pool = &world->body_pool;
+    int slots = count;
+    for (int i = 0; i < count; i++) {
+        if (bodies[i].slot >= slots) slots = bodies[i].slot + 1;
+    }
+    reserve_bodies(world, slots);
+    memcpy(world->bodies, bodies, sizeof(Body) * count);
+    world->bodyCount = count;
+
+    memset(pool->ids, 0, sizeof(unsigned) * pool->capacity);
+    for (int i = 0; i < count; i++) {
+        pool->ids[bodies[i].slot] = bodies[i].id;
+        pool->index[bodies[i].slot] = i;
+        // Past every restored id, which a snapshot loaded since may not be
+        if (bodies[i].id >= pool->next_id) pool->next_id = bodies[i].id + 1;
+    }
+    pool->free_slot = -1;
+    for (int slot = pool->capacity - 1; slot >= 0; slot--) {
+        if (pool->ids[slot] != 0) continue;
+        pool->index[slot] = pool->free_slot;
+        pool->free_slot = slot;
+    }
+    invalidate_body_indices(world);
+}
+
+bool despawn_body(World* world, BodyHandle handle) {
+    Body* body = get_body(world, handle);
+    if (!body) return false;
+
+    BodyPool* pool = &world->body_pool;
+    int index = pool->index[handle.slot];
+    int last = --world->bodyCount;
+    if (index != last) {
+        world->bodies[index] = world->bodies[last];
+        update_body_slot(world, index);
+    }
+
+    pool->ids[handle.slot] = 0;
+    pool->index[handle.slot] = pool->free_slot;
+    pool->free_slot = handle.slot;
+    invalidate_body_indices(world);
+    return true;
+}
+
+Body* get_body(World* world, BodyHandle handle) {
+    const BodyPool* pool = &world->body_pool;
+    if (handle.id == 0 || handle.slot < 0 || handle.slot >= pool->capacity) return NULL;
+    if (pool->ids[handle.slot] != handle.id) return NULL;
+    return &world->bodies[pool->index[handle.slot]];
+}
+
+BodyHandle body_handle(const World* world, int index) {
+    const Body* body = &world->bodies[index];
+    return (BodyHandle){ body->slot, body->id };
+}
+
+void update_body_slot(World* world, int index) {
+    world->body_pool.index[world->bodies[index].slot] = index;
+}
+
+void free_bodies(World* world) {
+    if (world->body_pool.mapping) {
+        munmap(world->body_pool.mapping, world->body_pool.mapping_size);
+    } else {
+        free(world->bodies);
+    }
+    free(world->body_pool.index);
+    free(world->body_pool.ids);
+    world->bodies = NULL;
+    world->bodyCount = 0;
+    world->body_pool = (BodyPool){0};
+}
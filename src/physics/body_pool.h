@@ -0,0 +1,48 @@
+#ifndef BODY_POOL_H
+#define BODY_POOL_H
+
+#include "../core/types.h"
+
+// Make room for at least capacity bodies, so spawning up to that many never
+// allocates. Growth past the reserve doubles the storage.
+void reserve_bodies(World* world, int capacity);
+
+// Add a copy of body to the world and return a handle to it
+BodyHandle spawn_body(World* world, Body body);
+
+// Add a copy of body under the id it already has, for bodies moving between
+// worlds that share one id space. The caller keeps ids unique.
+BodyHandle adopt_body(World* world, Body body);
+
+// Add the count bodies already written just past the last one, into storage
+// made with reserve_bodies, giving each its id and slot. Bulk loaders fill
+// that storage in parallel and then spawn it all at once.
+void spawn_reserved_bodies(World* world, int count);
+
+// Replace every body with count copies of bodies taken from this world
+// earlier, each back in the slot and under the id it was taken with, so
+// handles made back then resolve again
+void restore_bodies(World* world, const Body* bodies, int count);
+
+// Remove the body behind handle by moving the last body into its place.
+// Returns false if the handle no longer refers to a body.
+bool despawn_body(World* world, BodyHandle handle);
+
+// Body behind handle, or NULL once it has been despawned. The pointer is only
+// valid until the next spawn, despawn or reorder.
+Body* get_body(World* world, BodyHandle handle);
+
+// Handle to the body stored at index
+BodyHandle body_handle(const World* world, int index);
+
+// Drop solver state that refers to bodies by index, after bodies are added,
+// removed or moved: the neighbor lists and event predictions
+void invalidate_body_indices(World* world);
+
+// Point a body's slot at the index it now lives at, after bodies are moved
+void update_body_slot(World* world, int index);
+
+// Release the body storage and slot table
+void free_bodies(World* world);
+
+#endif // BODY_POOL_H
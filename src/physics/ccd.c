@@ -0,0 +1,227 @@
+#include "ccd.h"
+#include "neighbors.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Keep swept bodies a hair short of touching so the discrete pass sees a clean contact
+#define CCD_BACKOFF 0.98f
+
+// Displacement over the step, matching the Velocity Verlet position update
+static void step_displacement(const Body* body, float dt, float* dx, float* dy) {
+    if (body->sleeping || body->type == BODY_STATIC) {
+        *dx = 0;
+        *dy = 0;
+        return;
+    }
+    *dx = body->vx * dt + 0.5f * body->ax * dt * dt;
+    *dy = body->vy * dt + 0.5f * body->ay * dt * dt;
+}
+
+// Earliest fraction of the step at which a body moving by (dx, dy) reaches a
+// wall, or 1 if it stays inside. The normal points into the wall it hits.
+static float wall_time_of_impact(const World* world, const Body* body, float dx, float dy, float* nx, float* ny) {
+    float t = 1;
+    if (dx > 0 && body->x + dx > world->width - body->radius) {
+        t = (world->width - body->radius - body->x) / dx;
+        *nx = 1;
+        *ny = 0;
+    }
+    if (dx < 0 && body->x + dx < body->radius) {
+        t = (body->radius - body->x) / dx;
+        *nx = -1;
+        *ny = 0;
+    }
+    if (dy > 0 && body->y + dy > world->height - body->radius) {
+        float ty = (world->height - body->radius - body->y) / dy;
+        if (ty < t) {
+            t = ty;
+            *nx = 0;
+            *ny = 1;
+        }
+    }
+    if (dy < 0 && body->y + dy < body->radius) {
+        float ty = (body->radius - body->y) / dy;
+        if (ty < t) {
+            t = ty;
+            *nx = 0;
+            *ny = -1;
+        }
+    }
+    return fmaxf(t, 0);
+}
+
+// Earliest fraction of the step at which two circles moving linearly touch,
+// or 1 if they don't. Pairs that already overlap are left to the discrete pass.
+static float pair_time_of_impact(const Body* a, float adx, float ady,
+                                 const Body* b, float bdx, float bdy) {
+    // Solve |p + t * d| = r for the relative position p and displacement d
+    float px = b->x - a->x;
+    float py = b->y - a->y;
+    float dx = bdx - adx;
+    float dy = bdy - ady;
+    float r = a->radius + b->radius;
+
+    float c = px * px + py * py - r * r;
+    if (c <= 0) return 1;
+    float bq = px * dx + py * dy;
+    if (bq >= 0) return 1;  // Not approaching
+    float aq = dx * dx + dy * dy;
+    float disc = bq * bq - aq * c;
+    if (disc < 0) return 1;
+
+    float t = (-bq - sqrtf(disc)) / aq;
+    return t < 1 ? t : 1;
+}
+
+static void reserve_sweep(CcdSweep* sweep, int count) {
+    if (count <= sweep->capacity) return;
+    sweep->indices = realloc(sweep->indices, sizeof(int) * count);
+    sweep->fractions = realloc(sweep->fractions, sizeof(float) * count);
+    sweep->hits = realloc(sweep->hits, sizeof(int) * count);
+    sweep->normals = realloc(sweep->normals, sizeof(float) * 2 * count);
+    sweep->entries = realloc(sweep->entries, sizeof(int) * count);
+    sweep->capacity = count;
+}
+
+// Move entry k's impact earlier if its body reaches body j first
+static void sweep_pair(World* world, float dt, CcdSweep* sweep, int k, int j) {
+    const Body* body = &world->bodies[sweep->indices[k]];
+    const Body* other = &world->bodies[j];
+    float dx, dy, odx, ody;
+    step_displacement(body, dt, &dx, &dy);
+    step_displacement(other, dt, &odx, &ody);
+
+    // Skip pairs whose swept bounds never meet
+    float reach = body->radius + other->radius;
+    if (fminf(body->x, body->x + dx) > fmaxf(other->x, other->x + odx) + reach ||
+        fmaxf(body->x, body->x + dx) < fminf(other->x, other->x + odx) - reach ||
+        fminf(body->y, body->y + dy) > fmaxf(other->y, other->y + ody) + reach ||
+        fmaxf(body->y, body->y + dy) < fminf(other->y, other->y + ody) - reach) {
+        return;
+    }
+
+    float t = pair_time_of_impact(body, dx, dy, other, odx, ody);
+    if (t < sweep->fractions[k]) {
+        sweep->fractions[k] = t;
+        sweep->hits[k] = j;
+        // Normal between the centers at the moment of impact
+        float px = (other->x + odx * t) - (body->x + dx * t);
+        float py = (other->y + ody * t) - (body->y + dy * t);
+        float len = sqrtf(px * px + py * py);
+        sweep->normals[2 * k] = px / len;
+        sweep->normals[2 * k + 1] = py / len;
+    }
+}
+
+void sweep_fast_bodies(World* world, float dt) {
+    CcdSweep* sweep = &world->ccd;
+    sweep->count = 0;
+    if (world->collision_mode != COLLISION_CCD) return;
+    reserve_sweep(sweep, world->bodyCount);
+
+    // Give each fast body an entry starting from its wall impact, and find
+    // how far any body moves this step
+    float maxFastSq = 0, maxMoveSq = 0;
+    for (int i = 0; i < world->bodyCount; i++) {
+        Body* body = &world->bodies[i];
+        sweep->entries[i] = -1;
+        float dx, dy;
+        step_displacement(body, dt, &dx, &dy);
+        float moveSq = dx * dx + dy * dy;
+        maxMoveSq = fmaxf(maxMoveSq, moveSq);
+
+        // Only dynamic bodies are stopped at impact; kinematic ones push through
+        if (body->type != BODY_DYNAMIC) continue;
+
+        // Slow bodies stay on the discrete path
+        float threshold = CCD_MOTION_THRESHOLD * body->radius;
+        if (moveSq <= threshold * threshold) continue;
+        world->stats.ccd_bodies++;
+        maxFastSq = fmaxf(maxFastSq, moveSq);
+
+        int k = sweep->count++;
+        float nx = 0, ny = 0;
+        sweep->entries[i] = k;
+        sweep->indices[k] = i;
+        sweep->fractions[k] = wall_time_of_impact(world, body, dx, dy, &nx, &ny);
+        sweep->hits[k] = -1;
+        sweep->normals[2 * k] = nx;
+        sweep->normals[2 * k + 1] = ny;
+    }
+    if (sweep->count == 0) return;
+
+    // A fast body can only reach bodies that start within its sweep plus
+    // theirs, so widen the neighbor lists by both and test only listed pairs.
+    // Walking the lists in order meets each body's partners in ascending
+    // order, the same order an all-pairs sweep would.
+    update_neighbor_list(world, sqrtf(maxFastSq) + sqrtf(maxMoveSq));
+    const NeighborList* list = &world->neighbors;
+    for (int i = 0; i < world->bodyCount; i++) {
+        for (int k = list->start[i]; k < list->start[i + 1]; k++) {
+            int j = list->pairs[k];
+            if (sweep->entries[i] >= 0) sweep_pair(world, dt, sweep, sweep->entries[i], j);
+            if (sweep->entries[j] >= 0) sweep_pair(world, dt, sweep, sweep->entries[j], i);
+        }
+    }
+
+    // Keep the entries that hit something
+    int count = 0;
+    for (int k = 0; k < sweep->count; k++) {
+        if (sweep->fractions[k] >= 1) continue;
+        sweep->indices[count] = sweep->indices[k];
+        sweep->fractions[count] = sweep->fractions[k] * CCD_BACKOFF;
+        sweep->hits[count] = sweep->hits[k];
+        sweep->normals[2 * count] = sweep->normals[2 * k];
+        sweep->normals[2 * count + 1] = sweep->normals[2 * k + 1];
+        count++;
+        world->stats.ccd_impacts++;
+    }
+    sweep->count = count;
+}
+
+void resolve_impacts(World* world) {
+    CcdSweep* sweep = &world->ccd;
+    for (int k = 0; k < sweep->count; k++) {
+        Body* a = &world->bodies[sweep->indices[k]];
+        float nx = sweep->normals[2 * k];
+        float ny = sweep->normals[2 * k + 1];
+
+        if (sweep->hits[k] < 0) {
+            // Reflect the velocity into the wall with the usual restitution
+            float vn = a->vx * nx + a->vy * ny;
+            if (vn <= 0) continue;
+            float e = vn > RESTITUTION_THRESHOLD ? world->restitution : 0;
+            a->vx -= (1 + e) * vn * nx;
+            a->vy -= (1 + e) * vn * ny;
+            world->stats.boundary_hits++;
+            continue;
+        }
+
+        Body* b = &world->bodies[sweep->hits[k]];
+        float velAlongNormal = (b->vx - a->vx) * nx + (b->vy - a->vy) * ny;
+        if (velAlongNormal >= 0) continue;
+
+        float e = -velAlongNormal > RESTITUTION_THRESHOLD ? world->restitution : 0;
+        float j = -(1 + e) * velAlongNormal / (a->inv_mass + b->inv_mass);
+        a->vx -= j * nx * a->inv_mass;
+        a->vy -= j * ny * a->inv_mass;
+        b->vx += j * nx * b->inv_mass;
+        b->vy += j * ny * b->inv_mass;
+        world->stats.impulses_applied++;
+
+        // The struck body may have been asleep
+        if (b->sleeping) {
+            b->sleeping = false;
+            b->sleep_time = 0;
+        }
+    }
+}
+
+void free_ccd_sweep(CcdSweep* sweep) {
+    free(sweep->indices);
+    free(sweep->fractions);
+    free(sweep->hits);
+    free(sweep->normals);
+    free(sweep->entries);
+    *sweep = (CcdSweep){0};
+}
@@ -0,0 +1,20 @@
+#ifndef CCD_H
+#define CCD_H
+
+#include "../core/types.h"
+
+// Find the awake bodies whose displacement this step exceeds CCD_MOTION_THRESHOLD
+// of their radius and the fraction of the step each can travel before first
+// touching another body or a wall. Candidates come from the neighbor lists,
+// widened by the step's largest displacements. Must run before positions are
+// integrated.
+void sweep_fast_bodies(World* world, float dt);
+
+// Apply the restitution response to each swept body at its impact, since it
+// stops short of the overlap the discrete pass would need to see
+void resolve_impacts(World* world);
+
+// Release the sweep's storage
+void free_ccd_sweep(CcdSweep* sweep);
+
+#endif // CCD_H
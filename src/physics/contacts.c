@@ -0,0 +1,87 @@
+#include "contacts.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+static uint32_t pair_hash(unsigned a, unsigned b) {
+    uint64_t key = ((uint64_t)a << 32) | b;
+    key *= 0x9E3779B97F4A7C15ull;
+    return (uint32_t)(key >> 32);
+}
+
+static void grow_contacts(Contact** contacts, int* capacity, int needed) {
+    if (needed <= *capacity) return;
+    int newCapacity = *capacity > 0 ? *capacity : 64;
+    while (newCapacity < needed) newCapacity *= 2;
+    *contacts = realloc(*contacts, sizeof(Contact) * newCapacity);
+    *capacity = newCapacity;
+}
+
+void contact_cache_begin(ContactCache* cache) {
+    // Swap buffers so last step's contacts become the lookup set
+    Contact* contacts = cache->previous;
+    int capacity = cache->previous_capacity;
+    cache->previous = cache->contacts;
+    cache->previous_capacity = cache->capacity;
+    cache->previous_count = cache->count;
+    cache->contacts = contacts;
+    cache->capacity = capacity;
+    cache->count = 0;
+
+    // Keep the table at most half full
+    int needed = 16;
+    while (needed < cache->previous_count * 2) needed *= 2;
+    if (needed > cache->slot_count) {
+        free(cache->slots);
+        cache->slots = malloc(sizeof(int) * needed);
+        cache->slot_count = needed;
+    }
+    for (int i = 0; i < cache->slot_count; i++) {
+        cache->slots[i] = -1;
+    }
+
+    uint32_t mask = (uint32_t)cache->slot_count - 1;
+    for (int i = 0; i < cache->previous_count; i++) {
+        Contact* contact = &cache->previous[i];
+        uint32_t slot = pair_hash(contact->key_a, contact->key_b) & mask;
+        while (cache->slots[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        cache->slots[slot] = i;
+    }
+}
+
+Contact* contact_cache_add(ContactCache* cache, const Body* bodies, int a, int b) {
+    grow_contacts(&cache->contacts, &cache->capacity, cache->count + 1);
+    Contact* contact = &cache->contacts[cache->count++];
+
+    // Key pairs by ordered ids, since moving bodies can flip their index order.
+    // Walls keep their negative index, which as unsigned sorts after every id.
+    unsigned key_a = bodies[a].id;
+    unsigned key_b = b >= 0 ? bodies[b].id : (unsigned)b;
+    *contact = (Contact){
+        .a = a, .b = b,
+        .key_a = key_a < key_b ? key_a : key_b,
+        .key_b = key_a < key_b ? key_b : key_a
+    };
+
+    if (cache->previous_count == 0) return contact;
+
+    uint32_t mask = (uint32_t)cache->slot_count - 1;
+    uint32_t slot = pair_hash(contact->key_a, contact->key_b) & mask;
+    while (cache->slots[slot] >= 0) {
+        Contact* old = &cache->previous[cache->slots[slot]];
+        if (old->key_a == contact->key_a && old->key_b == contact->key_b) {
+            contact->normal_impulse = old->normal_impulse;
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return contact;
+}
+
+void contact_cache_free(ContactCache* cache) {
+    free(cache->contacts);
+    free(cache->previous);
+    free(cache->slots);
+    *cache = (ContactCache){0};
+}
@@ -0,0 +1,17 @@
+#ifndef CONTACTS_H
+#define CONTACTS_H
+
+#include "../core/types.h"
+
+// Start a new step: the current contacts become the previous ones and are indexed by body ids,
+// which unlike indices survive bodies being despawned or moved between steps
+void contact_cache_begin(ContactCache* cache);
+
+// Add a contact for the pair (a, b), a < b or b < 0 for a wall, carrying over its accumulated impulse
+// from the previous step if the pair was touching then. The pointer is valid until the next add.
+Contact* contact_cache_add(ContactCache* cache, const Body* bodies, int a, int b);
+
+// Release the cache's storage
+void contact_cache_free(ContactCache* cache);
+
+#endif // CONTACTS_H
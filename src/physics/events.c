@@ -0,0 +1,388 @@
+#include "events.h"
+#include "physics.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Normal speed (pixels/s) below which a touching pair or wall contact counts
+// as resting. Contacts too slow to bounce leave with about zero normal speed,
+// and rounding would otherwise predict them colliding again at once.
+#define RESTING_SPEED 1e-3
+
+// Queued events per body beyond which stale ones are swept out
+#define EVENTS_PER_BODY 4
+
+static void reserve_bodies(EventQueue* queue, int count) {
+    if (count <= queue->body_capacity) return;
+    queue->body_time = realloc(queue->body_time, sizeof(double) * count);
+    queue->collisions = realloc(queue->collisions, sizeof(int) * count);
+    queue->synced = realloc(queue->synced, sizeof(float) * 4 * count);
+    queue->cell_of = realloc(queue->cell_of, sizeof(int) * count);
+    queue->next_in_cell = realloc(queue->next_in_cell, sizeof(int) * count);
+    queue->prev_in_cell = realloc(queue->prev_in_cell, sizeof(int) * count);
+    queue->body_capacity = count;
+}
+
+static bool earlier(const Event* a, const Event* b) {
+    return a->time < b->time;
+}
+
+static void sift_down(EventQueue* queue, int i, Event event) {
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= queue->count) break;
+        if (child + 1 < queue->count && earlier(&queue->heap[child + 1], &queue->heap[child])) child++;
+        if (!earlier(&queue->heap[child], &event)) break;
+        queue->heap[i] = queue->heap[child];
+        i = child;
+    }
+    queue->heap[i] = event;
+}
+
+static void push_event(EventQueue* queue, Event event) {
+    if (queue->count == queue->capacity) {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : 256;
+        queue->heap = realloc(queue->heap, sizeof(Event) * queue->capacity);
+    }
+
+    int i = queue->count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!earlier(&event, &queue->heap[parent])) break;
+        queue->heap[i] = queue->heap[parent];
+        i = parent;
+    }
+    queue->heap[i] = event;
+}
+
+static Event pop_event(EventQueue* queue) {
+    Event top = queue->heap[0];
+    Event last = queue->heap[--queue->count];
+    if (queue->count > 0) sift_down(queue, 0, last);
+    return top;
+}
+
+static bool is_stale(const EventQueue* queue, const Event* event) {
+    if (queue->collisions[event->a] != event->count_a) return true;
+    return event->b >= 0 && queue->collisions[event->b] != event->count_b;
+}
+
+// Drop predictions whose own body has collided since and re-heapify. Events
+// only stale through their partner stay, since popping them re-predicts
+// their body.
+static void compact_queue(EventQueue* queue) {
+    int kept = 0;
+    for (int i = 0; i < queue->count; i++) {
+        const Event* event = &queue->heap[i];
+        if (queue->collisions[event->a] == event->count_a) {
+            queue->heap[kept++] = *event;
+        }
+    }
+    queue->count = kept;
+    for (int i = kept / 2 - 1; i >= 0; i--) {
+        sift_down(queue, i, queue->heap[i]);
+    }
+}
+
+static int cell_at(const EventQueue* queue, float x, float y) {
+    int cx = x >= 0 ? (int)(x / queue->cell_size) : 0;
+    int cy = y >= 0 ? (int)(y / queue->cell_size) : 0;
+    if (cx >= queue->cols) cx = queue->cols - 1;
+    if (cy >= queue->rows) cy = queue->rows - 1;
+    return cy * queue->cols + cx;
+}
+
+static void file_body(EventQueue* queue, int index, int cell) {
+    queue->cell_of[index] = cell;
+    queue->prev_in_cell[index] = -1;
+    queue->next_in_cell[index] = queue->cell_head[cell];
+    if (queue->cell_head[cell] >= 0) queue->prev_in_cell[queue->cell_head[cell]] = index;
+    queue->cell_head[cell] = index;
+}
+
+static void unfile_body(EventQueue* queue, int index) {
+    int prev = queue->prev_in_cell[index];
+    int next = queue->next_in_cell[index];
+    if (prev >= 0) queue->next_in_cell[prev] = next;
+    else queue->cell_head[queue->cell_of[index]] = next;
+    if (next >= 0) queue->prev_in_cell[next] = prev;
+}
+
+// Move a body along its straight path up to the given time
+static void advance_body(World* world, int index, double time) {
+    Body* body = &world->bodies[index];
+    float t = (float)(time - world->events.body_time[index]);
+    body->x += body->vx * t;
+    body->y += body->vy * t;
+    world->events.body_time[index] = time;
+}
+
+// Time from now until body a, whose position is at now, touches body b, or
+// INFINITY if they never meet. Overlapping pairs still closing meet at once.
+static double pair_time(const World* world, int a, int b, double now) {
+    const Body* first = &world->bodies[a];
+    const Body* second = &world->bodies[b];
+    double lag = now - world->events.body_time[b];
+    double dx = second->x + second->vx * lag - first->x;
+    double dy = second->y + second->vy * lag - first->y;
+    double dvx = second->vx - first->vx;
+    double dvy = second->vy - first->vy;
+
+    double approach = dx * dvx + dy * dvy;
+    if (approach >= -RESTING_SPEED * sqrt(dx * dx + dy * dy)) return INFINITY;
+
+    double reach = first->radius + second->radius;
+    double gap = dx * dx + dy * dy - reach * reach;
+    if (gap <= 0) return 0;
+
+    double speedSq = dvx * dvx + dvy * dvy;
+    double discriminant = approach * approach - speedSq * gap;
+    if (discriminant < 0) return INFINITY;
+    return gap / (-approach + sqrt(discriminant));
+}
+
+// Time until a body reaches a wall, or INFINITY if it is moving away
+static double wall_time(const World* world, const Body* body, int wall) {
+    float nx, ny, offset;
+    wall_plane(world, wall, &nx, &ny, &offset);
+    double speed = body->vx * nx + body->vy * ny;
+    if (speed <= RESTING_SPEED) return INFINITY;
+    double penetration = body->x * nx + body->y * ny + body->radius - offset;
+    return penetration >= 0 ? 0 : -penetration / speed;
+}
+
+// Time until a body leaves its cell, and the cell it enters, or INFINITY
+// when it only heads for the edge of the grid
+static double crossing_time(const EventQueue* queue, const Body* body, int cell, int* next) {
+    int cx = cell % queue->cols;
+    int cy = cell / queue->cols;
+    double tx = INFINITY, ty = INFINITY;
+    int stepX = 0, stepY = 0;
+
+    if (body->vx > 0 && cx < queue->cols - 1) {
+        tx = ((cx + 1) * queue->cell_size - body->x) / body->vx;
+        stepX = 1;
+    } else if (body->vx < 0 && cx > 0) {
+        tx = (cx * queue->cell_size - body->x) / body->vx;
+        stepX = -1;
+    }
+    if (body->vy > 0 && cy < queue->rows - 1) {
+        ty = ((cy + 1) * queue->cell_size - body->y) / body->vy;
+        stepY = 1;
+    } else if (body->vy < 0 && cy > 0) {
+        ty = (cy * queue->cell_size - body->y) / body->vy;
+        stepY = -1;
+    }
+
+    if (tx < ty) {
+        *next = cell + stepX;
+        return tx > 0 ? tx : 0;
+    }
+    *next = cell + stepY * queue->cols;
+    return ty > 0 ? ty : 0;
+}
+
+// Queue the earliest event of a body whose position is at now: a collision
+// with a wall or a body in an adjacent cell, or leaving its cell. Each body
+// keeps exactly one prediction of its own in the queue.
+static void predict(World* world, int a, double now) {
+    EventQueue* queue = &world->events;
+    const Body* body = &world->bodies[a];
+    int cell = queue->cell_of[a];
+    Event best = { .a = a, .b = EVENT_CELL_CROSSING };
+    best.time = now + crossing_time(queue, body, cell, &best.count_b);
+
+    // Only dynamic bodies respond to walls and to kinematic or static bodies
+    for (int wall = 0; wall < WALL_COUNT && body->type == BODY_DYNAMIC; wall++) {
+        double t = now + wall_time(world, body, wall);
+        if (t < best.time) {
+            best.time = t;
+            best.b = -1 - wall;
+        }
+    }
+
+    int cx = cell % queue->cols;
+    int cy = cell / queue->cols;
+    for (int y = cy > 0 ? cy - 1 : 0; y <= cy + 1 && y < queue->rows; y++) {
+        for (int x = cx > 0 ? cx - 1 : 0; x <= cx + 1 && x < queue->cols; x++) {
+            for (int j = queue->cell_head[y * queue->cols + x]; j >= 0; j = queue->next_in_cell[j]) {
+                if (j == a) continue;
+                if (body->type != BODY_DYNAMIC && world->bodies[j].type != BODY_DYNAMIC) continue;
+                double t = now + pair_time(world, a, j, now);
+                if (t < best.time) {
+                    best.time = t;
+                    best.b = j;
+                }
+            }
+        }
+    }
+
+    if (isinf(best.time)) return;
+    best.count_a = queue->collisions[a];
+    if (best.b >= 0) best.count_b = queue->collisions[best.b];
+    push_event(queue, best);
+}
+
+// Apply the restitution response to a pair or wall meeting right now
+static void collide(World* world, const Event* event) {
+    Body* a = &world->bodies[event->a];
+    Body* b = event->b >= 0 ? &world->bodies[event->b] : NULL;
+    float nx, ny;
+    if (b) {
+        float dx = b->x - a->x;
+        float dy = b->y - a->y;
+        float distance = sqrtf(dx * dx + dy * dy);
+        nx = distance > 0 ? dx / distance : 0;
+        ny = distance > 0 ? dy / distance : 1;
+        world->stats.impulses_applied++;
+    } else {
+        float offset;
+        wall_plane(world, -1 - event->b, &nx, &ny, &offset);
+        world->stats.boundary_hits++;
+    }
+
+    float invMassA = a->inv_mass;
+    float invMassB = b ? b->inv_mass : 0;
+    float velAlongNormal = ((b ? b->vx : 0) - a->vx) * nx + ((b ? b->vy : 0) - a->vy) * ny;
+    float j = (bounce_speed(world, velAlongNormal) - velAlongNormal) / (invMassA + invMassB);
+
+    a->vx -= j * invMassA * nx;
+    a->vy -= j * invMassA * ny;
+    if (b) {
+        b->vx += j * invMassB * nx;
+        b->vy += j * invMassB * ny;
+    }
+}
+
+static void record_sync(EventQueue* queue, const Body* body, int index) {
+    float* synced = &queue->synced[4 * index];
+    synced[0] = body->x;
+    synced[1] = body->y;
+    synced[2] = body->vx;
+    synced[3] = body->vy;
+}
+
+// File every body in a fresh grid and predict each from scratch at the
+// current clock. Cells are at least as wide as the largest body, so bodies
+// two cells apart cannot touch.
+static void prime_queue(World* world) {
+    EventQueue* queue = &world->events;
+    reserve_bodies(queue, world->bodyCount);
+    queue->count = 0;
+    queue->body_count = world->bodyCount;
+
+    float maxRadius = 0;
+    for (int i = 0; i < world->bodyCount; i++) {
+        maxRadius = fmaxf(maxRadius, world->bodies[i].radius);
+    }
+    float area = world->width * world->height;
+    queue->cell_size = fmaxf(2 * maxRadius, sqrtf(area / (world->bodyCount + 1)));
+    queue->cols = (int)ceilf(world->width / queue->cell_size);
+    queue->rows = (int)ceilf(world->height / queue->cell_size);
+
+    int cells = queue->cols * queue->rows;
+    if (cells > queue->cell_capacity) {
+        queue->cell_head = realloc(queue->cell_head, sizeof(int) * cells);
+        queue->cell_capacity = cells;
+    }
+    for (int c = 0; c < cells; c++) queue->cell_head[c] = -1;
+
+    for (int i = 0; i < world->bodyCount; i++) {
+        queue->body_time[i] = queue->clock;
+        queue->collisions[i] = 0;
+        file_body(queue, i, cell_at(queue, world->bodies[i].x, world->bodies[i].y));
+    }
+    for (int i = 0; i < world->bodyCount; i++) {
+        predict(world, i, queue->clock);
+    }
+}
+
+void step_events(World* world, float dt) {
+    EventQueue* queue = &world->events;
+
+    // Hard disks never rest
+    for (int i = 0; i < world->bodyCount; i++) {
+        world->bodies[i].sleeping = false;
+        world->bodies[i].sleep_time = 0;
+    }
+
+    if (queue->body_count != world->bodyCount) {
+        prime_queue(world);
+    } else {
+        // Bodies moved or pushed since the last step need new predictions
+        for (int i = 0; i < world->bodyCount; i++) {
+            const Body* body = &world->bodies[i];
+            const float* synced = &queue->synced[4 * i];
+            if (body->x == synced[0] && body->y == synced[1] &&
+                body->vx == synced[2] && body->vy == synced[3]) continue;
+            unfile_body(queue, i);
+            file_body(queue, i, cell_at(queue, body->x, body->y));
+            queue->collisions[i]++;
+            predict(world, i, queue->clock);
+        }
+    }
+
+    double target = queue->clock + dt;
+    while (queue->count > 0 && queue->heap[0].time <= target &&
+           world->stats.events < MAX_EVENTS_PER_STEP) {
+        Event event = pop_event(queue);
+
+        // Events left over from a step that hit the event limit happen now
+        if (event.time < queue->clock) event.time = queue->clock;
+
+        // A body that has collided since already has a newer prediction queued
+        if (queue->collisions[event.a] != event.count_a) {
+            world->stats.stale_events++;
+            continue;
+        }
+        // Its partner collided first, so this body needs a new prediction
+        if (is_stale(queue, &event)) {
+            world->stats.stale_events++;
+            advance_body(world, event.a, event.time);
+            predict(world, event.a, event.time);
+            continue;
+        }
+
+        advance_body(world, event.a, event.time);
+        if (event.b == EVENT_CELL_CROSSING) {
+            // Only the body's filing changes, so predictions involving it stand
+            unfile_body(queue, event.a);
+            file_body(queue, event.a, event.count_b);
+            predict(world, event.a, event.time);
+            continue;
+        }
+
+        if (event.b >= 0) advance_body(world, event.b, event.time);
+        collide(world, &event);
+        world->stats.events++;
+
+        queue->collisions[event.a]++;
+        predict(world, event.a, event.time);
+        if (event.b >= 0) {
+            queue->collisions[event.b]++;
+            predict(world, event.b, event.time);
+        }
+    }
+
+    if (queue->count > EVENTS_PER_BODY * world->bodyCount) {
+        compact_queue(queue);
+    }
+
+    // Bring every body up to the end of the step for drawing and the next step
+    for (int i = 0; i < world->bodyCount; i++) {
+        advance_body(world, i, target);
+        record_sync(queue, &world->bodies[i], i);
+    }
+    queue->clock = target;
+}
+
+void free_events(EventQueue* queue) {
+    free(queue->heap);
+    free(queue->body_time);
+    free(queue->collisions);
+    free(queue->synced);
+    free(queue->cell_of);
+    free(queue->next_in_cell);
+    free(queue->prev_in_cell);
+    free(queue->cell_head);
+    *queue = (EventQueue){0};
+}
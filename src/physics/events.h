@@ -0,0 +1,15 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "../core/types.h"
+
+// Advance the world by dt as a hard-disk system: bodies fly freely between
+// exactly predicted collisions with each other and the walls, which are
+// resolved in time order with the usual restitution response. Forces and the
+// world's field are not integrated.
+void step_events(World* world, float dt);
+
+// Release the event queue
+void free_events(EventQueue* queue);
+
+#endif // EVENTS_H
@@ -0,0 +1,250 @@
+#include "field.h"
+#include "particle_mesh.h"
+#include "physics.h"
+#include "../utils/thread_pool.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Nodes a traversal can have pending: three siblings per level plus the root
+#define TRAVERSAL_STACK (3 * QUADTREE_MAX_DEPTH + 4)
+
+static float source_strength(const World* world, const Body* body) {
+    return world->field == FIELD_ELECTROSTATIC ? body->charge : body->mass;
+}
+
+static int add_node(QuadTree* tree, float cx, float cy, float half) {
+    if (tree->count == tree->capacity) {
+        tree->capacity = tree->capacity ? tree->capacity * 2 : 64;
+        tree->nodes = realloc(tree->nodes, sizeof(QuadNode) * tree->capacity);
+    }
+    tree->nodes[tree->count] = (QuadNode){
+        .cx = cx, .cy = cy, .half = half,
+        .child = -1, .body = -1
+    };
+    return tree->count++;
+}
+
+// Children are stored in quadrant order: bit 0 set for the right half, bit 1
+// for the bottom half
+static int quadrant(const QuadNode* node, float x, float y) {
+    return (x >= node->cx ? 1 : 0) | (y >= node->cy ? 2 : 0);
+}
+
+static void split_node(QuadTree* tree, int index) {
+    float half = tree->nodes[index].half / 2;
+    float cx = tree->nodes[index].cx;
+    float cy = tree->nodes[index].cy;
+    int first = add_node(tree, cx - half, cy - half, half);
+    add_node(tree, cx + half, cy - half, half);
+    add_node(tree, cx - half, cy + half, half);
+    add_node(tree, cx + half, cy + half, half);
+    tree->nodes[index].child = first;
+}
+
+// Bodies meeting in a cell at the depth limit share it as a chain
+static void insert_body(QuadTree* tree, const Body* bodies, int body) {
+    int index = 0;
+    tree->next[body] = -1;
+    for (int depth = 0; ; depth++) {
+        QuadNode* node = &tree->nodes[index];
+        if (node->child >= 0) {
+            index = node->child + quadrant(node, bodies[body].x, bodies[body].y);
+            continue;
+        }
+        if (node->body < 0 || depth >= QUADTREE_MAX_DEPTH) {
+            tree->next[body] = node->body;
+            node->body = body;
+            return;
+        }
+
+        // Occupied leaf: push its body down a level and keep descending
+        int resident = node->body;
+        node->body = -1;
+        split_node(tree, index);
+        node = &tree->nodes[index];
+        int slot = node->child + quadrant(node, bodies[resident].x, bodies[resident].y);
+        tree->nodes[slot].body = resident;
+    }
+}
+
+static void build_tree(World* world) {
+    QuadTree* tree = &world->tree;
+    tree->count = 0;
+    if (world->bodyCount == 0) return;
+    if (world->bodyCount > tree->next_capacity) {
+        tree->next = realloc(tree->next, sizeof(int) * world->bodyCount);
+        tree->next_capacity = world->bodyCount;
+    }
+
+    float minX = world->bodies[0].x, maxX = minX;
+    float minY = world->bodies[0].y, maxY = minY;
+    for (int i = 1; i < world->bodyCount; i++) {
+        const Body* body = &world->bodies[i];
+        minX = fminf(minX, body->x);
+        maxX = fmaxf(maxX, body->x);
+        minY = fminf(minY, body->y);
+        maxY = fmaxf(maxY, body->y);
+    }
+    float half = fmaxf(maxX - minX, maxY - minY) / 2 + 1;
+    add_node(tree, (minX + maxX) / 2, (minY + maxY) / 2, half);
+
+    for (int i = 0; i < world->bodyCount; i++) {
+        insert_body(tree, world->bodies, i);
+    }
+
+    // Children follow their parents, so a reverse pass sums bottom up
+    for (int i = tree->count - 1; i >= 0; i--) {
+        QuadNode* node = &tree->nodes[i];
+        node->strength = 0;
+        node->weight = 0;
+        node->x = 0;
+        node->y = 0;
+
+        if (node->child >= 0) {
+            for (int c = 0; c < 4; c++) {
+                const QuadNode* child = &tree->nodes[node->child + c];
+                node->strength += child->strength;
+                node->weight += child->weight;
+                node->x += child->x * child->weight;
+                node->y += child->y * child->weight;
+            }
+        } else {
+            for (int b = node->body; b >= 0; b = tree->next[b]) {
+                const Body* body = &world->bodies[b];
+                float strength = source_strength(world, body);
+                node->strength += strength;
+                node->weight += fabsf(strength);
+                node->x += body->x * fabsf(strength);
+                node->y += body->y * fabsf(strength);
+            }
+        }
+
+        if (node->weight > 0) {
+            node->x /= node->weight;
+            node->y /= node->weight;
+        } else {
+            node->x = node->cx;
+            node->y = node->cy;
+        }
+    }
+    world->stats.tree_nodes = tree->count;
+}
+
+// Field at (x, y) from every source except the body itself: the sum of
+// strength * offset / (distance^2 + softening^2)^(3/2)
+static void field_at(const World* world, int self, float x, float y, float* fx, float* fy) {
+    const QuadTree* tree = &world->tree;
+    float theta = world->opening_angle;
+    float softening = FIELD_SOFTENING * FIELD_SOFTENING;
+    int stack[TRAVERSAL_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    *fx = 0;
+    *fy = 0;
+
+    while (top > 0) {
+        const QuadNode* node = &tree->nodes[stack[--top]];
+        if (node->weight == 0) continue;
+
+        float dx = node->x - x;
+        float dy = node->y - y;
+        float distSq = dx * dx + dy * dy;
+
+        // Open cells that look too large from here. A cell around the point
+        // may hold the body itself, so it is always opened.
+        if (node->child >= 0) {
+            float size = 2 * node->half;
+            bool inside = fabsf(x - node->cx) <= node->half && fabsf(y - node->cy) <= node->half;
+            if (inside || size * size >= theta * theta * distSq) {
+                for (int c = 0; c < 4; c++) stack[top++] = node->child + c;
+                continue;
+            }
+        } else if (node->body == self || tree->next[node->body] >= 0) {
+            // Leaves holding the body itself, or a chain, sum their bodies one by one
+            for (int b = node->body; b >= 0; b = tree->next[b]) {
+                if (b == self) continue;
+                const Body* source = &world->bodies[b];
+                float bx = source->x - x;
+                float by = source->y - y;
+                float r2 = bx * bx + by * by + softening;
+                float s = source_strength(world, source) / (r2 * sqrtf(r2));
+                *fx += bx * s;
+                *fy += by * s;
+            }
+            continue;
+        }
+
+        float r2 = distSq + softening;
+        float s = node->strength / (r2 * sqrtf(r2));
+        *fx += dx * s;
+        *fy += dy * s;
+    }
+}
+
+void set_field_acceleration(const World* world, Body* body, float fx, float fy) {
+    // Masses attract; like charges repel
+    float scale = world->field == FIELD_ELECTROSTATIC
+        ? -world->field_constant * body->charge * body->inv_mass
+        : world->field_constant;
+    float ax = fx * scale;
+    float ay = fy * scale;
+
+    // A sleeping body keeps the acceleration it fell asleep under until the
+    // change would carry it past the resting energy within the time it took
+    // to fall asleep. Its island follows through wake_islands.
+    if (body->sleeping) {
+        float dax = ax - body->ax;
+        float day = ay - body->ay;
+        float t = world->time_to_sleep;
+        if (body->mass * (dax * dax + day * day) * t * t <= 2 * world->sleep_energy_threshold) return;
+        body->sleeping = false;
+        body->sleep_time = 0;
+    }
+    body->ax = ax;
+    body->ay = ay;
+}
+
+static void field_task(void* context, int begin, int end) {
+    World* world = context;
+    for (int i = begin; i < end; i++) {
+        Body* body = &world->bodies[i];
+        if (body->type != BODY_DYNAMIC) continue;
+
+        float fx, fy;
+        field_at(world, i, body->x, body->y, &fx, &fy);
+        set_field_acceleration(world, body, fx, fy);
+    }
+}
+
+void apply_field(World* world) {
+    if (world->field == FIELD_UNIFORM || world->field == FIELD_NONE) {
+        float gravity = world->field == FIELD_UNIFORM ? world->gravity : 0;
+        for (int i = 0; i < world->bodyCount; i++) {
+            Body* body = &world->bodies[i];
+            if (body->sleeping || body->type != BODY_DYNAMIC) continue;
+            body->ax = 0;
+            body->ay = gravity;
+        }
+        return;
+    }
+
+    // Each body only writes its own acceleration, so bodies split freely across threads
+    ThreadPool* pool = world->bodyCount >= FIELD_PARALLEL_BODIES ? world_thread_pool(world) : NULL;
+
+    if (world->field_method == FIELD_PARTICLE_MESH) {
+        solve_particle_mesh(world, pool);
+        return;
+    }
+
+    build_tree(world);
+    thread_pool_run(pool, world->bodyCount, field_task, world);
+}
+
+void free_field(World* world) {
+    free(world->tree.nodes);
+    free(world->tree.next);
+    world->tree = (QuadTree){0};
+    free_particle_mesh(&world->mesh);
+    destroy_thread_pool(world->pool);
+    world->pool = NULL;
+}
@@ -0,0 +1,20 @@
+#ifndef FIELD_H
+#define FIELD_H
+
+#include "../core/types.h"
+
+// Reset each awake body's acceleration to the world's force field at the
+// current positions: uniform gravity, or mutual gravitation or electrostatics
+// approximated with a Barnes-Hut tree rebuilt for the call or a particle mesh.
+// Mutual fields also sample sleeping bodies, since other bodies move them.
+void apply_field(World* world);
+
+// Scale a mutual field sample at a dynamic body into its acceleration. A
+// sleeping body is only woken, and updated, once the field has changed enough
+// to set it moving.
+void set_field_acceleration(const World* world, Body* body, float fx, float fy);
+
+// Release the tree, mesh and thread pool used for mutual forces
+void free_field(World* world);
+
+#endif // FIELD_H
@@ -0,0 +1,134 @@
+#include "islands.h"
+#include <stdlib.h>
+
+static void reserve_islands(IslandGraph* islands, int count) {
+    if (count <= islands->capacity) return;
+    islands->parent = realloc(islands->parent, sizeof(int) * count);
+    islands->min_sleep_time = realloc(islands->min_sleep_time, sizeof(float) * count);
+    islands->sleep_ids = realloc(islands->sleep_ids, sizeof(int) * count);
+    islands->wake_ids = realloc(islands->wake_ids, sizeof(int) * count);
+    islands->capacity = count;
+}
+
+static int find_root(int* parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];  // Path halving
+        i = parent[i];
+    }
+    return i;
+}
+
+static int compare_ids(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+void wake_islands(World* world) {
+    IslandGraph* islands = &world->islands;
+    reserve_islands(islands, world->bodyCount);
+
+    // An awake body still carrying an island id was woken on its own by a
+    // contact, apply_force or apply_impulse
+    int wakeCount = 0;
+    for (int i = 0; i < world->bodyCount; i++) {
+        Body* body = &world->bodies[i];
+        if (!body->sleeping && body->island != 0) {
+            islands->wake_ids[wakeCount++] = body->island;
+        }
+    }
+    if (wakeCount == 0) return;
+
+    qsort(islands->wake_ids, wakeCount, sizeof(int), compare_ids);
+    for (int i = 0; i < world->bodyCount; i++) {
+        Body* body = &world->bodies[i];
+        if (body->island == 0) continue;
+        if (bsearch(&body->island, islands->wake_ids, wakeCount, sizeof(int), compare_ids)) {
+            body->sleeping = false;
+            body->sleep_time = 0;
+            body->island = 0;
+        }
+    }
+}
+
+void update_islands(World* world, float dt) {
+    IslandGraph* islands = &world->islands;
+    reserve_islands(islands, world->bodyCount);
+    int* parent = islands->parent;
+
+    // Advance each awake body's rest timer. Only dynamic bodies fall asleep.
+    int sleepingCount = 0;
+    for (int i = 0; i < world->bodyCount; i++) {
+        Body* body = &world->bodies[i];
+        parent[i] = i;
+        if (body->sleeping) {
+            sleepingCount++;
+            continue;
+        }
+        if (body->type != BODY_DYNAMIC) continue;
+
+        float ke = 0.5f * body->mass * (body->vx * body->vx + body->vy * body->vy);
+        body->sleep_time = ke < world->sleep_energy_threshold ? body->sleep_time + dt : 0;
+    }
+
+    // Join touching bodies; contacts with sleeping bodies have already woken
+    // them, and walls, static and kinematic bodies don't link islands together
+    for (int i = 0; i < world->contacts.count; i++) {
+        Contact* contact = &world->contacts.contacts[i];
+        if (contact->b < 0) continue;
+        if (world->bodies[contact->a].type != BODY_DYNAMIC) continue;
+        if (world->bodies[contact->b].type != BODY_DYNAMIC) continue;
+        int ra = find_root(parent, contact->a);
+        int rb = find_root(parent, contact->b);
+        if (ra != rb) {
+            parent[ra] = rb;
+        }
+    }
+
+    // An island can only sleep once every member has rested long enough
+    for (int i = 0; i < world->bodyCount; i++) {
+        if (world->bodies[i].sleeping || world->bodies[i].type != BODY_DYNAMIC) continue;
+        if (parent[i] == i) {
+            islands->min_sleep_time[i] = world->bodies[i].sleep_time;
+            islands->sleep_ids[i] = 0;
+            world->stats.islands++;
+        }
+    }
+    for (int i = 0; i < world->bodyCount; i++) {
+        if (world->bodies[i].sleeping || world->bodies[i].type != BODY_DYNAMIC) continue;
+        int root = find_root(parent, i);
+        if (world->bodies[i].sleep_time < islands->min_sleep_time[root]) {
+            islands->min_sleep_time[root] = world->bodies[i].sleep_time;
+        }
+    }
+
+    // Give each island that falls asleep a fresh id so it can be woken as a whole
+    for (int i = 0; i < world->bodyCount; i++) {
+        if (world->bodies[i].sleeping || world->bodies[i].type != BODY_DYNAMIC || parent[i] != i) continue;
+        if (islands->min_sleep_time[i] >= world->time_to_sleep) {
+            islands->sleep_ids[i] = ++islands->next_id;
+        }
+    }
+    for (int i = 0; i < world->bodyCount; i++) {
+        Body* body = &world->bodies[i];
+        if (body->sleeping || body->type != BODY_DYNAMIC) continue;
+        int id = islands->sleep_ids[find_root(parent, i)];
+        if (id != 0) {
+            body->sleeping = true;
+            body->island = id;
+            body->vx = 0;
+            body->vy = 0;
+            sleepingCount++;
+        }
+    }
+
+    world->stats.sleeping_bodies = sleepingCount;
+}
+
+void free_islands(IslandGraph* islands) {
+    free(islands->parent);
+    free(islands->min_sleep_time);
+    free(islands->sleep_ids);
+    free(islands->wake_ids);
+    *islands = (IslandGraph){0};
+}
@@ -0,0 +1,16 @@
+#ifndef ISLANDS_H
+#define ISLANDS_H
+
+#include "../core/types.h"
+
+// Wake every sleeping island that has a member which was woken individually
+void wake_islands(World* world);
+
+// Group awake bodies into islands through this step's contacts and put
+// islands that have rested for long enough to sleep
+void update_islands(World* world, float dt);
+
+// Release the island graph's storage
+void free_islands(IslandGraph* islands);
+
+#endif // ISLANDS_H
@@ -0,0 +1,170 @@
+#include "neighbors.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void reserve_bodies(NeighborList* list, int count) {
+    if (count <= list->body_capacity) return;
+    list->start = realloc(list->start, sizeof(int) * (count + 1));
+    list->anchor = realloc(list->anchor, sizeof(float) * 2 * count);
+    list->cell_bodies = realloc(list->cell_bodies, sizeof(int) * count);
+    list->body_capacity = count;
+}
+
+static void push_pair(NeighborList* list, int body) {
+    if (list->pair_count == list->pair_capacity) {
+        list->pair_capacity = list->pair_capacity ? list->pair_capacity * 2 : 256;
+        list->pairs = realloc(list->pairs, sizeof(int) * list->pair_capacity);
+    }
+    list->pairs[list->pair_count++] = body;
+}
+
+static int clamp_index(float value, int count) {
+    if (!(value >= 0)) return 0;
+    return value >= count ? count - 1 : (int)value;
+}
+
+// Bucket bodies into a grid whose cells are as wide as the longest pair
+// reach, so each body only needs checking against its own and adjacent cells
+static void build_lists(World* world, float skin) {
+    NeighborList* list = &world->neighbors;
+    int n = world->bodyCount;
+    reserve_bodies(list, n);
+    list->pair_count = 0;
+    list->body_count = n;
+    list->skin = skin;
+    list->rebuilds++;
+    world->stats.neighbor_rebuilds++;
+    list->start[0] = 0;
+    list->mean_gap = 0;
+    if (n == 0) return;
+
+    float minX = world->bodies[0].x, maxX = minX;
+    float minY = world->bodies[0].y, maxY = minY;
+    float maxRadius = 0;
+    for (int i = 0; i < n; i++) {
+        const Body* body = &world->bodies[i];
+        minX = fminf(minX, body->x);
+        maxX = fmaxf(maxX, body->x);
+        minY = fminf(minY, body->y);
+        maxY = fmaxf(maxY, body->y);
+        maxRadius = fmaxf(maxRadius, body->radius);
+        list->anchor[2 * i] = body->x;
+        list->anchor[2 * i + 1] = body->y;
+    }
+
+    // Widen cells until the grid is no larger than a few cells per body
+    float cellSize = fmaxf(2 * maxRadius + skin, 1);
+    int cols, rows;
+    for (;;) {
+        cols = (int)((maxX - minX) / cellSize) + 1;
+        rows = (int)((maxY - minY) / cellSize) + 1;
+        if ((long)cols * rows <= 4L * n + 16) break;
+        cellSize *= 2;
+    }
+
+    int cells = cols * rows;
+    if (cells + 1 > list->cell_capacity) {
+        list->cell_start = realloc(list->cell_start, sizeof(int) * (cells + 1));
+        list->cell_capacity = cells + 1;
+    }
+
+    // Counting sort of bodies by cell, keeping index order within a cell
+    memset(list->cell_start, 0, sizeof(int) * (cells + 1));
+    for (int i = 0; i < n; i++) {
+        int cx = clamp_index((world->bodies[i].x - minX) / cellSize, cols);
+        int cy = clamp_index((world->bodies[i].y - minY) / cellSize, rows);
+        list->cell_start[cy * cols + cx + 1]++;
+    }
+    for (int c = 0; c < cells; c++) {
+        list->cell_start[c + 1] += list->cell_start[c];
+    }
+    for (int i = 0; i < n; i++) {
+        int cx = clamp_index((world->bodies[i].x - minX) / cellSize, cols);
+        int cy = clamp_index((world->bodies[i].y - minY) / cellSize, rows);
+        list->cell_bodies[list->cell_start[cy * cols + cx]++] = i;
+    }
+    // Filling advanced each start to the next cell's; shift them back
+    for (int c = cells; c > 0; c--) {
+        list->cell_start[c] = list->cell_start[c - 1];
+    }
+    list->cell_start[0] = 0;
+
+    for (int i = 0; i < n; i++) {
+        const Body* a = &world->bodies[i];
+        int cx = clamp_index((a->x - minX) / cellSize, cols);
+        int cy = clamp_index((a->y - minY) / cellSize, rows);
+        int first = list->pair_count;
+
+        for (int y = cy > 0 ? cy - 1 : 0; y <= cy + 1 && y < rows; y++) {
+            for (int x = cx > 0 ? cx - 1 : 0; x <= cx + 1 && x < cols; x++) {
+                int cell = y * cols + x;
+                for (int k = list->cell_start[cell]; k < list->cell_start[cell + 1]; k++) {
+                    int j = list->cell_bodies[k];
+                    if (j <= i) continue;
+                    const Body* b = &world->bodies[j];
+                    // At least one of the pair has to respond to a contact
+                    if (a->type != BODY_DYNAMIC && b->type != BODY_DYNAMIC) continue;
+                    float dx = b->x - a->x;
+                    float dy = b->y - a->y;
+                    float reach = a->radius + b->radius + skin;
+                    if (dx * dx + dy * dy < reach * reach) push_pair(list, j);
+                }
+            }
+        }
+
+        // Keep each list ascending so pairs come out in the same order as an
+        // all-pairs sweep
+        for (int k = first + 1; k < list->pair_count; k++) {
+            int j = list->pairs[k];
+            int m = k;
+            for (; m > first && list->pairs[m - 1] > j; m--) {
+                list->pairs[m] = list->pairs[m - 1];
+            }
+            list->pairs[m] = j;
+        }
+        list->start[i + 1] = list->pair_count;
+    }
+
+    // How far apart in memory the bodies of each pair are
+    double gap = 0;
+    for (int i = 0; i < n; i++) {
+        for (int k = list->start[i]; k < list->start[i + 1]; k++) {
+            gap += list->pairs[k] - i;
+        }
+    }
+    if (list->pair_count > 0) list->mean_gap = (float)(gap / list->pair_count);
+}
+
+void update_neighbor_list(World* world, float margin) {
+    NeighborList* list = &world->neighbors;
+    list->steps++;
+
+    // Two bodies each moving half the skin toward each other could close it
+    bool rebuild = list->body_count != world->bodyCount || list->rebuilds == 0;
+    if (!rebuild) {
+        float maxMoveSq = 0;
+        for (int i = 0; i < world->bodyCount; i++) {
+            float dx = world->bodies[i].x - list->anchor[2 * i];
+            float dy = world->bodies[i].y - list->anchor[2 * i + 1];
+            maxMoveSq = fmaxf(maxMoveSq, dx * dx + dy * dy);
+        }
+        rebuild = 2 * sqrtf(maxMoveSq) + margin > list->skin;
+    }
+    if (rebuild) {
+        build_lists(world, world->neighbor_skin + margin);
+    }
+
+    world->stats.neighbor_pairs = list->pair_count;
+    world->stats.neighbor_gap = list->mean_gap;
+    world->stats.steps_per_rebuild = (float)list->steps / list->rebuilds;
+}
+
+void free_neighbor_list(NeighborList* list) {
+    free(list->start);
+    free(list->pairs);
+    free(list->anchor);
+    free(list->cell_start);
+    free(list->cell_bodies);
+    *list = (NeighborList){0};
+}
@@ -0,0 +1,14 @@
+#ifndef NEIGHBORS_H
+#define NEIGHBORS_H
+
+#include "../core/types.h"
+
+// Make sure the neighbor lists hold every pair that can be within margin of
+// touching now. The lists are rebuilt only once some body has moved far
+// enough since the last rebuild to use up the skin.
+void update_neighbor_list(World* world, float margin);
+
+// Release the lists
+void free_neighbor_list(NeighborList* list);
+
+#endif // NEIGHBORS_H
@@ -0,0 +1,198 @@
+#include "particle_mesh.h"
+#include "field.h"
+#include "../utils/fft.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    World* world;
+    ParticleMesh* mesh;
+    int parts;              // Partial grids the bodies are deposited into
+} MeshJob;
+
+// Cloud-in-cell stencil: the four cells around a point and their weights
+typedef struct {
+    int x0, x1, y0, y1;
+    float wx, wy;           // Weight of the x1 column and y1 row
+} Stencil;
+
+static int clamp_cell(int i, int size) {
+    return i < 0 ? 0 : i >= size ? size - 1 : i;
+}
+
+static Stencil stencil_at(const ParticleMesh* mesh, float x, float y) {
+    float gx = x / mesh->cell - 0.5f;
+    float gy = y / mesh->cell - 0.5f;
+    float fx = floorf(gx);
+    float fy = floorf(gy);
+    return (Stencil){
+        .x0 = clamp_cell((int)fx, mesh->size),
+        .x1 = clamp_cell((int)fx + 1, mesh->size),
+        .y0 = clamp_cell((int)fy, mesh->size),
+        .y1 = clamp_cell((int)fy + 1, mesh->size),
+        .wx = gx - fx,
+        .wy = gy - fy
+    };
+}
+
+// Size the grids for size cells across extent and transform the potential
+// kernel, which only changes with the grid
+static void prepare_mesh(ParticleMesh* mesh, int size, float extent, ThreadPool* pool) {
+    float cell = extent / size;
+    if (mesh->size == size && mesh->cell == cell) return;
+
+    free_particle_mesh(mesh);
+    int padded = 2 * size;
+    mesh->size = size;
+    mesh->cell = cell;
+    mesh->density = malloc(sizeof(float) * 2 * padded * padded);
+    mesh->kernel = malloc(sizeof(float) * 2 * padded * padded);
+    mesh->field = malloc(sizeof(float) * 2 * size * size);
+
+    // Offsets past the grid's own extent wrap to negative separations
+    float softening = FIELD_SOFTENING * FIELD_SOFTENING;
+    for (int j = 0; j < padded; j++) {
+        float dy = (j < size ? j : j - padded) * cell;
+        for (int i = 0; i < padded; i++) {
+            float dx = (i < size ? i : i - padded) * cell;
+            float* k = &mesh->kernel[2 * (j * padded + i)];
+            k[0] = 1.0f / sqrtf(dx * dx + dy * dy + softening);
+            k[1] = 0;
+        }
+    }
+    fft_2d(mesh->kernel, padded, false, pool);
+}
+
+// Deposit bodies [begin, end) onto grid, whose cells are stride floats
+// apart and rows width cells apart
+static void deposit_bodies(World* world, const ParticleMesh* mesh, float* grid, int width, int stride,
+                           int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        const Body* body = &world->bodies[i];
+        float strength = world->field == FIELD_ELECTROSTATIC ? body->charge : body->mass;
+        Stencil s = stencil_at(mesh, body->x, body->y);
+        grid[stride * (s.y0 * width + s.x0)] += strength * (1 - s.wx) * (1 - s.wy);
+        grid[stride * (s.y0 * width + s.x1)] += strength * s.wx * (1 - s.wy);
+        grid[stride * (s.y1 * width + s.x0)] += strength * (1 - s.wx) * s.wy;
+        grid[stride * (s.y1 * width + s.x1)] += strength * s.wx * s.wy;
+    }
+}
+
+// Each part deposits its share of the bodies onto its own grid
+static void deposit_task(void* context, int begin, int end) {
+    MeshJob* job = context;
+    int size = job->mesh->size;
+    int count = job->world->bodyCount;
+    for (int p = begin; p < end; p++) {
+        float* grid = job->mesh->partial + (size_t)p * size * size;
+        memset(grid, 0, sizeof(float) * size * size);
+        deposit_bodies(job->world, job->mesh, grid, size, 1,
+            (int)((long)count * p / job->parts), (int)((long)count * (p + 1) / job->parts));
+    }
+}
+
+// Sum the parts' grids into the density, always in part order
+static void sum_parts_task(void* context, int begin, int end) {
+    ParticleMesh* mesh = ((MeshJob*)context)->mesh;
+    int parts = ((MeshJob*)context)->parts;
+    int size = mesh->size;
+    int padded = 2 * size;
+    for (int y = begin; y < end; y++) {
+        for (int x = 0; x < size; x++) {
+            float sum = 0;
+            for (int p = 0; p < parts; p++) {
+                sum += mesh->partial[(size_t)p * size * size + y * size + x];
+            }
+            mesh->density[2 * (y * padded + x)] = sum;
+        }
+    }
+}
+
+// Float sums depend on how they are split, so the bodies are always split
+// into the same number of parts, however many threads share them, and the
+// density comes out the same on any number of threads
+static void deposit(World* world, ParticleMesh* mesh, ThreadPool* pool) {
+    int padded = 2 * mesh->size;
+    memset(mesh->density, 0, sizeof(float) * 2 * padded * padded);
+
+    MeshJob job = { world, mesh, MESH_DEPOSIT_PARTS };
+    if (mesh->partial_count < job.parts) {
+        free(mesh->partial);
+        mesh->partial = malloc(sizeof(float) * mesh->size * mesh->size * job.parts);
+        mesh->partial_count = job.parts;
+    }
+    thread_pool_run(pool, job.parts, deposit_task, &job);
+    thread_pool_run(pool, mesh->size, sum_parts_task, &job);
+}
+
+// Field is the gradient of the summed strength / distance potential, taken
+// with central differences inside the grid and one-sided ones at its edge
+static void difference_task(void* context, int begin, int end) {
+    ParticleMesh* mesh = ((MeshJob*)context)->mesh;
+    int size = mesh->size;
+    int padded = 2 * size;
+    for (int y = begin; y < end; y++) {
+        int up = y > 0 ? y - 1 : y;
+        int down = y < size - 1 ? y + 1 : y;
+        for (int x = 0; x < size; x++) {
+            int left = x > 0 ? x - 1 : x;
+            int right = x < size - 1 ? x + 1 : x;
+            float* f = &mesh->field[2 * (y * size + x)];
+            f[0] = (mesh->density[2 * (y * padded + right)] - mesh->density[2 * (y * padded + left)])
+                 / ((right - left) * mesh->cell);
+            f[1] = (mesh->density[2 * (down * padded + x)] - mesh->density[2 * (up * padded + x)])
+                 / ((down - up) * mesh->cell);
+        }
+    }
+}
+
+static void interpolate_task(void* context, int begin, int end) {
+    World* world = ((MeshJob*)context)->world;
+    ParticleMesh* mesh = ((MeshJob*)context)->mesh;
+    int size = mesh->size;
+    for (int i = begin; i < end; i++) {
+        Body* body = &world->bodies[i];
+        if (body->type != BODY_DYNAMIC) continue;
+
+        Stencil s = stencil_at(mesh, body->x, body->y);
+        const float* f00 = &mesh->field[2 * (s.y0 * size + s.x0)];
+        const float* f10 = &mesh->field[2 * (s.y0 * size + s.x1)];
+        const float* f01 = &mesh->field[2 * (s.y1 * size + s.x0)];
+        const float* f11 = &mesh->field[2 * (s.y1 * size + s.x1)];
+        float fx = (f00[0] * (1 - s.wx) + f10[0] * s.wx) * (1 - s.wy)
+                 + (f01[0] * (1 - s.wx) + f11[0] * s.wx) * s.wy;
+        float fy = (f00[1] * (1 - s.wx) + f10[1] * s.wx) * (1 - s.wy)
+                 + (f01[1] * (1 - s.wx) + f11[1] * s.wx) * s.wy;
+        set_field_acceleration(world, body, fx, fy);
+    }
+}
+
+void solve_particle_mesh(World* world, ThreadPool* pool) {
+    ParticleMesh* mesh = &world->mesh;
+    prepare_mesh(mesh, world->mesh_size, fmaxf(world->width, world->height), pool);
+    int padded = 2 * mesh->size;
+
+    deposit(world, mesh, pool);
+    fft_2d(mesh->density, padded, false, pool);
+    for (int i = 0; i < padded * padded; i++) {
+        float* d = &mesh->density[2 * i];
+        const float* k = &mesh->kernel[2 * i];
+        float re = d[0] * k[0] - d[1] * k[1];
+        d[1] = d[0] * k[1] + d[1] * k[0];
+        d[0] = re;
+    }
+    fft_2d(mesh->density, padded, true, pool);
+
+    MeshJob job = { world, mesh, 1 };
+    thread_pool_run(pool, mesh->size, difference_task, &job);
+    thread_pool_run(pool, world->bodyCount, interpolate_task, &job);
+}
+
+void free_particle_mesh(ParticleMesh* mesh) {
+    free(mesh->density);
+    free(mesh->kernel);
+    free(mesh->field);
+    free(mesh->partial);
+    *mesh = (ParticleMesh){0};
+}
@@ -0,0 +1,15 @@
+#ifndef PARTICLE_MESH_H
+#define PARTICLE_MESH_H
+
+#include "../core/types.h"
+
+// Set each awake body's acceleration from the world's mutual field using a
+// particle mesh: strengths are deposited onto the grid with cloud-in-cell
+// weights, convolved with the softened 1/r potential by FFT, differenced
+// into a field and interpolated back with the same weights
+void solve_particle_mesh(World* world, ThreadPool* pool);
+
+// Release the mesh grids
+void free_particle_mesh(ParticleMesh* mesh);
+
+#endif // PARTICLE_MESH_H
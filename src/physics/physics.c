@@ -1,6 +1,75 @@
 #include "physics.h"
+#include "contacts.h"
+#include "islands.h"
+#include "ccd.h"
+#include "xpbd.h"
+#include "field.h"
+#include "neighbors.h"
+#include "events.h"
+#include "body_pool.h"
+#include "reorder.h"
+#include "state_hash.h"
+#include "../utils/thread_pool.h"
+#include "../io/trajectory.h"
+#include "../io/history.h"
+#include "../io/state_publisher.h"
+#include "../net/replication.h"
 #include <math.h>
 
+void init_physics(World* world) {
+    world->field = FIELD_UNIFORM;
+    world->field_constant = FIELD_CONSTANT;
+    world->field_method = FIELD_BARNES_HUT;
+    world->opening_angle = BARNES_HUT_THETA;
+    world->mesh_size = PARTICLE_MESH_SIZE;
+    world->threads = default_thread_count();
+    world->solver = SOLVER_IMPULSE;
+    world->substeps = XPBD_SUBSTEPS;
+    world->reorder_interval = REORDER_INTERVAL;
+    world->reorder_locality = REORDER_LOCALITY;
+    world->width = WINDOW_WIDTH;
+    world->height = WINDOW_HEIGHT;
+    world->gravity = GRAVITY;
+    world->restitution = RESTITUTION;
+    world->collision_mode = COLLISION_CCD;
+    world->position_correction = CORRECTION_SPLIT_IMPULSE;
+    world->min_iterations = MIN_COLLISION_ITERATIONS;
+    world->max_iterations = MAX_COLLISION_ITERATIONS;
+    world->penetration_tolerance = PENETRATION_TOLERANCE;
+    world->velocity_tolerance = VELOCITY_TOLERANCE;
+    world->sleep_energy_threshold = SLEEP_ENERGY_THRESHOLD;
+    world->time_to_sleep = TIME_TO_SLEEP;
+    world->neighbor_skin = NEIGHBOR_SKIN;
+}
+
+void cleanup_physics(World* world) {
+    contact_cache_free(&world->contacts);
+    free_islands(&world->islands);
+    free_ccd_sweep(&world->ccd);
+    free_xpbd(&world->xpbd);
+    free_field(world);
+    free_neighbor_list(&world->neighbors);
+    free_events(&world->events);
+    free_body_order(&world->body_order);
+    free_bodies(world);
+    if (world->recorder) {
+        stop_trajectory(world->recorder);
+        world->recorder = NULL;
+    }
+    if (world->publisher) {
+        stop_publishing(world->publisher);
+        world->publisher = NULL;
+    }
+    if (world->replication) {
+        stop_replication(world->replication);
+        world->replication = NULL;
+    }
+    if (world->history) {
+        stop_history(world->history);
+        world->history = NULL;
+    }
+}
+
 Body create_body(float x, float y, float vx, float vy, float mass, float radius, SDL_Color color) {
     return (Body){
         .x = x,
@@ -10,139 +79,456 @@ Body create_body(float x, float y, float vx, float vy, float mass, float radius,
         .ax = 0,
         .ay = 0,
         .mass = mass,
+        .inv_mass = 1 / mass,
+        .type = BODY_DYNAMIC,
         .radius = radius,
         .color = color
     };
 }
 
-void apply_force(Body* body, float fx, float fy) {
-    body->ax += fx / body->mass;
-    body->ay += fy / body->mass;
+// Wake a single body; the rest of its island follows at the start of the next step
+static void wake_body(Body* body) {
+    body->sleeping = false;
+    body->sleep_time = 0;
 }
 
-void handle_boundary_collision(Body* body) {
-    if (body->y > WINDOW_HEIGHT - body->radius) {
-        body->y = WINDOW_HEIGHT - body->radius;
-        body->vy *= -RESTITUTION;
-    }
-    if (body->y < body->radius) {
-        body->y = body->radius;
-        body->vy *= -RESTITUTION;
-    }
-    if (body->x > WINDOW_WIDTH - body->radius) {
-        body->x = WINDOW_WIDTH - body->radius;
-        body->vx *= -RESTITUTION;
+bool valid_body(const Body* body) {
+    return isfinite(body->x) && isfinite(body->y) && isfinite(body->vx) && isfinite(body->vy) &&
+           isfinite(body->charge) && isfinite(body->mass) && isfinite(body->radius) &&
+           body->mass > 0 && body->radius > 0;
+}
+
+void set_body_type(World* world, Body* body, BodyType type) {
+    body->type = type;
+    body->inv_mass = type == BODY_DYNAMIC ? 1 / body->mass : 0;
+    body->ax = 0;
+    body->ay = 0;
+    if (type == BODY_STATIC) {
+        body->vx = 0;
+        body->vy = 0;
     }
-    if (body->x < body->radius) {
-        body->x = body->radius;
-        body->vx *= -RESTITUTION;
+    wake_body(body);
+
+    // Which pairs the neighbor lists and event predictions skip depends on type
+    if (world) invalidate_body_indices(world);
+}
+
+void apply_force(Body* body, float fx, float fy) {
+    wake_body(body);
+    body->ax += fx * body->inv_mass;
+    body->ay += fy * body->inv_mass;
+}
+
+void wall_plane(const World* world, int wall, float* nx, float* ny, float* offset) {
+    switch (wall) {
+        case WALL_BOTTOM: *nx = 0;  *ny = 1;  *offset = world->height; break;
+        case WALL_TOP:    *nx = 0;  *ny = -1; *offset = 0;             break;
+        case WALL_RIGHT:  *nx = 1;  *ny = 0;  *offset = world->width;  break;
+        default:          *nx = -1; *ny = 0;  *offset = 0;             break;
     }
 }
 
-void handle_circle_collision(Body* a, Body* b) {
-    // Calculate distance between centers
+float bounce_speed(const World* world, float velAlongNormal) {
+    return velAlongNormal < -RESTITUTION_THRESHOLD ? -world->restitution * velAlongNormal : 0;
+}
+
+// Overlap of a contact at the current positions, negative while separated
+static float contact_penetration(const World* world, const Contact* contact) {
+    const Body* a = &world->bodies[contact->a];
+    if (contact->b < 0) {
+        float nx, ny, offset;
+        wall_plane(world, -1 - contact->b, &nx, &ny, &offset);
+        return a->x * nx + a->y * ny + a->radius - offset;
+    }
+    const Body* b = &world->bodies[contact->b];
     float dx = b->x - a->x;
     float dy = b->y - a->y;
-    float distance = sqrtf(dx * dx + dy * dy);
+    return a->radius + b->radius - sqrtf(dx * dx + dy * dy);
+}
+
+// Add contacts between an awake body and any walls it overlaps, is within
+// margin of, or in speculative mode is about to reach. Walls join the
+// iterative solve like any other contact so bodies stacked on them can settle.
+void handle_boundary_collision(World* world, int index, float margin) {
+    Body* body = &world->bodies[index];
+    if (body->type != BODY_DYNAMIC) return;
     
-    // Check if circles are overlapping
-    float minDist = a->radius + b->radius;
-    if (distance >= minDist) return;
+    for (int wall = 0; wall < WALL_COUNT; wall++) {
+        float nx, ny, offset;
+        wall_plane(world, wall, &nx, &ny, &offset);
+        float penetration = body->x * nx + body->y * ny + body->radius - offset;
+        
+        // Walls are static, so the body's own velocity is the approach speed
+        float velAlongNormal = -(body->vx * nx + body->vy * ny);
+        if (penetration <= -margin) {
+            if (world->collision_mode != COLLISION_SPECULATIVE) continue;
+            if (-velAlongNormal * world->step_dt <= -penetration) continue;
+            world->stats.speculative_contacts++;
+        } else if (penetration > 0) {
+            world->stats.boundary_hits++;
+        }
+        
+        Contact* contact = contact_cache_add(&world->contacts, world->bodies, index, -1 - wall);
+        contact->nx = nx;
+        contact->ny = ny;
+        contact->normal_mass = body->mass;
+        contact->bounce = bounce_speed(world, velAlongNormal);
+    }
+}
+
+void handle_circle_collision(World* world, Contact* contact) {
+    // Wall contacts have no second body; they neither move nor respond
+    Body* a = &world->bodies[contact->a];
+    Body* b = contact->b >= 0 ? &world->bodies[contact->b] : NULL;
+    float invMassA = a->inv_mass;
+    float invMassB = b ? b->inv_mass : 0;
+    PhysicsStats* stats = &world->stats;
+    
+    // Refresh the overlap from the current positions, which earlier
+    // iterations may have moved
+    float penetration = contact_penetration(world, contact);
     
-    // Normalize collision vector
-    float nx = dx / distance;
-    float ny = dy / distance;
+    // Use the normal found at the start of the step so the accumulated
+    // impulse keeps a consistent direction
+    float nx = contact->nx;
+    float ny = contact->ny;
     
     // Calculate relative velocity
-    float rvx = b->vx - a->vx;
-    float rvy = b->vy - a->vy;
+    float rvx = (b ? b->vx : 0) - a->vx;
+    float rvy = (b ? b->vy : 0) - a->vy;
     
     // Calculate relative velocity along collision normal
     float velAlongNormal = rvx * nx + rvy * ny;
     
-    // If objects are moving apart, don't resolve collision
-    if (velAlongNormal > 0) return;
+    // If objects are moving apart and there is no impulse to take back,
+    // don't resolve collision
+    if (velAlongNormal > 0 && contact->normal_impulse == 0) {
+        stats->separating_contacts++;
+        return;
+    }
+    
+    // A speculative contact that hasn't closed yet only removes the approach
+    // speed that would carry the bodies past touching during the next step
+    float target = contact->bounce;
+    if (penetration < 0 && world->collision_mode == COLLISION_SPECULATIVE) {
+        target = penetration / world->step_dt;
+    }
     
-    // Calculate restitution (bounce)
-    float e = RESTITUTION;
+    // Track the residual this iteration works on for the convergence check
+    if (target - velAlongNormal > stats->max_approach_speed) {
+        stats->max_approach_speed = target - velAlongNormal;
+    }
     
-    // Calculate impulse scalar
-    float j = -(1 + e) * velAlongNormal;
-    j /= 1/a->mass + 1/b->mass;
+    // Calculate impulse scalar towards the target, clamping the accumulated
+    // impulse so the contact can only ever push
+    float j = (target - velAlongNormal) * contact->normal_mass;
+    float oldImpulse = contact->normal_impulse;
+    contact->normal_impulse = fmaxf(oldImpulse + j, 0);
+    j = contact->normal_impulse - oldImpulse;
     
     // Apply impulse
-    float impulsex = j * nx;
-    float impulsey = j * ny;
-    
-    a->vx -= impulsex / a->mass;
-    a->vy -= impulsey / a->mass;
-    b->vx += impulsex / b->mass;
-    b->vy += impulsey / b->mass;
+    if (j != 0) {
+        float impulsex = j * nx;
+        float impulsey = j * ny;
+        
+        a->vx -= impulsex * invMassA;
+        a->vy -= impulsey * invMassA;
+        if (b) {
+            b->vx += impulsex * invMassB;
+            b->vy += impulsey * invMassB;
+        }
+        stats->impulses_applied++;
+    }
     
     // Positional correction (to prevent sinking)
     float percent = 0.8f; // penetration resolution percentage
     float slop = 0.01f;   // penetration allowance
-    float penetration = minDist - distance;
     
+    if (world->position_correction == CORRECTION_SPLIT_IMPULSE) {
+        // Drive a pseudo-velocity that closes part of the overlap this step;
+        // it moves positions once the iterations finish and never touches
+        // the real velocity, so the correction adds no energy
+        float bias = penetration > slop
+            ? SPLIT_IMPULSE_BETA * (penetration - slop) / world->step_dt : 0;
+        float pseudoAlongNormal = ((b ? b->pvx : 0) - a->pvx) * nx + ((b ? b->pvy : 0) - a->pvy) * ny;
+        
+        // Penetration the pseudo-velocity doesn't yet account for
+        float residual = (bias - pseudoAlongNormal) * world->step_dt;
+        if (residual > stats->max_penetration) {
+            stats->max_penetration = residual;
+        }
+        
+        float jp = (bias - pseudoAlongNormal) * contact->normal_mass;
+        float oldPseudo = contact->pseudo_impulse;
+        contact->pseudo_impulse = fmaxf(oldPseudo + jp, 0);
+        jp = contact->pseudo_impulse - oldPseudo;
+        
+        if (jp != 0) {
+            a->pvx -= jp * nx * invMassA;
+            a->pvy -= jp * ny * invMassA;
+            if (b) {
+                b->pvx += jp * nx * invMassB;
+                b->pvy += jp * ny * invMassB;
+            }
+            stats->position_corrections++;
+        }
+        return;
+    }
+    
+    if (penetration > stats->max_penetration) {
+        stats->max_penetration = penetration;
+    }
     if (penetration > slop) {
-        float correction = (penetration * percent) / (1/a->mass + 1/b->mass);
+        float correction = penetration * percent * contact->normal_mass;
         float cx = correction * nx;
         float cy = correction * ny;
         
-        a->x -= cx / a->mass;
-        a->y -= cy / a->mass;
-        b->x += cx / b->mass;
-        b->y += cy / b->mass;
+        a->x -= cx * invMassA;
+        a->y -= cy * invMassA;
+        if (b) {
+            b->x += cx * invMassB;
+            b->y += cy * invMassB;
+        }
+        stats->position_corrections++;
     }
 }
 
-void handle_collisions(World* world) {
-    // Check each pair of bodies for collisions
+float max_body_speed(const World* world) {
+    float maxSpeedSq = 0;
     for (int i = 0; i < world->bodyCount; i++) {
-        for (int j = i + 1; j < world->bodyCount; j++) {
-            handle_circle_collision(&world->bodies[i], &world->bodies[j]);
+        const Body* body = &world->bodies[i];
+        if (body->sleeping) continue;
+        maxSpeedSq = fmaxf(maxSpeedSq, body->vx * body->vx + body->vy * body->vy);
+    }
+    return sqrtf(maxSpeedSq);
+}
+
+ThreadPool* world_thread_pool(World* world) {
+    if (world->threads <= 1) return NULL;
+    if (thread_pool_size(world->pool) != world->threads) {
+        destroy_thread_pool(world->pool);
+        world->pool = create_thread_pool(world->threads);
+    }
+    return world->pool;
+}
+
+// Sleeping and static bodies don't move, so pairs of them need no contact
+static bool is_resting(const Body* body) {
+    return body->sleeping || body->type == BODY_STATIC;
+}
+
+void find_contacts(World* world, float margin) {
+    ContactCache* cache = &world->contacts;
+    contact_cache_begin(cache);
+    
+    // Speculative pairs can close at up to twice the top speed within the step
+    float listMargin = margin;
+    if (world->collision_mode == COLLISION_SPECULATIVE) {
+        listMargin += 2 * max_body_speed(world) * world->step_dt;
+    }
+    update_neighbor_list(world, listMargin);
+    const NeighborList* list = &world->neighbors;
+    
+    // Check each listed pair of bodies for overlap
+    for (int i = 0; i < world->bodyCount; i++) {
+        for (int k = list->start[i]; k < list->start[i + 1]; k++) {
+            int j = list->pairs[k];
+            Body* a = &world->bodies[i];
+            Body* b = &world->bodies[j];
+            if (is_resting(a) && is_resting(b)) continue;
+            world->stats.pairs_tested++;
+            
+            float dx = b->x - a->x;
+            float dy = b->y - a->y;
+            float minDist = a->radius + b->radius;
+            float reach = minDist + margin;
+            float distSq = dx * dx + dy * dy;
+            if (distSq >= reach * reach) {
+                // Keep separated pairs whose closing speed would eat the gap within a step
+                if (world->collision_mode != COLLISION_SPECULATIVE) continue;
+                float distance = sqrtf(distSq);
+                float closing = -((b->vx - a->vx) * dx + (b->vy - a->vy) * dy) / distance;
+                if (closing * world->step_dt <= distance - minDist) continue;
+                world->stats.speculative_contacts++;
+            } else if (distSq < minDist * minDist) {
+                world->stats.contacts_found++;
+            }
+            
+            // Touching an awake body wakes a sleeping one
+            if (a->sleeping) wake_body(a);
+            if (b->sleeping) wake_body(b);
+            
+            Contact* contact = contact_cache_add(cache, world->bodies, i, j);
+            
+            // Normalize collision vector, pushing coincident bodies apart vertically
+            float distance = sqrtf(distSq);
+            contact->nx = distance > 0 ? dx / distance : 0;
+            contact->ny = distance > 0 ? dy / distance : 1;
+            contact->normal_mass = 1 / (a->inv_mass + b->inv_mass);
+            
+            // Bounce target comes from the approach speed before any impulse this step
+            float velAlongNormal = (b->vx - a->vx) * contact->nx + (b->vy - a->vy) * contact->ny;
+            contact->bounce = bounce_speed(world, velAlongNormal);
+        }
+    }
+    
+    // Check awake bodies against the walls
+    for (int i = 0; i < world->bodyCount; i++) {
+        if (!world->bodies[i].sleeping) {
+            handle_boundary_collision(world, i, margin);
         }
     }
 }
 
-void update_physics(World* world, float dt) {
-    dt *= TIME_SCALE;
+static void warm_start_contacts(World* world) {
+    // Reapply last step's accumulated impulse so resting contacts start near their solution
+    for (int i = 0; i < world->contacts.count; i++) {
+        Contact* contact = &world->contacts.contacts[i];
+        if (contact->normal_impulse == 0) continue;
+        
+        Body* a = &world->bodies[contact->a];
+        float impulsex = contact->normal_impulse * contact->nx;
+        float impulsey = contact->normal_impulse * contact->ny;
+        
+        a->vx -= impulsex * a->inv_mass;
+        a->vy -= impulsey * a->inv_mass;
+        if (contact->b >= 0) {
+            Body* b = &world->bodies[contact->b];
+            b->vx += impulsex * b->inv_mass;
+            b->vy += impulsey * b->inv_mass;
+        }
+    }
+}
+
+void handle_collisions(World* world) {
+    world->stats.max_penetration = 0;
+    world->stats.max_approach_speed = 0;
+    
+    for (int i = 0; i < world->contacts.count; i++) {
+        handle_circle_collision(world, &world->contacts.contacts[i]);
+    }
+    world->stats.iterations++;
+}
+
+// Verlet integration with the contact solver between the half kicks
+static void step_impulse(World* world, float dt) {
+    // Find how far fast bodies can move before they would tunnel
+    sweep_fast_bodies(world, dt);
+    int swept = 0;
     
     for (int i = 0; i < world->bodyCount; i++) {
         Body* body = &world->bodies[i];
+        if (body->sleeping || body->type == BODY_STATIC) continue;
         
-        // Store current acceleration for Velocity Verlet
-        float old_ax = body->ax;
-        float old_ay = body->ay;
+        float travel = 1;
+        if (swept < world->ccd.count && world->ccd.indices[swept] == i) {
+            travel = world->ccd.fractions[swept++];
+        }
         
-        // Reset acceleration
-        body->ax = 0;
-        body->ay = 0;
+        // Update position (Velocity Verlet), stopping swept bodies at impact
+        body->x += (body->vx * dt + 0.5f * body->ax * dt * dt) * travel;
+        body->y += (body->vy * dt + 0.5f * body->ay * dt * dt) * travel;
         
-        // Apply gravity
-        apply_force(body, 0, body->mass * GRAVITY);
+        // First half of the velocity update, with the old acceleration
+        body->vx += 0.5f * body->ax * dt;
+        body->vy += 0.5f * body->ay * dt;
+    }
+    
+    // Evaluate the field at the new positions. Applied directly, since
+    // apply_force would wake every body.
+    apply_field(world);
+    
+    // Second half of the velocity update, with the new acceleration
+    for (int i = 0; i < world->bodyCount; i++) {
+        Body* body = &world->bodies[i];
+        if (body->sleeping || body->type == BODY_STATIC) continue;
+        body->vx += 0.5f * body->ax * dt;
+        body->vy += 0.5f * body->ay * dt;
+    }
+    
+    // Swept bodies stopped short of their impact still need its response
+    resolve_impacts(world);
+    
+    // Find this step's contacts, including walls, once and warm start them
+    find_contacts(world, 0);
+    wake_islands(world);
+    warm_start_contacts(world);
+    
+    // Handle collisions between bodies, stopping once an iteration finds
+    // nothing left to resolve or the iteration budget runs out
+    for (int i = 0; i < world->max_iterations; i++) {
+        handle_collisions(world);
         
-        // Update position (Velocity Verlet)
-        body->x += body->vx * dt + 0.5f * old_ax * dt * dt;
-        body->y += body->vy * dt + 0.5f * old_ay * dt * dt;
+        if (i + 1 >= world->min_iterations &&
+            world->stats.max_penetration <= world->penetration_tolerance &&
+            world->stats.max_approach_speed <= world->velocity_tolerance) {
+            break;
+        }
+    }
+    
+    // Move bodies by their split-impulse pseudo-velocity, then discard it
+    if (world->position_correction == CORRECTION_SPLIT_IMPULSE) {
+        for (int i = 0; i < world->bodyCount; i++) {
+            Body* body = &world->bodies[i];
+            body->x += body->pvx * dt;
+            body->y += body->pvy * dt;
+            body->pvx = 0;
+            body->pvy = 0;
+        }
+    }
+}
+
+void update_physics(World* world, float dt) {
+    dt *= TIME_SCALE;
+    world->step_dt = dt;
+    world->stats = (PhysicsStats){0};
+    
+    // Islands with a member woken since the last step wake as a whole
+    wake_islands(world);
+    
+    if (world->solver == SOLVER_EVENT) {
+        step_events(world, dt);
+    } else {
+        // Event predictions go stale under the stepping solvers
+        world->events.body_count = 0;
         
-        // Update velocity
-        body->vx += 0.5f * (old_ax + body->ax) * dt;
-        body->vy += 0.5f * (old_ay + body->ay) * dt;
+        if (world->solver == SOLVER_XPBD) {
+            step_xpbd(world, dt);
+        } else {
+            step_impulse(world, dt);
+        }
         
-        // Handle collisions with boundaries
-        handle_boundary_collision(body);
+        // Put islands that have come to rest to sleep
+        update_islands(world, dt);
     }
     
-    // Handle collisions between bodies
-    for (int i = 0; i < COLLISION_ITERATIONS; i++) {
-        handle_collisions(world);
+    // Keep bodies that are close in space close in memory, while this
+    // step's neighbor lists can still measure it
+    update_body_order(world);
+    world->stats.state_hash = hash_world_state(world);
+    
+    if (world->history) {
+        capture_history(world->history, world);
+    }
+    if (world->recorder) {
+        record_trajectory(world->recorder, world, dt);
+    }
+    if (world->publisher) {
+        publish_state(world->publisher, world, dt);
+    }
+    if (world->replication) {
+        replicate_state(world->replication, world, dt);
     }
 }
 
 void apply_impulse(Body* body, float ix, float iy) {
-    body->vx += ix / body->mass;
-    body->vy += iy / body->mass;
+    wake_body(body);
+    body->vx += ix * body->inv_mass;
+    body->vy += iy * body->inv_mass;
+}
+
+PhysicsStats get_physics_stats(const World* world) {
+    return world->stats;
 }
 
 Body* get_body_at_position(World* world, int x, int y) {
@@ -3,21 +3,61 @@
 
 #include "../core/types.h"
 
+// Set the world's solver parameters to their defaults
+void init_physics(World* world);
+
+// Release the solver's storage and the bodies
+void cleanup_physics(World* world);
+
 // Initialize a new physics body with given parameters
 Body create_body(float x, float y, float vx, float vy, float mass, float radius, SDL_Color color);
 
-// Update physics for all bodies in the world
+// Whether a body's values can be simulated: a finite position, velocity and
+// charge, and a positive finite mass and radius. Scenes and snapshots hold
+// the bodies they load to this.
+bool valid_body(const Body* body);
+
+// Update physics for all bodies in the world. Bodies may be reordered at the
+// end of the step, so hold handles rather than indices across calls.
 void update_physics(World* world, float dt);
 
-// Handle collisions between bodies (to be implemented)
+// Speed of the fastest awake body
+float max_body_speed(const World* world);
+
+// Pool for parallel loops over the world's bodies, recreated when
+// world->threads changes, or NULL when running on a single thread
+ThreadPool* world_thread_pool(World* world);
+
+// Find the contacts between bodies and against the walls for this step into
+// the world's contact cache from the neighbor lists, keeping separated pairs
+// within margin of touching
+void find_contacts(World* world, float margin);
+
+// Outward normal and offset of a boundary wall's plane
+void wall_plane(const World* world, int wall, float* nx, float* ny, float* offset);
+
+// Bounce target for a contact approaching at the given normal speed; slow
+// contacts rest instead of bouncing forever
+float bounce_speed(const World* world, float velAlongNormal);
+
+// Run one collision iteration over the step's cached contacts, recording the
+// max penetration and approaching speed it saw in the world's stats
 void handle_collisions(World* world);
 
+// Make a body dynamic, kinematic or static. Kinematic and static bodies get
+// infinite mass; static ones also stop. world is NULL for a body that isn't
+// in one yet.
+void set_body_type(World* world, Body* body, BodyType type);
+
 // Apply forces to a body
 void apply_force(Body* body, float fx, float fy);
 
 // Apply an impulse to a body
 void apply_impulse(Body* body, float ix, float iy);
 
+// Get the solver counters for the last call to update_physics
+PhysicsStats get_physics_stats(const World* world);
+
 // Get body at position (returns NULL if no body at position)
 Body* get_body_at_position(World* world, int x, int y);
 
@@ -0,0 +1,178 @@
+#include "reorder.h"
+#include "body_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MORTON_BITS 16
+#define RADIX_BITS 8
+
+static void reserve_order(BodyOrder* order, int count) {
+    if (count > order->capacity) {
+        order->codes = realloc(order->codes, sizeof(unsigned) * 2 * count);
+        order->order = realloc(order->order, sizeof(int) * 2 * count);
+        order->capacity = count;
+    }
+    if (count > order->scratch_capacity) {
+        order->scratch = realloc(order->scratch, sizeof(Body) * count);
+        order->scratch_capacity = count;
+    }
+}
+
+// Spread the low 16 bits of value out to the even bits
+static unsigned spread_bits(unsigned value) {
+    value &= 0xFFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+static unsigned quantize(float value, float extent) {
+    float scaled = value / extent * ((1 << MORTON_BITS) - 1);
+    if (!(scaled > 0)) return 0;
+    if (scaled >= (1 << MORTON_BITS) - 1) return (1 << MORTON_BITS) - 1;
+    return (unsigned)scaled;
+}
+
+static unsigned morton_code(const World* world, const Body* body) {
+    return spread_bits(quantize(body->x, world->width)) |
+           spread_bits(quantize(body->y, world->height)) << 1;
+}
+
+// Radix sort body indices by Morton code, returning the sorted indices
+static const int* sort_by_morton(World* world) {
+    BodyOrder* order = &world->body_order;
+    int n = world->bodyCount;
+
+    // The scratch array is swapped in as the body storage, so it needs the
+    // pool's full capacity
+    reserve_order(order, world->body_pool.capacity);
+
+    unsigned* codes = order->codes;
+    unsigned* codesOut = order->codes + order->capacity;
+    int* indices = order->order;
+    int* indicesOut = order->order + order->capacity;
+    for (int i = 0; i < n; i++) {
+        codes[i] = morton_code(world, &world->bodies[i]);
+        indices[i] = i;
+    }
+
+    // Stable LSD radix sort, so bodies sharing a code keep their order
+    for (int shift = 0; shift < 2 * MORTON_BITS; shift += RADIX_BITS) {
+        int counts[(1 << RADIX_BITS) + 1];
+        memset(counts, 0, sizeof(counts));
+        for (int i = 0; i < n; i++) {
+            counts[((codes[i] >> shift) & ((1 << RADIX_BITS) - 1)) + 1]++;
+        }
+        for (int d = 0; d < 1 << RADIX_BITS; d++) {
+            counts[d + 1] += counts[d];
+        }
+        for (int i = 0; i < n; i++) {
+            int k = counts[(codes[i] >> shift) & ((1 << RADIX_BITS) - 1)]++;
+            codesOut[k] = codes[i];
+            indicesOut[k] = indices[i];
+        }
+        unsigned* codesSwap = codes;
+        codes = codesOut;
+        codesOut = codesSwap;
+        int* indicesSwap = indices;
+        indices = indicesOut;
+        indicesOut = indicesSwap;
+    }
+    return indices;
+}
+
+// Mean index gap the neighbor pairs would have in Morton order
+static float sorted_gap(World* world) {
+    BodyOrder* order = &world->body_order;
+    const NeighborList* list = &world->neighbors;
+    const int* sorted = sort_by_morton(world);
+    int* ranks = sorted == order->order ? order->order + order->capacity : order->order;
+    for (int k = 0; k < world->bodyCount; k++) {
+        ranks[sorted[k]] = k;
+    }
+
+    double gap = 0;
+    for (int i = 0; i < world->bodyCount; i++) {
+        for (int k = list->start[i]; k < list->start[i + 1]; k++) {
+            gap += abs(ranks[list->pairs[k]] - ranks[i]);
+        }
+    }
+    return (float)(gap / list->pair_count);
+}
+
+void reorder_bodies(World* world) {
+    BodyOrder* order = &world->body_order;
+    int n = world->bodyCount;
+    order->steps = 0;
+    order->base_gap = 0;
+    if (n < 2) return;
+
+    const int* sorted = sort_by_morton(world);
+
+    // Gather into the scratch array and swap it in. Everything else stored per
+    // body lives in the Body itself, so only the slot table needs remapping.
+    for (int i = 0; i < n; i++) {
+        order->scratch[i] = world->bodies[sorted[i]];
+    }
+    if (world->body_pool.mapping) {
+        // Bodies mapped from a snapshot can't be handed to the allocator
+        memcpy(world->bodies, order->scratch, sizeof(Body) * n);
+    } else {
+        // The old storage, sized to the pool, becomes the scratch. The pool
+        // may have been emptied and regrown since scratch was last sized, so
+        // either can be the smaller.
+        Body* previous = world->bodies;
+        world->bodies = order->scratch;
+        order->scratch = previous;
+        order->scratch_capacity = world->body_pool.capacity;
+    }
+    for (int i = 0; i < n; i++) {
+        update_body_slot(world, i);
+    }
+
+    // The step's contacts name bodies by index, and history and snapshots
+    // keep them, so point them at where their bodies went
+    int* ranks = sorted == order->order ? order->order + order->capacity : order->order;
+    for (int k = 0; k < n; k++) {
+        ranks[sorted[k]] = k;
+    }
+    ContactCache* cache = &world->contacts;
+    for (int k = 0; k < cache->count; k++) {
+        Contact* contact = &cache->contacts[k];
+        if (contact->a >= n || contact->b >= n) continue;
+        contact->a = ranks[contact->a];
+        if (contact->b >= 0) contact->b = ranks[contact->b];
+    }
+
+    invalidate_body_indices(world);
+    order->reorders++;
+}
+
+void update_body_order(World* world) {
+    BodyOrder* order = &world->body_order;
+    order->steps++;
+
+    bool due = world->reorder_interval > 0 && order->steps >= world->reorder_interval;
+
+    // Compare the lists' gap with the one Morton order gives, measured by
+    // the first build after a reorder or, before any, by a trial sort
+    const NeighborList* list = &world->neighbors;
+    if (world->reorder_locality > 0 && list->body_count == world->bodyCount && list->pair_count > 0) {
+        if (order->base_gap == 0) {
+            order->base_gap = order->reorders > 0 ? list->mean_gap : sorted_gap(world);
+        }
+        due = due || list->mean_gap > world->reorder_locality * order->base_gap;
+    }
+
+    if (due) reorder_bodies(world);
+    world->stats.reorders = order->reorders;
+}
+
+void free_body_order(BodyOrder* order) {
+    free(order->codes);
+    free(order->order);
+    free(order->scratch);
+    *order = (BodyOrder){0};
+}
@@ -0,0 +1,17 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+#include "../core/types.h"
+
+// Reorder body storage if the interval has passed, or if the neighbor lists
+// show pairs drifting apart in memory since the last reorder
+void update_body_order(World* world);
+
+// Sort bodies by the Morton code of their position. Handles stay valid;
+// raw indices and pointers into world->bodies do not.
+void reorder_bodies(World* world);
+
+// Release the sorting scratch
+void free_body_order(BodyOrder* order);
+
+#endif // REORDER_H
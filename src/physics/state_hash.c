@@ -0,0 +1,67 @@
+#include "state_hash.h"
+#include "physics.h"
+#include "../utils/thread_pool.h"
+#include <string.h>
+
+#define HASH_MAX_PARTS 64
+
+typedef struct {
+    const World* world;
+    int parts;
+    uint64_t sums[HASH_MAX_PARTS];
+} HashJob;
+
+// Finalizer from MurmurHash3, which spreads every input bit over the output
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t float_pair(float low, float high) {
+    uint32_t a, b;
+    memcpy(&a, &low, sizeof(a));
+    memcpy(&b, &high, sizeof(b));
+    return a | (uint64_t)b << 32;
+}
+
+// Four words per body, folded in with multiplies and mixed once. Every step
+// is integer arithmetic without branches, so bodies hash independently.
+static uint64_t hash_body(const Body* body) {
+    uint64_t h = (body->id | (uint64_t)body->type << 32 | (uint64_t)body->sleeping << 40) * 0x9e3779b97f4a7c15ull;
+    h = (h ^ float_pair(body->x, body->y)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ float_pair(body->vx, body->vy)) * 0x94d049bb133111ebull;
+    h = (h ^ float_pair(body->radius, body->mass)) * 0x9e3779b97f4a7c15ull;
+    return mix64(h);
+}
+
+static void hash_task(void* context, int begin, int end) {
+    HashJob* job = context;
+    int count = job->world->bodyCount;
+    for (int p = begin; p < end; p++) {
+        int first = (int)((long)count * p / job->parts);
+        int last = (int)((long)count * (p + 1) / job->parts);
+        uint64_t sum = 0;
+        for (int i = first; i < last; i++) {
+            sum += hash_body(&job->world->bodies[i]);
+        }
+        job->sums[p] = sum;
+    }
+}
+
+uint64_t hash_world_state(World* world) {
+    ThreadPool* pool = world->bodyCount >= HASH_PARALLEL_BODIES ? world_thread_pool(world) : NULL;
+    HashJob job = { .world = world, .parts = thread_pool_size(pool) * 4 };
+    if (job.parts > HASH_MAX_PARTS) job.parts = HASH_MAX_PARTS;
+    thread_pool_run(pool, job.parts, hash_task, &job);
+
+    // Integer sums come out the same however the bodies were split
+    uint64_t sum = 0;
+    for (int p = 0; p < job.parts; p++) {
+        sum += job.sums[p];
+    }
+    return mix64(sum ^ mix64((uint64_t)world->bodyCount));
+}
@@ -0,0 +1,13 @@
+#ifndef STATE_HASH_H
+#define STATE_HASH_H
+
+#include "../core/types.h"
+
+// Hash the id, type, sleep flag, position, velocity, radius and mass of
+// every body, bit for bit. Bodies are hashed one by one and the results
+// summed, so the hash doesn't depend on storage order or on how the bodies
+// are split across threads, and two worlds hash alike only if they hold
+// the same bodies in the same states, save for a 1 in 2^64 chance.
+uint64_t hash_world_state(World* world);
+
+#endif // STATE_HASH_H
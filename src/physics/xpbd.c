@@ -0,0 +1,151 @@
+#include "xpbd.h"
+#include "physics.h"
+#include "field.h"
+#include <math.h>
+#include <stdlib.h>
+
+static void reserve_xpbd(XpbdScratch* xpbd, int count) {
+    if (count <= xpbd->capacity) return;
+    xpbd->previous = realloc(xpbd->previous, sizeof(float) * 2 * count);
+    xpbd->capacity = count;
+}
+
+// Current contact normal and overlap
+static float constraint_normal(const World* world, Contact* contact, float* nx, float* ny) {
+    const Body* a = &world->bodies[contact->a];
+    if (contact->b < 0) {
+        float offset;
+        wall_plane(world, -1 - contact->b, nx, ny, &offset);
+        return a->x * *nx + a->y * *ny + a->radius - offset;
+    }
+
+    const Body* b = &world->bodies[contact->b];
+    float dx = b->x - a->x;
+    float dy = b->y - a->y;
+    float distance = sqrtf(dx * dx + dy * dy);
+    if (distance > 0) {
+        *nx = dx / distance;
+        *ny = dy / distance;
+    } else {
+        *nx = contact->nx;
+        *ny = contact->ny;
+    }
+    return a->radius + b->radius - distance;
+}
+
+static float normal_velocity(const World* world, const Contact* contact, float nx, float ny) {
+    const Body* a = &world->bodies[contact->a];
+    float bvx = 0, bvy = 0;
+    if (contact->b >= 0) {
+        bvx = world->bodies[contact->b].vx;
+        bvy = world->bodies[contact->b].vy;
+    }
+    return (bvx - a->vx) * nx + (bvy - a->vy) * ny;
+}
+
+void step_xpbd(World* world, float dt) {
+    reserve_xpbd(&world->xpbd, world->bodyCount);
+    float* previous = world->xpbd.previous;
+    int substeps = world->substeps > 0 ? world->substeps : 1;
+    float h = dt / substeps;
+
+    // Gather constraints once per step, wide enough to catch any pair that
+    // could touch before the step ends
+    find_contacts(world, 2 * max_body_speed(world) * dt + world->gravity * dt * dt);
+    ContactCache* cache = &world->contacts;
+
+    // Forces applied since the last step act over every substep
+    for (int s = 0; s < substeps; s++) {
+        // Record each contact's approach speed for the restitution pass
+        for (int c = 0; c < cache->count; c++) {
+            Contact* contact = &cache->contacts[c];
+            float nx, ny;
+            constraint_normal(world, contact, &nx, &ny);
+            contact->bounce = normal_velocity(world, contact, nx, ny);
+            contact->normal_impulse = 0;
+        }
+
+        // Predict positions
+        for (int i = 0; i < world->bodyCount; i++) {
+            Body* body = &world->bodies[i];
+            if (body->sleeping || body->type == BODY_STATIC) continue;
+            previous[2 * i] = body->x;
+            previous[2 * i + 1] = body->y;
+            body->vx += body->ax * h;
+            body->vy += body->ay * h;
+            body->x += body->vx * h;
+            body->y += body->vy * h;
+        }
+
+        // One projection pass; contacts are rigid, so the compliance term drops out
+        world->stats.max_penetration = 0;
+        for (int c = 0; c < cache->count; c++) {
+            Contact* contact = &cache->contacts[c];
+            float nx, ny;
+            float penetration = constraint_normal(world, contact, &nx, &ny);
+            if (penetration <= 0) continue;
+            if (penetration > world->stats.max_penetration) {
+                world->stats.max_penetration = penetration;
+            }
+
+            Body* a = &world->bodies[contact->a];
+            Body* b = contact->b >= 0 ? &world->bodies[contact->b] : NULL;
+            float invMassA = a->inv_mass;
+            float invMassB = b ? b->inv_mass : 0;
+            float lambda = penetration / (invMassA + invMassB);
+
+            a->x -= lambda * invMassA * nx;
+            a->y -= lambda * invMassA * ny;
+            if (b) {
+                b->x += lambda * invMassB * nx;
+                b->y += lambda * invMassB * ny;
+            }
+            contact->normal_impulse += lambda;
+            world->stats.position_corrections++;
+        }
+
+        // Velocities follow from the corrected positions
+        for (int i = 0; i < world->bodyCount; i++) {
+            Body* body = &world->bodies[i];
+            if (body->sleeping || body->type == BODY_STATIC) continue;
+            body->vx = (body->x - previous[2 * i]) / h;
+            body->vy = (body->y - previous[2 * i + 1]) / h;
+        }
+
+        // Replace the normal velocity of each projected contact with its bounce,
+        // using the approach speed from before the substep. This also removes
+        // the separating speed that pushing out an overlap adds.
+        for (int c = 0; c < cache->count; c++) {
+            Contact* contact = &cache->contacts[c];
+            if (contact->normal_impulse == 0) continue;
+
+            float nx, ny;
+            constraint_normal(world, contact, &nx, &ny);
+            float velAlongNormal = normal_velocity(world, contact, nx, ny);
+            float target = bounce_speed(world, contact->bounce);
+
+            Body* a = &world->bodies[contact->a];
+            Body* b = contact->b >= 0 ? &world->bodies[contact->b] : NULL;
+            float invMassA = a->inv_mass;
+            float invMassB = b ? b->inv_mass : 0;
+            float j = (target - velAlongNormal) / (invMassA + invMassB);
+
+            a->vx -= j * invMassA * nx;
+            a->vy -= j * invMassA * ny;
+            if (b) {
+                b->vx += j * invMassB * nx;
+                b->vy += j * invMassB * ny;
+            }
+            world->stats.impulses_applied++;
+        }
+        world->stats.iterations++;
+    }
+
+    // Only the field carries over, matching the Verlet path
+    apply_field(world);
+}
+
+void free_xpbd(XpbdScratch* xpbd) {
+    free(xpbd->previous);
+    *xpbd = (XpbdScratch){0};
+}
@@ -0,0 +1,15 @@
+#ifndef XPBD_H
+#define XPBD_H
+
+#include "../core/types.h"
+
+// Advance the world by dt with extended position-based dynamics: the step is
+// split into world->substeps substeps, each integrating positions, projecting
+// every contact and wall constraint once and deriving velocities from the
+// change in position
+void step_xpbd(World* world, float dt);
+
+// Release the solver's scratch storage
+void free_xpbd(XpbdScratch* xpbd);
+
+#endif // XPBD_H
@@ -85,8 +85,10 @@ void render_world(World* world) {
     
     for (int i = 0; i < world->bodyCount; i++) {
         Body* body = &world->bodies[i];
+        // Dim sleeping bodies so resting islands are easy to spot
+        Uint8 alpha = body->sleeping ? body->color.a / 2 : body->color.a;
         SDL_SetRenderDrawColor(world->renderer, 
-            body->color.r, body->color.g, body->color.b, body->color.a);
+            body->color.r, body->color.g, body->color.b, alpha);
             
         SDL_Rect rect = {
             (int)(body->x - body->radius),
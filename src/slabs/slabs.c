@@ -0,0 +1,211 @@
+#include "../core/types.h"
+#include "../physics/physics.h"
+#include "../io/scene.h"
+#include "../net/domain.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Headless split run: steps a scene in vertical slabs, one process each,
+// then steps it again in this process alone and reports how long each took
+// and how far apart the results ended up
+
+#define SLABS_DT (1.0f / 120)
+#define SLABS_PROCESSES 4
+#define SLABS_STEPS 600
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Step one slab of the world, then send the bodies it owns back on result
+static bool run_rank(World* world, int rank, int ranks, const float* bounds, float halo,
+                     int left, int right, int steps, int result) {
+    Domain* domain = join_domain(rank, ranks, bounds, halo, left, right);
+    keep_domain_bodies(domain, world);
+    bool connected = true;
+    for (int s = 0; s < steps && connected; s++) {
+        connected = exchange_domain(domain, world);
+        if (!connected) break;
+        update_physics(world, SLABS_DT);
+        drop_ghosts(domain, world);
+    }
+    if (!connected) {
+        fprintf(stderr, "Slab %d lost a neighbor\n", rank);
+    }
+    bool sent = send_bodies(result, world->bodies, world->bodyCount);
+    leave_domain(domain);
+    return connected && sent;
+}
+
+static int compare_ids(const void* a, const void* b) {
+    unsigned x = ((const Body*)a)->id, y = ((const Body*)b)->id;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <scene> [processes] [steps] [halo]\n", argv[0]);
+        return 1;
+    }
+    int ranks = argc > 2 ? atoi(argv[2]) : SLABS_PROCESSES;
+    int steps = argc > 3 ? atoi(argv[3]) : SLABS_STEPS;
+    if (ranks < 1 || steps < 0) {
+        fprintf(stderr, "Need at least one process and no negative steps\n");
+        return 1;
+    }
+
+    World world = {0};
+    init_physics(&world);
+    // Each slab steps on one thread, so compare against one thread; worker
+    // threads also wouldn't survive the fork
+    world.threads = 1;
+    if (!load_scene(&world, argv[1])) return 1;
+
+    // Settings that would otherwise be decided over the whole world. Islands
+    // can span slabs, and the slabs can't agree on when they sleep. Each slab
+    // would stop iterating once its own contacts converge. And storage stays
+    // in id order, which the slabs follow so their solvers visit contacts in
+    // the same order as one process.
+    world.sleep_energy_threshold = 0;
+    world.min_iterations = world.max_iterations;
+    world.reorder_interval = 0;
+    world.reorder_locality = 0;
+    if (world.field == FIELD_GRAVITATION || world.field == FIELD_ELECTROSTATIC) {
+        fprintf(stderr, "Mutual force fields need every body in one process\n");
+        cleanup_physics(&world);
+        return 1;
+    }
+
+    float halo = argc > 4 ? (float)atof(argv[4]) : domain_halo(&world, SLABS_DT);
+    float* bounds = malloc(sizeof(float) * (ranks + 1));
+    if (!split_domain(&world, ranks, halo, bounds)) {
+        fprintf(stderr, "Slabs for %d processes are narrower than the %.1f px halo\n", ranks, halo);
+        free(bounds);
+        cleanup_physics(&world);
+        return 1;
+    }
+
+    // A link between each pair of neighbors, and a channel back from each slab
+    int (*links)[2] = malloc(sizeof(int[2]) * ranks);
+    int (*results)[2] = malloc(sizeof(int[2]) * ranks);
+    for (int r = 0; r < ranks; r++) {
+        if ((r < ranks - 1 && socketpair(AF_UNIX, SOCK_STREAM, 0, links[r]) != 0) ||
+            socketpair(AF_UNIX, SOCK_STREAM, 0, results[r]) != 0) {
+            fprintf(stderr, "Failed to connect the slabs\n");
+            return 1;
+        }
+    }
+
+    fflush(stdout);
+    double start = now();
+    for (int r = 0; r < ranks; r++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Failed to start slab %d\n", r);
+            return 1;
+        }
+        if (pid > 0) continue;
+
+        // Keep only this slab's ends of the links
+        int left = r > 0 ? links[r - 1][1] : -1;
+        int right = r < ranks - 1 ? links[r][0] : -1;
+        for (int k = 0; k < ranks; k++) {
+            if (k < ranks - 1 && links[k][0] != right) close(links[k][0]);
+            if (k < ranks - 1 && links[k][1] != left) close(links[k][1]);
+            close(results[k][0]);
+            if (k != r) close(results[k][1]);
+        }
+        bool ok = run_rank(&world, r, ranks, bounds, halo, left, right, steps, results[r][1]);
+        exit(ok ? 0 : 1);
+    }
+    for (int r = 0; r < ranks; r++) {
+        if (r < ranks - 1) {
+            close(links[r][0]);
+            close(links[r][1]);
+        }
+        close(results[r][1]);
+    }
+
+    // Gather every slab's bodies
+    Body* split = NULL;
+    int splitCount = 0;
+    bool gathered = true;
+    for (int r = 0; r < ranks; r++) {
+        int count;
+        Body* bodies = receive_bodies(results[r][0], &count);
+        close(results[r][0]);
+        if (!bodies) {
+            gathered = false;
+            continue;
+        }
+        split = realloc(split, sizeof(Body) * (splitCount + count + 1));
+        for (int k = 0; k < count; k++) {
+            split[splitCount++] = bodies[k];
+        }
+        free(bodies);
+    }
+    for (int r = 0; r < ranks; r++) {
+        int status;
+        wait(&status);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) gathered = false;
+    }
+    double splitTime = now() - start;
+    if (!gathered) {
+        fprintf(stderr, "A slab failed\n");
+        return 1;
+    }
+
+    // The same steps in this process alone
+    start = now();
+    for (int s = 0; s < steps; s++) {
+        update_physics(&world, SLABS_DT);
+    }
+    double wholeTime = now() - start;
+
+    printf("%d bodies, %d steps, %.1f px halo\n", world.bodyCount, steps, halo);
+    printf("1 process:   %8.3f ms/step\n", wholeTime * 1000 / (steps > 0 ? steps : 1));
+    printf("%d processes: %8.3f ms/step, %.2fx\n", ranks, splitTime * 1000 / (steps > 0 ? steps : 1),
+        splitTime > 0 ? wholeTime / splitTime : 0);
+
+    // Match bodies by id to see how far the runs drifted apart
+    if (splitCount != world.bodyCount) {
+        printf("Body counts differ: %d split, %d whole\n", splitCount, world.bodyCount);
+    } else {
+        Body* whole = malloc(sizeof(Body) * (world.bodyCount + 1));
+        for (int i = 0; i < world.bodyCount; i++) {
+            whole[i] = world.bodies[i];
+        }
+        qsort(split, splitCount, sizeof(Body), compare_ids);
+        qsort(whole, world.bodyCount, sizeof(Body), compare_ids);
+        double maxDistance = 0, totalDistance = 0;
+        int mismatched = 0;
+        for (int i = 0; i < splitCount; i++) {
+            if (split[i].id != whole[i].id) {
+                mismatched++;
+                continue;
+            }
+            double distance = hypot(split[i].x - whole[i].x, split[i].y - whole[i].y);
+            if (distance > maxDistance) maxDistance = distance;
+            totalDistance += distance;
+        }
+        printf("Difference from one process: max %.4f px, mean %.4f px", maxDistance,
+            splitCount > 0 ? totalDistance / splitCount : 0);
+        if (mismatched) printf(", %d bodies missing", mismatched);
+        printf("\n");
+        free(whole);
+    }
+
+    free(split);
+    free(links);
+    free(results);
+    free(bounds);
+    cleanup_physics(&world);
+    return 0;
+}
@@ -1,4 +1,8 @@
 #include "ui.h"
+#include "../physics/physics.h"
+#include "../io/trajectory.h"
+#include "../io/history.h"
+#include "../net/replication.h"
 #include <stdio.h>
 
 bool init_ui(World* world) {
@@ -45,6 +49,83 @@ void cleanup_ui(World* world) {
     nk_sdl_shutdown();
 }
 
+static void draw_solver_stats(struct nk_context* ctx, const PhysicsStats* stats) {
+    char buffer[64];
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Pairs Tested: %d", stats->pairs_tested);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Contacts: %d", stats->contacts_found);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Speculative: %d", stats->speculative_contacts);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Tree Nodes: %d", stats->tree_nodes);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Separating: %d", stats->separating_contacts);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Impulses: %d", stats->impulses_applied);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Corrections: %d", stats->position_corrections);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Boundary Hits: %d", stats->boundary_hits);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    // Fraction of tested pairs that actually overlapped
+    float hit_rate = stats->pairs_tested > 0
+        ? 100.0f * stats->contacts_found / stats->pairs_tested : 0.0f;
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Iterations: %d", stats->iterations);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Pair Hit Rate: %.1f%%", hit_rate);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Neighbor Pairs: %d", stats->neighbor_pairs);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Steps/Rebuild: %.1f", stats->steps_per_rebuild);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Index Gap: %.1f", stats->neighbor_gap);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Reorders: %d", stats->reorders);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Events: %d", stats->events);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Stale Events: %d", stats->stale_events);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "CCD Swept: %d", stats->ccd_bodies);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "CCD Impacts: %d", stats->ccd_impacts);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Islands: %d", stats->islands);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Sleeping: %d", stats->sleeping_bodies);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 2);
+    snprintf(buffer, sizeof(buffer), "Max Penetration: %.2f", stats->max_penetration);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+    snprintf(buffer, sizeof(buffer), "Max Approach: %.2f", stats->max_approach_speed);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+
+    nk_layout_row_dynamic(ctx, 20, 1);
+    snprintf(buffer, sizeof(buffer), "State Hash: %016llx", (unsigned long long)stats->state_hash);
+    nk_label(ctx, buffer, NK_TEXT_LEFT);
+}
+
 static void draw_body_properties(struct nk_context* ctx, Body* body, int index) {
     char buffer[256];
     
@@ -97,9 +178,15 @@ static void draw_body_properties(struct nk_context* ctx, Body* body, int index)
         snprintf(buffer, sizeof(buffer), "Acceleration: %.2f", accel);
         nk_label(ctx, buffer, NK_TEXT_LEFT);
 
-        nk_layout_row_dynamic(ctx, 20, 1);
+        nk_layout_row_dynamic(ctx, 20, 2);
         snprintf(buffer, sizeof(buffer), "Kinetic Energy: %.2f", ke);
         nk_label(ctx, buffer, NK_TEXT_LEFT);
+        nk_label(ctx, body->sleeping ? "Sleeping" : "Awake", NK_TEXT_LEFT);
+
+        static const char* types[] = { "Dynamic", "Kinematic", "Static" };
+        nk_layout_row_dynamic(ctx, 20, 1);
+        snprintf(buffer, sizeof(buffer), "Type: %s", types[body->type]);
+        nk_label(ctx, buffer, NK_TEXT_LEFT);
 
         nk_tree_pop(ctx);
     }
@@ -125,6 +212,88 @@ void update_ui(World* world) {
         char buffer[32];
         snprintf(buffer, sizeof(buffer), "Total Bodies: %d", world->bodyCount);
         nk_label(world->nk_ctx, buffer, NK_TEXT_LEFT);
+        if (world->recorder) {
+            snprintf(buffer, sizeof(buffer), "Recording, Dropped: %ld",
+                trajectory_dropped_frames(world->recorder));
+            nk_label(world->nk_ctx, buffer, NK_TEXT_LEFT);
+        }
+        if (world->replication) {
+            snprintf(buffer, sizeof(buffer), "Replicas: %d, Delta: %zu B",
+                replication_clients(world->replication), replication_delta_bytes(world->replication));
+            nk_label(world->nk_ctx, buffer, NK_TEXT_LEFT);
+        }
+
+        // Timeline of the kept steps. Dragging it rewinds the world and
+        // pauses it there; resuming steps on from the rewound step.
+        long oldest, newest;
+        if (world->history && history_range(world->history, &oldest, &newest)) {
+            snprintf(buffer, sizeof(buffer), "History: %ld steps, %.1f MB",
+                newest - oldest + 1, history_bytes(world->history) / (1024.0 * 1024.0));
+            nk_label(world->nk_ctx, buffer, NK_TEXT_LEFT);
+            nk_layout_row_dynamic(world->nk_ctx, 25, 2);
+            int step = (int)history_step(world->history);
+            if (nk_slider_int(world->nk_ctx, (int)oldest, &step, (int)newest, 1) &&
+                rewind_history(world->history, world, step)) {
+                world->paused = true;
+            }
+            if (nk_button_label(world->nk_ctx, world->paused ? "Resume" : "Pause")) {
+                world->paused = !world->paused;
+            }
+        }
+
+        // Solver Stats
+        nk_layout_row_dynamic(world->nk_ctx, 30, 1);
+        nk_label(world->nk_ctx, "Solver Stats", NK_TEXT_LEFT);
+        PhysicsStats stats = get_physics_stats(world);
+        draw_solver_stats(world->nk_ctx, &stats);
+
+        nk_layout_row_dynamic(world->nk_ctx, 25, 1);
+        nk_property_int(world->nk_ctx, "Max Iterations:", 1, &world->max_iterations, 64, 1, 1);
+        nk_property_float(world->nk_ctx, "Neighbor Skin:", 0.0f, &world->neighbor_skin, 64.0f, 1.0f, 0.5f);
+        nk_property_int(world->nk_ctx, "Reorder Interval:", 0, &world->reorder_interval, 10000, 10, 10);
+        nk_property_float(world->nk_ctx, "Reorder Locality:", 0.0f, &world->reorder_locality, 16.0f, 0.5f, 0.1f);
+        nk_property_float(world->nk_ctx, "Gravity:", 0.0f, &world->gravity, 5000.0f, 10.0f, 5.0f);
+        nk_property_float(world->nk_ctx, "Restitution:", 0.0f, &world->restitution, 1.0f, 0.05f, 0.01f);
+
+        static const char* fields[] = { "Uniform", "Gravitation", "Electrostatic", "None" };
+        nk_layout_row_dynamic(world->nk_ctx, 25, 2);
+        nk_label(world->nk_ctx, "Force Field:", NK_TEXT_LEFT);
+        world->field = nk_combo(world->nk_ctx, fields, 4,
+            world->field, 25, nk_vec2(200, 140));
+
+        static const char* field_methods[] = { "Barnes-Hut", "Particle Mesh" };
+        nk_layout_row_dynamic(world->nk_ctx, 25, 2);
+        nk_label(world->nk_ctx, "Field Method:", NK_TEXT_LEFT);
+        world->field_method = nk_combo(world->nk_ctx, field_methods, 2,
+            world->field_method, 25, nk_vec2(200, 80));
+
+        // Mesh sizes must be powers of two
+        static const char* mesh_sizes[] = { "64", "128", "256", "512" };
+        int mesh_index = 0;
+        while (mesh_index < 3 && (64 << mesh_index) < world->mesh_size) mesh_index++;
+        nk_layout_row_dynamic(world->nk_ctx, 25, 2);
+        nk_label(world->nk_ctx, "Mesh Size:", NK_TEXT_LEFT);
+        world->mesh_size = 64 << nk_combo(world->nk_ctx, mesh_sizes, 4,
+            mesh_index, 25, nk_vec2(200, 140));
+
+        nk_layout_row_dynamic(world->nk_ctx, 25, 1);
+        nk_property_float(world->nk_ctx, "Opening Angle:", 0.0f, &world->opening_angle, 1.0f, 0.1f, 0.01f);
+        nk_property_int(world->nk_ctx, "Field Threads:", 1, &world->threads, 64, 1, 1);
+
+        static const char* solvers[] = { "Impulse", "XPBD", "Event" };
+        nk_layout_row_dynamic(world->nk_ctx, 25, 2);
+        nk_label(world->nk_ctx, "Solver:", NK_TEXT_LEFT);
+        world->solver = nk_combo(world->nk_ctx, solvers, 3,
+            world->solver, 25, nk_vec2(200, 120));
+
+        nk_layout_row_dynamic(world->nk_ctx, 25, 1);
+        nk_property_int(world->nk_ctx, "XPBD Substeps:", 1, &world->substeps, 64, 1, 1);
+
+        static const char* collision_modes[] = { "Discrete", "CCD", "Speculative" };
+        nk_layout_row_dynamic(world->nk_ctx, 25, 2);
+        nk_label(world->nk_ctx, "Collision Mode:", NK_TEXT_LEFT);
+        world->collision_mode = nk_combo(world->nk_ctx, collision_modes, 3,
+            world->collision_mode, 25, nk_vec2(200, 120));
 
         // Separator
         nk_layout_row_dynamic(world->nk_ctx, 10, 1);
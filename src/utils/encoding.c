@@ -0,0 +1,58 @@
+#include "encoding.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void reserve_bytes(ByteBuffer* buffer, size_t size) {
+    if (size <= buffer->capacity) return;
+    size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+    while (capacity < size) capacity *= 2;
+    buffer->data = realloc(buffer->data, capacity);
+    buffer->capacity = capacity;
+}
+
+void put_bytes(ByteBuffer* buffer, const void* data, size_t size) {
+    if (size == 0) return;
+    reserve_bytes(buffer, buffer->size + size);
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+void put_varint(ByteBuffer* buffer, uint32_t value) {
+    reserve_bytes(buffer, buffer->size + 5);
+    while (value >= 0x80) {
+        buffer->data[buffer->size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buffer->data[buffer->size++] = (unsigned char)value;
+}
+
+bool get_varint(const unsigned char** cursor, const unsigned char* end, uint32_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 35 && *cursor < end; shift += 7) {
+        unsigned char byte = *(*cursor)++;
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+int32_t quantize(float value, float quantum) {
+    float scaled = roundf(value / quantum);
+    if (!(scaled > -2147483520.0f)) return scaled > 0 ? INT32_MAX : INT32_MIN + 1;
+    if (scaled >= 2147483520.0f) return INT32_MAX;
+    return (int32_t)scaled;
+}
+
+void free_bytes(ByteBuffer* buffer) {
+    free(buffer->data);
+    *buffer = (ByteBuffer){0};
+}
@@ -0,0 +1,41 @@
+#ifndef ENCODING_H
+#define ENCODING_H
+
+// Growable byte buffers and the compact integer coding shared by the
+// trajectory recorder and replication. Stands alone so that tools reading
+// those streams don't need the engine's types.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+// Make room for at least size bytes in total
+void reserve_bytes(ByteBuffer* buffer, size_t size);
+
+// Append size raw bytes
+void put_bytes(ByteBuffer* buffer, const void* data, size_t size);
+
+// Append value as an LEB128 varint: seven bits per byte, high bit set on all
+// but the last
+void put_varint(ByteBuffer* buffer, uint32_t value);
+
+// Read a varint at cursor, advancing it. Returns false if it runs past end.
+bool get_varint(const unsigned char** cursor, const unsigned char* end, uint32_t* value);
+
+// Map signed deltas to unsigned so small magnitudes of either sign stay short
+uint32_t zigzag(int32_t value);
+int32_t unzigzag(uint32_t value);
+
+// value in whole quanta, rounded and saturated to the int32 range
+int32_t quantize(float value, float quantum);
+
+// Release the buffer's storage
+void free_bytes(ByteBuffer* buffer);
+
+#endif // ENCODING_H
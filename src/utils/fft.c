@@ -0,0 +1,81 @@
+#include "fft.h"
+#include <math.h>
+#include <string.h>
+
+void fft(float* data, int n, bool inverse) {
+    // Bit-reversal permutation
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            float re = data[2 * i], im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    // Butterflies; twiddles advance in double so long transforms stay accurate
+    for (int len = 2; len <= n; len <<= 1) {
+        double angle = (inverse ? 2 : -2) * M_PI / len;
+        double stepRe = cos(angle), stepIm = sin(angle);
+        for (int start = 0; start < n; start += len) {
+            double wRe = 1, wIm = 0;
+            for (int k = 0; k < len / 2; k++) {
+                float* a = &data[2 * (start + k)];
+                float* b = &data[2 * (start + k + len / 2)];
+                float tRe = (float)(b[0] * wRe - b[1] * wIm);
+                float tIm = (float)(b[0] * wIm + b[1] * wRe);
+                b[0] = a[0] - tRe;
+                b[1] = a[1] - tIm;
+                a[0] += tRe;
+                a[1] += tIm;
+
+                double nextRe = wRe * stepRe - wIm * stepIm;
+                wIm = wRe * stepIm + wIm * stepRe;
+                wRe = nextRe;
+            }
+        }
+    }
+
+    if (inverse) {
+        float scale = 1.0f / n;
+        for (int i = 0; i < 2 * n; i++) data[i] *= scale;
+    }
+}
+
+typedef struct {
+    float* data;
+    int size;
+    bool inverse;
+} FftJob;
+
+static void row_task(void* context, int begin, int end) {
+    FftJob* job = context;
+    for (int row = begin; row < end; row++) {
+        fft(&job->data[2 * row * job->size], job->size, job->inverse);
+    }
+}
+
+// Columns are gathered into a contiguous buffer so each transform stays in cache
+static void column_task(void* context, int begin, int end) {
+    FftJob* job = context;
+    float column[2 * FFT_MAX_SIZE];
+    for (int col = begin; col < end; col++) {
+        for (int row = 0; row < job->size; row++) {
+            memcpy(&column[2 * row], &job->data[2 * (row * job->size + col)], sizeof(float) * 2);
+        }
+        fft(column, job->size, job->inverse);
+        for (int row = 0; row < job->size; row++) {
+            memcpy(&job->data[2 * (row * job->size + col)], &column[2 * row], sizeof(float) * 2);
+        }
+    }
+}
+
+void fft_2d(float* data, int size, bool inverse, ThreadPool* pool) {
+    FftJob job = { data, size, inverse };
+    thread_pool_run(pool, size, row_task, &job);
+    thread_pool_run(pool, size, column_task, &job);
+}
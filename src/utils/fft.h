@@ -0,0 +1,18 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include "thread_pool.h"
+
+// Largest transform length supported along one axis
+#define FFT_MAX_SIZE 4096
+
+// In-place radix-2 FFT of n complex values stored as interleaved real and
+// imaginary floats. n must be a power of two. The inverse transform is
+// scaled by 1/n, so a forward and inverse pair round trips.
+void fft(float* data, int n, bool inverse);
+
+// In-place 2D FFT of a size x size grid of interleaved complex values in
+// row-major order, with rows and columns split across the pool
+void fft_2d(float* data, int size, bool inverse, ThreadPool* pool);
+
+#endif // FFT_H
@@ -2,8 +2,14 @@
 #include <stdlib.h>
 #include <time.h>
 
-void init_random(void) {
-    srand(time(NULL));
+unsigned init_random(void) {
+    unsigned seed = (unsigned)time(NULL);
+    srand(seed);
+    return seed;
+}
+
+void seed_random(unsigned seed) {
+    srand(seed);
 }
 
 float random_float(float min, float max) {
@@ -3,8 +3,11 @@
 
 #include <SDL2/SDL.h>
 
-// Initialize random number generator
-void init_random(void);
+// Seed the random number generator from the clock, returning the seed
+unsigned init_random(void);
+
+// Seed the random number generator so it repeats an earlier sequence
+void seed_random(unsigned seed);
 
 // Get random float between min and max
 float random_float(float min, float max);
@@ -0,0 +1,130 @@
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Chunks handed out per thread, so uneven chunks still balance
+#define CHUNKS_PER_THREAD 4
+
+struct ThreadPool {
+    pthread_t* workers;
+    int size;                   // Threads including the caller
+    pthread_mutex_t lock;
+    pthread_cond_t start;       // Signalled when a loop is posted or the pool stops
+    pthread_cond_t done;        // Signalled when the last worker leaves a loop
+    ThreadTask task;
+    void* context;
+    int count;
+    int chunk;
+    int next;                   // First index not yet claimed
+    int active;                 // Workers still inside the current loop
+    unsigned long generation;   // Bumped for every posted loop
+    bool stopping;
+};
+
+// Claim and run chunks until the loop is exhausted
+static void run_chunks(ThreadPool* pool) {
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int begin = pool->next;
+        pool->next += pool->chunk;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (begin >= pool->count) return;
+        int end = begin + pool->chunk < pool->count ? begin + pool->chunk : pool->count;
+        pool->task(pool->context, begin, end);
+    }
+}
+
+static void* worker_main(void* arg) {
+    ThreadPool* pool = arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && !pool->stopping) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stopping) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_chunks(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool* create_thread_pool(int threads) {
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    pool->size = threads > 1 ? threads : 1;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->workers = malloc(sizeof(pthread_t) * pool->size);
+    for (int i = 0; i < pool->size - 1; i++) {
+        pthread_create(&pool->workers[i], NULL, worker_main, pool);
+    }
+    return pool;
+}
+
+void destroy_thread_pool(ThreadPool* pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->size - 1; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+}
+
+int thread_pool_size(const ThreadPool* pool) {
+    return pool ? pool->size : 1;
+}
+
+void thread_pool_run(ThreadPool* pool, int count, ThreadTask task, void* context) {
+    if (count <= 0) return;
+    if (!pool || pool->size == 1) {
+        task(context, 0, count);
+        return;
+    }
+
+    int chunk = count / (pool->size * CHUNKS_PER_THREAD);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->count = count;
+    pool->chunk = chunk > 0 ? chunk : 1;
+    pool->next = 0;
+    pool->active = pool->size - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    // The caller works through chunks alongside the workers
+    run_chunks(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int default_thread_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 1 ? (int)count : 1;
+}
@@ -0,0 +1,25 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "../core/types.h"
+
+// Work on the index range [begin, end) of a parallel loop
+typedef void (*ThreadTask)(void* context, int begin, int end);
+
+// Start a pool that runs loops on the calling thread plus threads - 1 workers
+ThreadPool* create_thread_pool(int threads);
+
+// Stop and join the workers
+void destroy_thread_pool(ThreadPool* pool);
+
+// Threads the pool runs loops on, including the caller
+int thread_pool_size(const ThreadPool* pool);
+
+// Split [0, count) into chunks and run task on them across the pool,
+// returning once every chunk is done. A NULL pool runs the loop inline.
+void thread_pool_run(ThreadPool* pool, int count, ThreadTask task, void* context);
+
+// Number of online processors, at least 1
+int default_thread_count(void);
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,118 @@
+#include "../io/state_buffer.h"
+#include "../net/replica.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Headless viewer: follows a running engine through its shared state buffer,
+// or a replica of its state over a socket, and prints a summary of the newest
+// step once a second. It only needs the wire layouts, not SDL or the engine.
+
+#define WATCH_INTERVAL_MS 1000
+#define WATCH_RETRIES 8     // Attempts at a consistent frame before giving up on this interval
+
+typedef struct {
+    int count;
+    float kinetic_energy;
+    float max_speed_sq;
+} FrameSummary;
+
+static void summarize(const SharedFrameView* view, FrameSummary* summary) {
+    *summary = (FrameSummary){ .count = view->count };
+    for (int i = 0; i < view->count; i++) {
+        const SharedBody* body = &view->bodies[i];
+        float speedSq = body->vx * body->vx + body->vy * body->vy;
+        summary->kinetic_energy += 0.5f * body->mass * speedSq;
+        if (speedSq > summary->max_speed_sq) summary->max_speed_sq = speedSq;
+    }
+}
+
+static void wait_interval(void) {
+    struct timespec interval = { WATCH_INTERVAL_MS / 1000, (WATCH_INTERVAL_MS % 1000) * 1000000L };
+    nanosleep(&interval, NULL);
+}
+
+// Follow a replication server, applying everything it sent between reports
+static int watch_replica(const char* address, int reports) {
+    ReplicaClient* client = connect_replica(address);
+    if (!client) {
+        fprintf(stderr, "No engine is serving replicas at %s\n", address);
+        return 1;
+    }
+
+    const Replica* replica = client_replica(client);
+    uint64_t lastStep = 0, lastBytes = 0;
+    for (int report = 0; reports == 0 || report < reports; report++) {
+        if (receive_replica(client, report == 0) < 0) {
+            printf("connection closed\n");
+            break;
+        }
+
+        FrameSummary summary = { .count = replica->count };
+        for (int s = 0; s < replica->slots; s++) {
+            const ReplicaBody* body = &replica->bodies[s];
+            if (body->id == 0) continue;
+            float speedSq = body->vx * body->vx + body->vy * body->vy;
+            summary.kinetic_energy += 0.5f * body->mass * speedSq;
+            if (speedSq > summary.max_speed_sq) summary.max_speed_sq = speedSq;
+        }
+        printf("step %llu: %d bodies, %.0f steps/s, kinetic energy %.1f, max speed %.1f, %.1f KB/s, keyframes %ld\n",
+            (unsigned long long)replica->step, summary.count,
+            (double)(replica->step - lastStep) * 1000 / WATCH_INTERVAL_MS,
+            summary.kinetic_energy, sqrtf(summary.max_speed_sq),
+            (double)(replica->bytes - lastBytes) / WATCH_INTERVAL_MS, replica->keyframes);
+        fflush(stdout);
+        lastStep = replica->step;
+        lastBytes = replica->bytes;
+        wait_interval();
+    }
+
+    close_replica(client);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    // Optional buffer name, or replication address, and number of reports,
+    // 0 to watch until killed
+    const char* name = argc > 1 ? argv[1] : STATE_BUFFER_NAME;
+    int reports = argc > 2 ? atoi(argv[2]) : 0;
+    if (strchr(name, ':')) return watch_replica(name, reports);
+
+    StateReader* reader = open_state_reader(name);
+    if (!reader) {
+        fprintf(stderr, "No engine is publishing state under %s\n", name);
+        return 1;
+    }
+
+    uint64_t lastStep = 0;
+    long torn = 0;
+    for (int report = 0; reports == 0 || report < reports; report++) {
+        // Read the frame in place, and only trust it if the writer left it alone
+        SharedFrameView view;
+        FrameSummary summary;
+        bool consistent = false;
+        for (int attempt = 0; attempt < WATCH_RETRIES && !consistent; attempt++) {
+            if (!begin_shared_frame(reader, &view)) continue;
+            summarize(&view, &summary);
+            consistent = end_shared_frame(&view);
+            if (!consistent) torn++;
+        }
+
+        if (consistent) {
+            printf("step %llu: %d bodies, %.0f steps/s, kinetic energy %.1f, max speed %.1f, torn reads %ld\n",
+                (unsigned long long)view.step, summary.count,
+                (double)(view.step - lastStep) * 1000 / WATCH_INTERVAL_MS,
+                summary.kinetic_energy, sqrtf(summary.max_speed_sq), torn);
+            lastStep = view.step;
+        } else {
+            printf("waiting for a frame\n");
+        }
+        fflush(stdout);
+        wait_interval();
+    }
+
+    close_state_reader(reader);
+    return 0;
+}